@@ -47,6 +47,7 @@ int Checker_isValid(Chunk_T oHeapStart, Chunk_T oHeapEnd,
    }
    
    /* Traverse memory through forward links. */
+   oPrevChunk = NULL;
    for (oChunk = oHeapStart;
         oChunk != NULL;
         oChunk = Chunk_getNextInMem(oChunk, oHeapEnd))
@@ -57,9 +58,24 @@ int Checker_isValid(Chunk_T oHeapStart, Chunk_T oHeapEnd,
          fprintf(stderr, "Traversing memory detected a bad chunk\n");
          return FALSE;
       }  
+
+#ifdef CHUNK_FOOTERLESS
+      /* Does the header record the status of the chunk before it? The
+         first chunk has none, and records one in use. */
+      if (Chunk_getPrevStatus(oChunk) != ((oPrevChunk == NULL) ?
+             CHUNK_INUSE : Chunk_getStatus(oPrevChunk)))
+      {
+         fprintf(stderr, "A header records the wrong status of"
+                 " the chunk before it\n");
+         return FALSE;
+      }
+#endif
+      oPrevChunk = oChunk;
    }
 
-   /* Traverse memory through backward links. */
+#ifndef CHUNK_FOOTERLESS
+   /* Traverse memory through backward links, which only free chunks
+      have without footers on chunks in use. */
    for (oChunk = Chunk_getPrevInMem(oHeapEnd, oHeapStart);
         oChunk != NULL;
         oChunk = Chunk_getPrevInMem(oChunk, oHeapStart))
@@ -73,6 +89,7 @@ int Checker_isValid(Chunk_T oHeapStart, Chunk_T oHeapEnd,
       }
 
    }
+#endif
 
    /* fwd cycle detection */
    oFreeListEnd = NULL;
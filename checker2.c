@@ -13,6 +13,14 @@ enum {FALSE, TRUE};
 
 int Checker_isValid(Chunk_T oHeapStart, Chunk_T oHeapEnd,
                     Chunk_T aoBins[], int iBinCount)
+{
+   return Checker_isValidBins(oHeapStart, oHeapEnd, aoBins, iBinCount,
+                              NULL);
+}
+
+int Checker_isValidBins(Chunk_T oHeapStart, Chunk_T oHeapEnd,
+                        Chunk_T aoBins[], int iBinCount,
+                        size_t (*pfGetBinIndex)(size_t uUnits))
 {
    Chunk_T oChunk; /* current chunk in traversals */
    Chunk_T oPrevChunk; /* previous chunk in traversals */
@@ -54,6 +62,7 @@ int Checker_isValid(Chunk_T oHeapStart, Chunk_T oHeapEnd,
    }
    
    /* Traverse memory through forward links. */
+   oPrevChunk = NULL;
    for (oChunk = oHeapStart;
         oChunk != NULL;
         oChunk = Chunk_getNextInMem(oChunk, oHeapEnd))
@@ -64,9 +73,24 @@ int Checker_isValid(Chunk_T oHeapStart, Chunk_T oHeapEnd,
          fprintf(stderr, "Traversing memory detected a bad chunk\n");
          return FALSE;
       }
+
+#ifdef CHUNK_FOOTERLESS
+      /* Does the header hold the status of the chunk before it, or for
+         the first chunk, of one in use? */
+      if (Chunk_getPrevStatus(oChunk) != ((oPrevChunk == NULL) ?
+             CHUNK_INUSE : Chunk_getStatus(oPrevChunk)))
+      {
+         fprintf(stderr, "A chunk header has a wrong status for"
+                 " the chunk before it\n");
+         return FALSE;
+      }
+#endif
+      oPrevChunk = oChunk;
    }
 
-   /* Traverse memory through backward links. */
+#ifndef CHUNK_FOOTERLESS
+   /* Traverse memory through backward links, if chunks in use have
+      footers to follow. */
    for (oChunk = Chunk_getPrevInMem(oHeapEnd, oHeapStart);
         oChunk != NULL;
         oChunk = Chunk_getPrevInMem(oChunk, oHeapStart))
@@ -79,6 +103,7 @@ int Checker_isValid(Chunk_T oHeapStart, Chunk_T oHeapEnd,
          return FALSE;
       }
    }
+#endif
 
    /* for each bin */
    for (iIndex = 0; iIndex < iBinCount; iIndex++)
@@ -261,7 +286,21 @@ int Checker_isValid(Chunk_T oHeapStart, Chunk_T oHeapEnd,
    for (iIndex = 0; iIndex < iBinCount; iIndex++)
    {
       /* make sure that each item in each list has the right size, 
-         skipping the last list */
+         skipping the last list unless the bins are given */
+      if (pfGetBinIndex != NULL)
+      {
+         for (oChunk = aoBins[iIndex];
+              oChunk != NULL;
+              oChunk = Chunk_getNextInList(oChunk))
+            if ((*pfGetBinIndex)(Chunk_getUnits(oChunk))
+                != (size_t)iIndex)
+            {
+               fprintf(stderr, "chunk with %d units in bin %d\n",
+                       (int) Chunk_getUnits(oChunk), iIndex);
+               return FALSE;
+            }
+         continue;
+      }
       if (iIndex == (iBinCount - 1)) continue;     
       for (oChunk = aoBins[iIndex];
            oChunk != NULL;
@@ -17,4 +17,13 @@
 int Checker_isValid(Chunk_T oHeapStart, Chunk_T oHeapEnd,
    Chunk_T aoBins[], int iBinCount);
 
+/* Return 1 (TRUE) if the heap is in a valid state, or 0 (FALSE)
+   otherwise, as Checker_isValid() does, except that each chunk of
+   uUnits units must be in bin (*pfGetBinIndex)(uUnits), rather than
+   in bin uUnits or, if that is past the end, in the last bin. */
+
+int Checker_isValidBins(Chunk_T oHeapStart, Chunk_T oHeapEnd,
+   Chunk_T aoBins[], int iBinCount,
+   size_t (*pfGetBinIndex)(size_t uUnits));
+
 #endif
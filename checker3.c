@@ -0,0 +1,224 @@
+/*--------------------------------------------------------------------*/
+/* checker3.c                                                         */
+/* Author: Nate Wilson                                                */
+/* Author: Narek Galstyan                                             */
+/*--------------------------------------------------------------------*/
+
+#include "checker3.h"
+#include <stdio.h>
+#include <assert.h>
+
+/* In lieu of a boolean data type. */
+enum {FALSE, TRUE};
+
+/* Return the index into the free lists of chunks of uUnits units,
+   worked out here apart from the heap manager: class 0 holds one size
+   per list, and each class past it the sizes with a given leading bit,
+   split by the iSecondLog2 bits after it. */
+
+static int Checker_getListIndex(size_t uUnits, int iSecondLog2)
+{
+   int iLeadingBit = 0; /* the position of the leading bit of uUnits */
+   size_t uSecondCount = (size_t)1 << iSecondLog2;
+
+   if (uUnits < uSecondCount)
+      return (int)uUnits;
+   while ((uUnits >> iLeadingBit) > 1)
+      iLeadingBit++;
+   return (iLeadingBit - iSecondLog2 + 1) * (int)uSecondCount
+          + (int)((uUnits >> (iLeadingBit - iSecondLog2))
+                  - uSecondCount);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Checker_isValid(Chunk_T oHeapStart, Chunk_T oHeapEnd,
+   Chunk_T aoLists[], unsigned long ulFirstMap,
+   unsigned long aulSecondMaps[], int iFirstCount, int iSecondLog2)
+{
+   Chunk_T oChunk; /* current chunk in traversals */
+   Chunk_T oPrevChunk; /* previous chunk in traversals */
+   Chunk_T oHareChunk; /* used in cycle detection */
+   size_t uFreeInMem = 0; /* free chunks found in memory */
+   size_t uFreeInLists = 0; /* chunks found in the free lists */
+   int iSecondCount;
+   int iFirst;
+   int iSecond;
+   int iIndex;
+
+   /* validate params */
+   assert(aoLists != NULL);
+   assert(aulSecondMaps != NULL);
+   iSecondCount = 1 << iSecondLog2;
+
+   /* check for an initialized heap */
+   if (oHeapStart == NULL)
+   {
+      fprintf(stderr, "The heap start is uninitialized\n");
+      return FALSE;
+   }
+   if (oHeapEnd == NULL)
+   {
+      fprintf(stderr, "The heap end is uninitialized\n");
+      return FALSE;
+   }
+
+   /* Traverse memory through forward links. */
+   oPrevChunk = NULL;
+   for (oChunk = (oHeapStart == oHeapEnd) ? NULL : oHeapStart;
+        oChunk != NULL;
+        oChunk = Chunk_getNextInMem(oChunk, oHeapEnd))
+   {
+      /* Is the chunk valid? */
+      if (! Chunk_isValid(oChunk, oHeapStart, oHeapEnd))
+      {
+         fprintf(stderr, "Traversing memory detected a bad chunk\n");
+         return FALSE;
+      }
+
+#ifdef CHUNK_FOOTERLESS
+      /* Does it record the status of the chunk before it? The first
+         one records a chunk in use, as it has nothing to merge with. */
+      if (Chunk_getPrevStatus(oChunk) != ((oPrevChunk == NULL) ?
+             CHUNK_INUSE : Chunk_getStatus(oPrevChunk)))
+      {
+         fprintf(stderr, "A chunk records the wrong status for the"
+                 " chunk before it\n");
+         return FALSE;
+      }
+#endif
+
+      /* Is it free right after a free chunk? */
+      if (Chunk_getStatus(oChunk) == CHUNK_FREE)
+      {
+         if ((oPrevChunk != NULL) &&
+             (Chunk_getStatus(oPrevChunk) == CHUNK_FREE))
+         {
+            fprintf(stderr, "The heap contains contiguous free"
+                    " chunks\n");
+            return FALSE;
+         }
+         uFreeInMem++;
+      }
+      oPrevChunk = oChunk;
+   }
+
+#ifndef CHUNK_FOOTERLESS
+   /* Traverse memory through backward links. Without footers on
+      chunks in use, there are none to follow past those. */
+   for (oChunk = (oHeapStart == oHeapEnd) ? NULL :
+           Chunk_getPrevInMem(oHeapEnd, oHeapStart);
+        oChunk != NULL;
+        oChunk = Chunk_getPrevInMem(oChunk, oHeapStart))
+   {
+      /* Is the chunk valid? */
+      if (! Chunk_isValid(oChunk, oHeapStart, oHeapEnd))
+      {
+         fprintf(stderr, "Backward traversing memory"
+                 " detected a bad chunk\n");
+         return FALSE;
+      }
+   }
+#endif
+
+   for (iFirst = 0; iFirst < iFirstCount; iFirst++)
+   {
+      /* Does the first-level bitmap agree with the second-level one? */
+      if (((ulFirstMap >> iFirst) & 1UL) !=
+          (unsigned long)(aulSecondMaps[iFirst] != 0))
+      {
+         fprintf(stderr, "First-level bit %d is wrong\n", iFirst);
+         return FALSE;
+      }
+
+      for (iSecond = 0; iSecond < iSecondCount; iSecond++)
+      {
+         iIndex = iFirst * iSecondCount + iSecond;
+
+         /* Does the second-level bitmap agree with the list? */
+         if (((aulSecondMaps[iFirst] >> iSecond) & 1UL) !=
+             (unsigned long)(aoLists[iIndex] != NULL))
+         {
+            fprintf(stderr, "Second-level bit %d of class %d is"
+                    " wrong\n", iSecond, iFirst);
+            return FALSE;
+         }
+
+         /* Is the list devoid of cycles? Use Floyd's algorithm to find
+            out. Since each chunk must be the previous one of its next
+            one, a list without forward cycles has no backward ones. */
+         oChunk = aoLists[iIndex];
+         oHareChunk = aoLists[iIndex];
+         while ((oHareChunk != NULL) &&
+                (Chunk_isValid(oHareChunk, oHeapStart, oHeapEnd)) &&
+                (Chunk_getNextInList(oHareChunk) != NULL) &&
+                (Chunk_isValid(Chunk_getNextInList(oHareChunk),
+                               oHeapStart, oHeapEnd)))
+         {
+            oChunk = Chunk_getNextInList(oChunk);
+            oHareChunk =
+               Chunk_getNextInList(Chunk_getNextInList(oHareChunk));
+            if (oChunk == oHareChunk)
+            {
+               fprintf(stderr, "List %d has a cycle\n", iIndex);
+               return FALSE;
+            }
+         }
+
+         /* Traverse the list. */
+         oPrevChunk = NULL;
+         for (oChunk = aoLists[iIndex];
+              oChunk != NULL;
+              oChunk = Chunk_getNextInList(oChunk))
+         {
+            /* Is the chunk valid? */
+            if (! Chunk_isValid(oChunk, oHeapStart, oHeapEnd))
+            {
+               fprintf(stderr, "Traversing list %d detected a bad"
+                       " chunk\n", iIndex);
+               return FALSE;
+            }
+
+            /* Is it free? */
+            if (Chunk_getStatus(oChunk) != CHUNK_FREE)
+            {
+               fprintf(stderr, "Chunk in list %d marked as in use\n",
+                       iIndex);
+               return FALSE;
+            }
+
+            /* Is it in the list of its class? */
+            if (Checker_getListIndex(Chunk_getUnits(oChunk),
+                                     iSecondLog2) != iIndex)
+            {
+               fprintf(stderr, "Chunk with %lu units in list %d\n",
+                       (unsigned long)Chunk_getUnits(oChunk), iIndex);
+               return FALSE;
+            }
+
+            /* Does it link back to the chunk before it? */
+            if (Chunk_getPrevInList(oChunk) != oPrevChunk)
+            {
+               fprintf(stderr, "List %d has a bad backward link\n",
+                       iIndex);
+               return FALSE;
+            }
+
+            oPrevChunk = oChunk;
+            uFreeInLists++;
+         }
+      }
+   }
+
+   /* Is each free chunk in a list? As a chunk is only ever in the
+      list of its class, and no list has cycles, the counts tell. */
+   if (uFreeInMem != uFreeInLists)
+   {
+      fprintf(stderr, "The heap has %lu free chunks, but the lists"
+              " hold %lu\n", (unsigned long)uFreeInMem,
+              (unsigned long)uFreeInLists);
+      return FALSE;
+   }
+
+   return TRUE;
+}
@@ -0,0 +1,24 @@
+/*--------------------------------------------------------------------*/
+/* checker3.h                                                         */
+/* Author: Nate Wilson                                                */
+/* Author: Narek Galstyan                                             */
+/*--------------------------------------------------------------------*/
+
+#ifndef CHECKER3_INCLUDED
+#define CHECKER3_INCLUDED
+
+#include "chunk.h"
+
+/* Return 1 (TRUE) if the heap is in a valid state, or 0 (FALSE)
+   otherwise. The heap is defined by parameters oHeapStart (the address
+   of the start of the heap), oHeapEnd (the address immediately
+   beyond the end of the heap), aoLists (the free lists of
+   iFirstCount first-level classes, each of 2^iSecondLog2 second-level
+   classes, row by row), and the bitmaps ulFirstMap and aulSecondMaps
+   that tell which of those lists are not empty. */
+
+int Checker_isValid(Chunk_T oHeapStart, Chunk_T oHeapEnd,
+   Chunk_T aoLists[], unsigned long ulFirstMap,
+   unsigned long aulSecondMaps[], int iFirstCount, int iSecondLog2);
+
+#endif
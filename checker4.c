@@ -0,0 +1,188 @@
+/*--------------------------------------------------------------------*/
+/* checker4.c                                                         */
+/* Author: Nate Wilson                                                */
+/* Author: Narek Galstyan                                             */
+/*--------------------------------------------------------------------*/
+
+#include "checker4.h"
+#include <stdio.h>
+#include <assert.h>
+
+/* In lieu of a boolean data type. */
+enum {FALSE, TRUE};
+
+/*--------------------------------------------------------------------*/
+
+int Checker_isValid(Chunk_T oHeapStart, Chunk_T oHeapEnd,
+   Chunk_T aoLists[], unsigned long ulOrderMap, int iOrderCount)
+{
+   Chunk_T oChunk; /* current chunk in traversals */
+   Chunk_T oPrevChunk; /* previous chunk in traversals */
+   Chunk_T oHareChunk; /* used in cycle detection */
+   Chunk_T oBuddy; /* the buddy of the current chunk */
+   size_t uUnits; /* units in the current chunk */
+   size_t uOffset; /* offset of the current chunk, in units */
+   size_t uFreeInMem = 0; /* free chunks found in memory */
+   size_t uFreeInLists = 0; /* chunks found in the free lists */
+   int iOrder;
+
+   /* validate params */
+   assert(aoLists != NULL);
+
+   /* check for an initialized heap */
+   if (oHeapStart == NULL)
+   {
+      fprintf(stderr, "The heap start is uninitialized\n");
+      return FALSE;
+   }
+   if (oHeapEnd == NULL)
+   {
+      fprintf(stderr, "The heap end is uninitialized\n");
+      return FALSE;
+   }
+
+   /* Traverse memory through forward links. */
+   for (oChunk = (oHeapStart == oHeapEnd) ? NULL : oHeapStart;
+        oChunk != NULL;
+        oChunk = Chunk_getNextInMem(oChunk, oHeapEnd))
+   {
+      /* Is the chunk valid? */
+      if (! Chunk_isValid(oChunk, oHeapStart, oHeapEnd))
+      {
+         fprintf(stderr, "Traversing memory detected a bad chunk\n");
+         return FALSE;
+      }
+
+      /* Is it a power of two units long, at a multiple of that? */
+      uUnits = Chunk_getUnits(oChunk);
+      uOffset = (size_t)((char*)oChunk - (char*)oHeapStart)
+                / Chunk_unitsToBytes(1);
+      if (((uUnits & (uUnits - 1)) != 0) ||
+          ((uOffset & (uUnits - 1)) != 0))
+      {
+         fprintf(stderr, "A chunk of %lu units is at offset %lu\n",
+                 (unsigned long)uUnits, (unsigned long)uOffset);
+         return FALSE;
+      }
+
+      /* Is it free along with its buddy? */
+      if (Chunk_getStatus(oChunk) == CHUNK_FREE)
+      {
+         oBuddy = (Chunk_T)((char*)oHeapStart
+                            + Chunk_unitsToBytes(uOffset ^ uUnits));
+         if ((oBuddy < oHeapEnd) &&
+             (Chunk_getStatus(oBuddy) == CHUNK_FREE) &&
+             (Chunk_getUnits(oBuddy) == uUnits))
+         {
+            fprintf(stderr, "The heap contains free buddies\n");
+            return FALSE;
+         }
+         uFreeInMem++;
+      }
+   }
+
+#ifndef CHUNK_FOOTERLESS
+   /* Traverse memory through backward links. Without footers on
+      chunks in use there are none past those, and as merging never
+      looks back in memory, headers do not record them either. */
+   for (oChunk = (oHeapStart == oHeapEnd) ? NULL :
+           Chunk_getPrevInMem(oHeapEnd, oHeapStart);
+        oChunk != NULL;
+        oChunk = Chunk_getPrevInMem(oChunk, oHeapStart))
+   {
+      /* Is the chunk valid? */
+      if (! Chunk_isValid(oChunk, oHeapStart, oHeapEnd))
+      {
+         fprintf(stderr, "Backward traversing memory"
+                 " detected a bad chunk\n");
+         return FALSE;
+      }
+   }
+#endif
+
+   for (iOrder = 0; iOrder < iOrderCount; iOrder++)
+   {
+      /* Does the bitmap agree with the list? */
+      if (((ulOrderMap >> iOrder) & 1UL) !=
+          (unsigned long)(aoLists[iOrder] != NULL))
+      {
+         fprintf(stderr, "Bit %d of the order map is wrong\n", iOrder);
+         return FALSE;
+      }
+
+      /* Is the list devoid of cycles? Use Floyd's algorithm to find
+         out. Since each chunk must be the previous one of its next
+         one, a list without forward cycles has no backward ones. */
+      oChunk = aoLists[iOrder];
+      oHareChunk = aoLists[iOrder];
+      while ((oHareChunk != NULL) &&
+             (Chunk_isValid(oHareChunk, oHeapStart, oHeapEnd)) &&
+             (Chunk_getNextInList(oHareChunk) != NULL) &&
+             (Chunk_isValid(Chunk_getNextInList(oHareChunk),
+                            oHeapStart, oHeapEnd)))
+      {
+         oChunk = Chunk_getNextInList(oChunk);
+         oHareChunk =
+            Chunk_getNextInList(Chunk_getNextInList(oHareChunk));
+         if (oChunk == oHareChunk)
+         {
+            fprintf(stderr, "List %d has a cycle\n", iOrder);
+            return FALSE;
+         }
+      }
+
+      /* Traverse the list. */
+      oPrevChunk = NULL;
+      for (oChunk = aoLists[iOrder];
+           oChunk != NULL;
+           oChunk = Chunk_getNextInList(oChunk))
+      {
+         /* Is the chunk valid? */
+         if (! Chunk_isValid(oChunk, oHeapStart, oHeapEnd))
+         {
+            fprintf(stderr, "Traversing list %d detected a bad"
+                    " chunk\n", iOrder);
+            return FALSE;
+         }
+
+         /* Is it free? */
+         if (Chunk_getStatus(oChunk) != CHUNK_FREE)
+         {
+            fprintf(stderr, "Chunk in list %d marked as in use\n",
+                    iOrder);
+            return FALSE;
+         }
+
+         /* Is it of the order of the list? */
+         if (Chunk_getUnits(oChunk) != (size_t)1 << iOrder)
+         {
+            fprintf(stderr, "Chunk with %lu units in list %d\n",
+                    (unsigned long)Chunk_getUnits(oChunk), iOrder);
+            return FALSE;
+         }
+
+         /* Does it link back to the chunk before it? */
+         if (Chunk_getPrevInList(oChunk) != oPrevChunk)
+         {
+            fprintf(stderr, "List %d has a bad backward link\n",
+                    iOrder);
+            return FALSE;
+         }
+
+         oPrevChunk = oChunk;
+         uFreeInLists++;
+      }
+   }
+
+   /* Is each free chunk in a list? As a chunk is only ever in the
+      list of its order, and no list has cycles, the counts tell. */
+   if (uFreeInMem != uFreeInLists)
+   {
+      fprintf(stderr, "The heap has %lu free chunks, but the lists"
+              " hold %lu\n", (unsigned long)uFreeInMem,
+              (unsigned long)uFreeInLists);
+      return FALSE;
+   }
+
+   return TRUE;
+}
@@ -0,0 +1,22 @@
+/*--------------------------------------------------------------------*/
+/* checker4.h                                                         */
+/* Author: Nate Wilson                                                */
+/* Author: Narek Galstyan                                             */
+/*--------------------------------------------------------------------*/
+
+#ifndef CHECKER4_INCLUDED
+#define CHECKER4_INCLUDED
+
+#include "chunk.h"
+
+/* Return 1 (TRUE) if the heap is in a valid state, or 0 (FALSE)
+   otherwise. The heap is defined by parameters oHeapStart (the address
+   of the start of the heap), oHeapEnd (the address immediately
+   beyond the end of the heap), aoLists (an array of iOrderCount free
+   lists, where list k contains the free chunks of 2^k units), and
+   ulOrderMap (whose bit k is set if list k is not empty). */
+
+int Checker_isValid(Chunk_T oHeapStart, Chunk_T oHeapEnd,
+   Chunk_T aoLists[], unsigned long ulOrderMap, int iOrderCount);
+
+#endif
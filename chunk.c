@@ -6,32 +6,140 @@
 #include "chunk.h"
 #include <stddef.h>
 #include <stdio.h>
+#include <limits.h>
 #include <assert.h>
 
 /*--------------------------------------------------------------------*/
 
+/* With CHUNK_INLINE, chunkinline.h defines the layout and all the
+   accessors, and only the checks at the end of this file are left. */
+
+#ifndef CHUNK_INLINE
 /* Physically a Chunk is a structure consisting of a number of units
    and an address. Logically a Chunk consists of multiple such 
    structures. */
    
+#ifdef CHUNK_COMPACT
+/* A compact Chunk stores the number of units and the address in 32
+   bits each, the address as an offset from the Chunk, so that the
+   structure takes 8 bytes. A unit is two such structures, so that
+   payloads stay as aligned as with the full-size structure. */
+
 struct Chunk
 {
-   /* The number of units in the Chunk. The low-order bit
-      stores the Chunk's status. */
+   /* The number of units in the Chunk, above STATUS_BITS
+      low-order bits. The lowest stores the Chunk's status. */
+   unsigned int uUnits;
+
+   /* The offset in units from the Chunk to an adjacent Chunk, or 0
+      if there is none, as no Chunk is adjacent to itself. */
+   int iAdjacentOffset;
+};
+#else
+struct Chunk
+{
+   /* The number of units in the Chunk, above STATUS_BITS
+      low-order bits. The lowest stores the Chunk's status. */
    size_t uUnits;
 
    /* The address of an adjacent Chunk. */
    Chunk_T oAdjacentChunk;
 };
+#endif
+
+/* The number of low-order bits of a header that do not store the
+   number of units: the Chunk's status and, without footers on Chunks
+   in use, the status of the previous Chunk in memory above it. */
+
+#ifdef CHUNK_FOOTERLESS
+enum {STATUS_BITS = 2};
+#else
+enum {STATUS_BITS = 1};
+#endif
+
+/* The number of structures in a unit, and of bytes. A header or a
+   footer is one structure, so a Chunk starts UNIT_BYTES less the
+   size of a structure past a unit boundary, its payload right at
+   the next one. */
+
+#ifdef CHUNK_COMPACT
+enum {STRUCTS_PER_UNIT = 2};
+#else
+enum {STRUCTS_PER_UNIT = 1};
+#endif
+enum {UNIT_BYTES = STRUCTS_PER_UNIT * (int)sizeof(struct Chunk)};
+
+/* The number of bytes of a Chunk that its payload cannot use: the
+   header, and the footer unless only free Chunks have one. */
+
+#ifdef CHUNK_FOOTERLESS
+enum {OVERHEAD_BYTES = (int)sizeof(struct Chunk)};
+#else
+enum {OVERHEAD_BYTES = 2 * (int)sizeof(struct Chunk)};
+#endif
+
+/*--------------------------------------------------------------------*/
+
+/* Return the Chunk or the part of one iUnits units from oChunk. */
+
+static Chunk_T Chunk_plusUnits(Chunk_T oChunk, ptrdiff_t iUnits)
+{
+   return oChunk + iUnits * STRUCTS_PER_UNIT;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the footer of oChunk, the last structure of it. */
+
+static Chunk_T Chunk_getFooter(Chunk_T oChunk)
+{
+   return Chunk_plusUnits(oChunk, (ptrdiff_t)Chunk_getUnits(oChunk))
+          - 1;
+}
+
+#ifdef CHUNK_COMPACT
+/*--------------------------------------------------------------------*/
+
+/* Return the Chunk iOffset units from oChunk, or NULL if iOffset
+   is 0. */
+
+static Chunk_T Chunk_fromOffset(Chunk_T oChunk, int iOffset)
+{
+   if (iOffset == 0)
+      return NULL;
+   return Chunk_plusUnits(oChunk, iOffset);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the offset in units from oChunk to oOtherChunk, or 0 if
+   oOtherChunk is NULL. */
+
+static int Chunk_toOffset(Chunk_T oChunk, Chunk_T oOtherChunk)
+{
+   if (oOtherChunk == NULL)
+      return 0;
+   assert(oOtherChunk != oChunk);
+   assert((oOtherChunk - oChunk) % STRUCTS_PER_UNIT == 0);
+   assert((oOtherChunk - oChunk
+           <= (ptrdiff_t)Chunk_getMaxUnits() * STRUCTS_PER_UNIT) &&
+          (oChunk - oOtherChunk
+           <= (ptrdiff_t)Chunk_getMaxUnits() * STRUCTS_PER_UNIT));
+   return (int)((oOtherChunk - oChunk) / STRUCTS_PER_UNIT);
+}
+#endif
 
 /*--------------------------------------------------------------------*/
 
 size_t Chunk_bytesToUnits(size_t uBytes)
 {
    size_t uUnits;
-   uUnits = ((uBytes - 1) / sizeof(struct Chunk)) + 1;
-   uUnits++;  /* Allow room for a header. */
-   uUnits++;  /* Allow room for a footer. */
+   /* Allow room for a header, and a footer unless CHUNK_FOOTERLESS
+      is defined. */
+   uUnits = ((uBytes + (size_t)OVERHEAD_BYTES - 1) / UNIT_BYTES) + 1;
+   /* Allow room for the footer and links of the Chunk once free. */
+   if (uUnits < (size_t)MIN_UNITS_PER_CHUNK)
+      uUnits = (size_t)MIN_UNITS_PER_CHUNK;
    return uUnits;
 }
 
@@ -39,7 +147,37 @@ size_t Chunk_bytesToUnits(size_t uBytes)
 
 size_t Chunk_unitsToBytes(size_t uUnits)
 {
-   return uUnits * sizeof(struct Chunk);
+   return uUnits * UNIT_BYTES;
+}
+
+/*--------------------------------------------------------------------*/
+
+size_t Chunk_getMaxUnits(void)
+{
+#ifdef CHUNK_COMPACT
+   /* A header holds no more, and a link reaches at least as far. */
+   return (size_t)UINT_MAX >> STATUS_BITS;
+#else
+   return ~(size_t)0 >> STATUS_BITS;
+#endif
+}
+
+/*--------------------------------------------------------------------*/
+
+size_t Chunk_unitsToPayloadBytes(size_t uUnits)
+{
+   assert(uUnits >= MIN_UNITS_PER_CHUNK);
+
+   /* Exclude the header, and the footer unless CHUNK_FOOTERLESS is
+      defined. */
+   return uUnits * UNIT_BYTES - (size_t)OVERHEAD_BYTES;
+}
+
+/*--------------------------------------------------------------------*/
+
+size_t Chunk_getStartOffset(void)
+{
+   return UNIT_BYTES - sizeof(struct Chunk);
 }
 
 /*--------------------------------------------------------------------*/
@@ -76,8 +214,24 @@ void Chunk_setStatus(Chunk_T oChunk, enum ChunkStatus eStatus)
    assert(oChunk != NULL);
    assert((eStatus == CHUNK_FREE) || (eStatus == CHUNK_INUSE));
 
-   oChunk->uUnits &= ~1U;
-   oChunk->uUnits |= eStatus;
+   /* Store the header once, so that a thread that reads it at the
+      same time never sees a status that the chunk does not have.
+      Without footers, the thread that owns the Chunk before it may
+      set another bit at the same time, so set the bit atomically. */
+#if defined(CHUNK_FOOTERLESS) && defined(HEAPMGR_THREADS)
+   if (eStatus == CHUNK_INUSE)
+      (void)__sync_fetch_and_or(&oChunk->uUnits, (size_t)1U);
+   else
+      (void)__sync_fetch_and_and(&oChunk->uUnits, ~(size_t)1U);
+#else
+   oChunk->uUnits = (oChunk->uUnits & ~(size_t)1U) | (size_t)eStatus;
+#endif
+
+#ifdef CHUNK_FOOTERLESS
+   /* A Chunk gets its footer as it becomes free. */
+   if (eStatus == CHUNK_FREE)
+      Chunk_getFooter(oChunk)->uUnits = Chunk_getUnits(oChunk);
+#endif
 }
 
 /*--------------------------------------------------------------------*/
@@ -86,22 +240,43 @@ size_t Chunk_getUnits(Chunk_T oChunk)
 {
    assert(oChunk != NULL);
 
-   return oChunk->uUnits >> 1;
+   return oChunk->uUnits >> STATUS_BITS;
 }
 
 /*--------------------------------------------------------------------*/
 
 void Chunk_setUnits(Chunk_T oChunk, size_t uUnits)
 {
+#if defined(CHUNK_FOOTERLESS) && defined(HEAPMGR_THREADS)
+   size_t uOld;
+#endif
+
    assert(oChunk != NULL);
    assert(uUnits >= MIN_UNITS_PER_CHUNK);
-
-   /* Set the Units in oChunk's header. */
-   oChunk->uUnits &= 1U;
-   oChunk->uUnits |= uUnits << 1U;
+   assert(uUnits <= Chunk_getMaxUnits());
+
+   /* Set the Units in oChunk's header, in one store, which must not
+      lose a status bit that another thread sets at the same time. */
+#if defined(CHUNK_FOOTERLESS) && defined(HEAPMGR_THREADS)
+   do
+      uOld = oChunk->uUnits;
+   while (__sync_val_compare_and_swap(&oChunk->uUnits, uOld,
+             (uOld & (((size_t)1U << STATUS_BITS) - 1))
+             | (uUnits << STATUS_BITS)) != uOld);
+#else
+   oChunk->uUnits = (oChunk->uUnits & (((size_t)1U << STATUS_BITS) - 1))
+                    | (uUnits << STATUS_BITS);
+#endif
+
+#ifdef CHUNK_FOOTERLESS
+   /* Only a free Chunk has a footer; the last unit of a Chunk in use
+      is payload. */
+   if (Chunk_getStatus(oChunk) != CHUNK_FREE)
+      return;
+#endif
 
    /* Set the Units in oChunk's footer. */
-   (oChunk + uUnits - 1)->uUnits = uUnits;
+   Chunk_getFooter(oChunk)->uUnits = uUnits;
 }
 
 /*--------------------------------------------------------------------*/
@@ -110,7 +285,11 @@ Chunk_T Chunk_getNextInList(Chunk_T oChunk)
 {
    assert(oChunk != NULL);
 
+#ifdef CHUNK_COMPACT
+   return Chunk_fromOffset(oChunk, oChunk->iAdjacentOffset);
+#else
    return oChunk->oAdjacentChunk;
+#endif
 }
 
 /*--------------------------------------------------------------------*/
@@ -119,7 +298,26 @@ void Chunk_setNextInList(Chunk_T oChunk, Chunk_T oNextChunk)
 {
    assert(oChunk != NULL);
 
+#ifdef CHUNK_COMPACT
+   oChunk->iAdjacentOffset = Chunk_toOffset(oChunk, oNextChunk);
+#else
    oChunk->oAdjacentChunk = oNextChunk;
+#endif
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the unit of oChunk that holds the link to its previous
+   Chunk in the free list: the one after the header, beside the next
+   link, if CHUNK_NEARLINKS is defined, or else the footer. */
+
+static Chunk_T Chunk_getPrevLinkUnit(Chunk_T oChunk)
+{
+#ifdef CHUNK_NEARLINKS
+   return oChunk + 1;
+#else
+   return Chunk_getFooter(oChunk);
+#endif
 }
 
 /*--------------------------------------------------------------------*/
@@ -128,7 +326,13 @@ Chunk_T Chunk_getPrevInList(Chunk_T oChunk)
 {
    assert(oChunk != NULL);
 
-   return (oChunk + Chunk_getUnits(oChunk) - 1)->oAdjacentChunk;
+#ifdef CHUNK_COMPACT
+   /* The offset is from the Chunk, wherever it is stored. */
+   return Chunk_fromOffset(oChunk,
+      Chunk_getPrevLinkUnit(oChunk)->iAdjacentOffset);
+#else
+   return Chunk_getPrevLinkUnit(oChunk)->oAdjacentChunk;
+#endif
 }
 
 /*--------------------------------------------------------------------*/
@@ -137,7 +341,12 @@ void Chunk_setPrevInList(Chunk_T oChunk, Chunk_T oPrevChunk)
 {
    assert(oChunk != NULL);
 
-   (oChunk + Chunk_getUnits(oChunk) - 1)->oAdjacentChunk = oPrevChunk;
+#ifdef CHUNK_COMPACT
+   Chunk_getPrevLinkUnit(oChunk)->iAdjacentOffset =
+      Chunk_toOffset(oChunk, oPrevChunk);
+#else
+   Chunk_getPrevLinkUnit(oChunk)->oAdjacentChunk = oPrevChunk;
+#endif
 }
 
 /*--------------------------------------------------------------------*/
@@ -150,7 +359,8 @@ Chunk_T Chunk_getNextInMem(Chunk_T oChunk, Chunk_T oHeapEnd)
    assert(oHeapEnd != NULL);
    assert(oChunk < oHeapEnd);
 
-   oNextChunk = oChunk + Chunk_getUnits(oChunk);
+   oNextChunk = Chunk_plusUnits(oChunk,
+                                (ptrdiff_t)Chunk_getUnits(oChunk));
    assert(oNextChunk <= oHeapEnd);
 
    if (oNextChunk == oHeapEnd)
@@ -161,6 +371,66 @@ Chunk_T Chunk_getNextInMem(Chunk_T oChunk, Chunk_T oHeapEnd)
 /*--------------------------------------------------------------------*/
 
 Chunk_T Chunk_getPrevInMem(Chunk_T oChunk, Chunk_T oHeapStart)
+{
+#ifndef CHUNK_FOOTERLESS
+   Chunk_T oPrevChunk;
+#endif
+
+   assert(oChunk != NULL);
+   assert(oHeapStart != NULL);
+   assert(oChunk >= oHeapStart);
+
+   if (oChunk == oHeapStart)
+      return NULL;
+
+#ifdef CHUNK_FOOTERLESS
+   /* Only a free Chunk has a footer to find it by. */
+   if (Chunk_getPrevStatus(oChunk) != CHUNK_FREE)
+      return NULL;
+
+   return Chunk_getFreePrevInMem(oChunk, oHeapStart);
+#else
+   oPrevChunk = Chunk_plusUnits(oChunk,
+                                -(ptrdiff_t)(oChunk - 1)->uUnits);
+   assert(oPrevChunk >= oHeapStart);
+
+   return oPrevChunk;
+#endif
+}
+
+#ifdef CHUNK_FOOTERLESS
+/*--------------------------------------------------------------------*/
+
+enum ChunkStatus Chunk_getPrevStatus(Chunk_T oChunk)
+{
+   assert(oChunk != NULL);
+
+   return (oChunk->uUnits >> 1) & 1U;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Chunk_setPrevStatus(Chunk_T oChunk, enum ChunkStatus eStatus)
+{
+   assert(oChunk != NULL);
+   assert((eStatus == CHUNK_FREE) || (eStatus == CHUNK_INUSE));
+
+   /* The thread that owns oChunk may set its other bits at the same
+      time. */
+#ifdef HEAPMGR_THREADS
+   if (eStatus == CHUNK_INUSE)
+      (void)__sync_fetch_and_or(&oChunk->uUnits, (size_t)2U);
+   else
+      (void)__sync_fetch_and_and(&oChunk->uUnits, ~(size_t)2U);
+#else
+   oChunk->uUnits = (oChunk->uUnits & ~(size_t)2U)
+                    | ((size_t)eStatus << 1);
+#endif
+}
+
+/*--------------------------------------------------------------------*/
+
+Chunk_T Chunk_getFreePrevInMem(Chunk_T oChunk, Chunk_T oHeapStart)
 {
    Chunk_T oPrevChunk;
 
@@ -171,21 +441,44 @@ Chunk_T Chunk_getPrevInMem(Chunk_T oChunk, Chunk_T oHeapStart)
    if (oChunk == oHeapStart)
       return NULL;
 
-   oPrevChunk = oChunk - ((oChunk - 1)->uUnits);
+   /* A thread that reads the footer without a lock may find a stale
+      one, which the payload of a Chunk in use has since overwritten;
+      one that reaches past oHeapStart finds no Chunk. */
+   if ((oChunk - 1)->uUnits >
+       (size_t)(oChunk - oHeapStart) / STRUCTS_PER_UNIT)
+      return NULL;
+
+   oPrevChunk = Chunk_plusUnits(oChunk,
+                                -(ptrdiff_t)(oChunk - 1)->uUnits);
    assert(oPrevChunk >= oHeapStart);
 
    return oPrevChunk;
 }
+#endif
+
+#endif
 
 /*--------------------------------------------------------------------*/
 
-/* Return the number of units as stored in oChunk's footer. */
+/* Return the end of oChunk, where the Chunk after it starts. */
+
+static char *Chunk_getEnd(Chunk_T oChunk)
+{
+   assert(oChunk != NULL);
+
+   return (char*)oChunk + Chunk_unitsToBytes(Chunk_getUnits(oChunk));
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of units as stored in oChunk's footer, the
+   structure that ends it. */
 
 static size_t Chunk_getFooterUnits(Chunk_T oChunk)
 {
    assert(oChunk != NULL);
 
-   return (oChunk + Chunk_getUnits(oChunk) - 1)->uUnits;
+   return ((Chunk_T)Chunk_getEnd(oChunk) - 1)->uUnits;
 }
 
 /*--------------------------------------------------------------------*/
@@ -205,7 +498,12 @@ int Chunk_isValid(Chunk_T oChunk,
    {  fprintf(stderr, "A chunk starts after the heap end\n");
       return 0;
    }
-   if (oChunk + Chunk_getUnits(oChunk) > oHeapEnd)
+   if ((size_t)((char*)oHeapEnd - (char*)oHeapStart)
+       / Chunk_unitsToBytes(1) > Chunk_getMaxUnits())
+   {  fprintf(stderr, "The heap spans more units than a chunk can\n");
+      return 0;
+   }
+   if (Chunk_getEnd(oChunk) > (char*)oHeapEnd)
    {  fprintf(stderr, "A chunk ends after the heap end\n");
       return 0;
    }
@@ -217,6 +515,11 @@ int Chunk_isValid(Chunk_T oChunk,
    {  fprintf(stderr, "A chunk has too few units\n");
       return 0;
    }
+#ifdef CHUNK_FOOTERLESS
+   /* Only a free Chunk has a footer. */
+   if (Chunk_getStatus(oChunk) != CHUNK_FREE)
+      return 1;
+#endif
    if (Chunk_getUnits(oChunk) != Chunk_getFooterUnits(oChunk))
    {  fprintf(stderr, "A chunk has inconsistent header/footer sizes\n");
       return 0;
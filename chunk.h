@@ -17,7 +17,28 @@ enum ChunkStatus {CHUNK_FREE, CHUNK_INUSE};
    free list. The last Unit is a footer that indicates the number of
    Units in the Chunk and, if the Chunk is free, a pointer to the
    previous Chunk in the free list. The Units between the header and
-   footer are the payload. */
+   footer are the payload.
+
+   If CHUNK_FOOTERLESS is defined, only a free Chunk has a footer, and
+   the payload of a Chunk in use runs to its end. The header then
+   also records the status of the Chunk before it in memory, so that
+   a Chunk can still find the one before it when that one is free.
+   Keeping that record up to date is the job of the heap manager.
+
+   If CHUNK_COMPACT is defined, a header or footer takes 8 bytes
+   rather than 16: the number of units takes 32 bits, and each pointer
+   is stored as a 32-bit offset in units from the Chunk. A unit still
+   takes 16 bytes, and a Chunk starts Chunk_getStartOffset() bytes
+   past a unit boundary, so that its header ends where the unit does
+   and its payload is as aligned as without CHUNK_COMPACT. A heap can
+   then span no more than Chunk_getMaxUnits() units.
+
+   If CHUNK_NEARLINKS is defined, a free Chunk keeps the pointer to
+   the previous Chunk in the free list in the Unit after its header
+   rather than in its footer, so that a free list operation touches
+   the start of the Chunk only. The first Unit of the payload of a
+   free Chunk is then not the heap manager's to use in full: the part
+   where a header keeps its pointer is taken. */
 
 typedef struct Chunk *Chunk_T;
 
@@ -29,7 +50,20 @@ enum {MIN_UNITS_PER_CHUNK = 3};
 
 /*--------------------------------------------------------------------*/
 
-/* Translate uBytes, a number of bytes, to units. Return the result. */
+/* If CHUNK_INLINE is defined, the functions below, but for
+   Chunk_isValid(), are the static inline ones of chunkinline.h, which
+   check nothing. Otherwise they are the checked ones of chunk.c. */
+
+#ifdef CHUNK_INLINE
+#include "chunkinline.h"
+#endif
+
+/*--------------------------------------------------------------------*/
+
+/* Translate uBytes, a number of bytes, to units. Return the result.
+   It is never less than MIN_UNITS_PER_CHUNK, so if CHUNK_FOOTERLESS
+   is defined, only a request that needs more than that takes a unit
+   less than it does with footers. */
 
 size_t Chunk_bytesToUnits(size_t uBytes);
 
@@ -41,6 +75,29 @@ size_t Chunk_unitsToBytes(size_t uUnits);
 
 /*--------------------------------------------------------------------*/
 
+/* Return the greatest number of units that a heap of Chunks can span,
+   so that no Chunk outgrows its header, however many it merges with,
+   and each Chunk can link to any other. */
+
+size_t Chunk_getMaxUnits(void);
+
+/*--------------------------------------------------------------------*/
+
+/* Translate uUnits, the number of units in a Chunk, to the number of
+   payload bytes that such a Chunk can hold. Return the result. */
+
+size_t Chunk_unitsToPayloadBytes(size_t uUnits);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of bytes past a unit boundary at which a Chunk
+   must start for its payload to be aligned for data of any type. A
+   heap of Chunks starts there, and every Chunk in it then does. */
+
+size_t Chunk_getStartOffset(void);
+
+/*--------------------------------------------------------------------*/
+
 /* Return the address of the payload of oChunk. */
 
 void *Chunk_toPayload(Chunk_T oChunk);
@@ -115,10 +172,39 @@ Chunk_T Chunk_getNextInMem(Chunk_T oChunk, Chunk_T oHeapEnd);
 /* Return oChunk's previous Chunk in memory, or NULL if there is no
    previous Chunk. Use oHeapStart to determine if there is no
    previous Chunk. The previous Chunk's number of units must be set
-   properly for this function to work. */
+   properly for this function to work. If CHUNK_FOOTERLESS is
+   defined, also return NULL if oChunk's header records the previous
+   Chunk as in use, as such a Chunk has no footer to find it by. */
 
 Chunk_T Chunk_getPrevInMem(Chunk_T oChunk, Chunk_T oHeapStart);
 
+#ifdef CHUNK_FOOTERLESS
+/*--------------------------------------------------------------------*/
+
+/* Return the status of oChunk's previous Chunk in memory, as
+   recorded in oChunk's header. */
+
+enum ChunkStatus Chunk_getPrevStatus(Chunk_T oChunk);
+
+/*--------------------------------------------------------------------*/
+
+/* Record eStatus as the status of oChunk's previous Chunk in memory,
+   in oChunk's header. */
+
+void Chunk_setPrevStatus(Chunk_T oChunk, enum ChunkStatus eStatus);
+
+/*--------------------------------------------------------------------*/
+
+/* Return oChunk's previous Chunk in memory, which the caller knows to
+   be free, or NULL if oChunk is oHeapStart. Unlike
+   Chunk_getPrevInMem(), do not read oChunk's header, so that oChunk
+   may be the end of the heap. Also return NULL if the footer before
+   oChunk reaches past oHeapStart, as a stale one read without a lock
+   may. */
+
+Chunk_T Chunk_getFreePrevInMem(Chunk_T oChunk, Chunk_T oHeapStart);
+#endif
+
 /*--------------------------------------------------------------------*/
 
 /* Return 1 (TRUE) if oChunk is valid, notably with respect to
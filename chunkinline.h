@@ -0,0 +1,304 @@
+/*--------------------------------------------------------------------*/
+/* chunkinline.h                                                      */
+/* Author: Nate Wilson                                                */
+/* Author: Narek Galstyan                                             */
+/*--------------------------------------------------------------------*/
+
+/* The Chunk accessors as static inline functions, for chunk.h to
+   include if CHUNK_INLINE is defined. They lay Chunks out as chunk.c
+   does, under the same layout flags, but check nothing, so that a
+   call costs no more than the loads and stores it makes. Build with
+   chunk.c alone to have the accessors check their arguments. */
+
+#ifndef CHUNKINLINE_INCLUDED
+#define CHUNKINLINE_INCLUDED
+
+#include <stddef.h>
+#include <limits.h>
+
+/*--------------------------------------------------------------------*/
+
+/* Physically a Chunk is a structure consisting of a number of units
+   and an address, or their 32-bit versions if CHUNK_COMPACT is
+   defined; see chunk.c. */
+
+#ifdef CHUNK_COMPACT
+struct Chunk
+{
+   unsigned int uUnits;
+   int iAdjacentOffset;
+};
+#else
+struct Chunk
+{
+   size_t uUnits;
+   Chunk_T oAdjacentChunk;
+};
+#endif
+
+/* The number of structures in a unit, and of bytes. A compact unit
+   is two structures, so that payloads stay aligned; see chunk.c. */
+
+#ifdef CHUNK_COMPACT
+enum {CHUNK_STRUCTS_PER_UNIT = 2};
+#else
+enum {CHUNK_STRUCTS_PER_UNIT = 1};
+#endif
+enum {CHUNK_UNIT_BYTES =
+         CHUNK_STRUCTS_PER_UNIT * (int)sizeof(struct Chunk)};
+
+/* The number of bytes of a Chunk that its payload cannot use. */
+
+#ifdef CHUNK_FOOTERLESS
+enum {CHUNK_OVERHEAD_BYTES = (int)sizeof(struct Chunk)};
+#else
+enum {CHUNK_OVERHEAD_BYTES = 2 * (int)sizeof(struct Chunk)};
+#endif
+
+/* The number of low-order bits of a header that do not store the
+   number of units: bit 0 holds the Chunk's status, and bit 1, without
+   footers on Chunks in use, the status of the previous Chunk. */
+
+#ifdef CHUNK_FOOTERLESS
+enum {CHUNK_STATUS_BITS = 2};
+#else
+enum {CHUNK_STATUS_BITS = 1};
+#endif
+
+/*--------------------------------------------------------------------*/
+
+static __inline__ size_t Chunk_bytesToUnits(size_t uBytes)
+{
+   size_t uUnits = ((uBytes + (size_t)CHUNK_OVERHEAD_BYTES - 1)
+                    / (size_t)CHUNK_UNIT_BYTES) + 1;
+   return (uUnits < (size_t)MIN_UNITS_PER_CHUNK) ?
+          (size_t)MIN_UNITS_PER_CHUNK : uUnits;
+}
+
+static __inline__ size_t Chunk_unitsToBytes(size_t uUnits)
+{
+   return uUnits * (size_t)CHUNK_UNIT_BYTES;
+}
+
+static __inline__ size_t Chunk_getMaxUnits(void)
+{
+#ifdef CHUNK_COMPACT
+   return (size_t)UINT_MAX >> CHUNK_STATUS_BITS;
+#else
+   return ~(size_t)0 >> CHUNK_STATUS_BITS;
+#endif
+}
+
+static __inline__ size_t Chunk_unitsToPayloadBytes(size_t uUnits)
+{
+   return uUnits * (size_t)CHUNK_UNIT_BYTES
+          - (size_t)CHUNK_OVERHEAD_BYTES;
+}
+
+static __inline__ size_t Chunk_getStartOffset(void)
+{
+   return (size_t)CHUNK_UNIT_BYTES - sizeof(struct Chunk);
+}
+
+static __inline__ void *Chunk_toPayload(Chunk_T oChunk)
+{
+   return (void*)(oChunk + 1);
+}
+
+static __inline__ Chunk_T Chunk_fromPayload(void *pv)
+{
+   return (Chunk_T)pv - 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static __inline__ size_t Chunk_getUnits(Chunk_T oChunk)
+{
+   return oChunk->uUnits >> CHUNK_STATUS_BITS;
+}
+
+/* Return the Chunk or the part of one iUnits units from oChunk. */
+
+static __inline__ Chunk_T Chunk_plusUnits(Chunk_T oChunk,
+                                          ptrdiff_t iUnits)
+{
+   return oChunk + iUnits * CHUNK_STRUCTS_PER_UNIT;
+}
+
+/* Return the footer of oChunk, the last structure of it. */
+
+static __inline__ Chunk_T Chunk_getFooter(Chunk_T oChunk)
+{
+   return Chunk_plusUnits(oChunk, (ptrdiff_t)Chunk_getUnits(oChunk))
+          - 1;
+}
+
+static __inline__ enum ChunkStatus Chunk_getStatus(Chunk_T oChunk)
+{
+   return (enum ChunkStatus)(oChunk->uUnits & 1U);
+}
+
+static __inline__ void Chunk_setStatus(Chunk_T oChunk,
+                                       enum ChunkStatus eStatus)
+{
+   /* Store the header once, as chunk.c does. */
+#if defined(CHUNK_FOOTERLESS) && defined(HEAPMGR_THREADS)
+   if (eStatus == CHUNK_INUSE)
+      (void)__sync_fetch_and_or(&oChunk->uUnits, (size_t)1U);
+   else
+      (void)__sync_fetch_and_and(&oChunk->uUnits, ~(size_t)1U);
+#else
+   oChunk->uUnits = (oChunk->uUnits & ~(size_t)1U) | (size_t)eStatus;
+#endif
+
+#ifdef CHUNK_FOOTERLESS
+   if (eStatus == CHUNK_FREE)
+      Chunk_getFooter(oChunk)->uUnits = Chunk_getUnits(oChunk);
+#endif
+}
+
+static __inline__ void Chunk_setUnits(Chunk_T oChunk, size_t uUnits)
+{
+#if defined(CHUNK_FOOTERLESS) && defined(HEAPMGR_THREADS)
+   size_t uOld;
+
+   do
+      uOld = oChunk->uUnits;
+   while (__sync_val_compare_and_swap(&oChunk->uUnits, uOld,
+             (uOld & (((size_t)1U << CHUNK_STATUS_BITS) - 1))
+             | (uUnits << CHUNK_STATUS_BITS)) != uOld);
+#else
+   oChunk->uUnits =
+      (oChunk->uUnits & (((size_t)1U << CHUNK_STATUS_BITS) - 1))
+      | (uUnits << CHUNK_STATUS_BITS);
+#endif
+
+#ifdef CHUNK_FOOTERLESS
+   if (Chunk_getStatus(oChunk) != CHUNK_FREE)
+      return;
+#endif
+
+   Chunk_getFooter(oChunk)->uUnits = uUnits;
+}
+
+#ifdef CHUNK_FOOTERLESS
+static __inline__ enum ChunkStatus Chunk_getPrevStatus(Chunk_T oChunk)
+{
+   return (enum ChunkStatus)((oChunk->uUnits >> 1) & 1U);
+}
+
+static __inline__ void Chunk_setPrevStatus(Chunk_T oChunk,
+                                           enum ChunkStatus eStatus)
+{
+#ifdef HEAPMGR_THREADS
+   if (eStatus == CHUNK_INUSE)
+      (void)__sync_fetch_and_or(&oChunk->uUnits, (size_t)2U);
+   else
+      (void)__sync_fetch_and_and(&oChunk->uUnits, ~(size_t)2U);
+#else
+   oChunk->uUnits = (oChunk->uUnits & ~(size_t)2U)
+                    | ((size_t)eStatus << 1);
+#endif
+}
+
+static __inline__ Chunk_T Chunk_getFreePrevInMem(Chunk_T oChunk,
+                                                 Chunk_T oHeapStart)
+{
+   /* Find no Chunk by a stale footer, as chunk.c does. */
+   if ((oChunk == oHeapStart) || ((oChunk - 1)->uUnits >
+          (size_t)(oChunk - oHeapStart) / CHUNK_STRUCTS_PER_UNIT))
+      return NULL;
+   return Chunk_plusUnits(oChunk, -(ptrdiff_t)(oChunk - 1)->uUnits);
+}
+#endif
+
+/*--------------------------------------------------------------------*/
+
+/* Return the unit of oChunk that holds the link to its previous
+   Chunk in the free list. */
+
+static __inline__ Chunk_T Chunk_getPrevLinkUnit(Chunk_T oChunk)
+{
+#ifdef CHUNK_NEARLINKS
+   return oChunk + 1;
+#else
+   return Chunk_getFooter(oChunk);
+#endif
+}
+
+#ifdef CHUNK_COMPACT
+static __inline__ Chunk_T Chunk_getNextInList(Chunk_T oChunk)
+{
+   int iOffset = oChunk->iAdjacentOffset;
+   return (iOffset == 0) ? NULL : Chunk_plusUnits(oChunk, iOffset);
+}
+
+static __inline__ void Chunk_setNextInList(Chunk_T oChunk,
+                                           Chunk_T oNextChunk)
+{
+   oChunk->iAdjacentOffset = (oNextChunk == NULL) ? 0 :
+      (int)((oNextChunk - oChunk) / CHUNK_STRUCTS_PER_UNIT);
+}
+
+static __inline__ Chunk_T Chunk_getPrevInList(Chunk_T oChunk)
+{
+   int iOffset = Chunk_getPrevLinkUnit(oChunk)->iAdjacentOffset;
+   return (iOffset == 0) ? NULL : Chunk_plusUnits(oChunk, iOffset);
+}
+
+static __inline__ void Chunk_setPrevInList(Chunk_T oChunk,
+                                           Chunk_T oPrevChunk)
+{
+   Chunk_getPrevLinkUnit(oChunk)->iAdjacentOffset =
+      (oPrevChunk == NULL) ? 0 :
+      (int)((oPrevChunk - oChunk) / CHUNK_STRUCTS_PER_UNIT);
+}
+#else
+static __inline__ Chunk_T Chunk_getNextInList(Chunk_T oChunk)
+{
+   return oChunk->oAdjacentChunk;
+}
+
+static __inline__ void Chunk_setNextInList(Chunk_T oChunk,
+                                           Chunk_T oNextChunk)
+{
+   oChunk->oAdjacentChunk = oNextChunk;
+}
+
+static __inline__ Chunk_T Chunk_getPrevInList(Chunk_T oChunk)
+{
+   return Chunk_getPrevLinkUnit(oChunk)->oAdjacentChunk;
+}
+
+static __inline__ void Chunk_setPrevInList(Chunk_T oChunk,
+                                           Chunk_T oPrevChunk)
+{
+   Chunk_getPrevLinkUnit(oChunk)->oAdjacentChunk = oPrevChunk;
+}
+#endif
+
+/*--------------------------------------------------------------------*/
+
+static __inline__ Chunk_T Chunk_getNextInMem(Chunk_T oChunk,
+                                             Chunk_T oHeapEnd)
+{
+   Chunk_T oNextChunk =
+      Chunk_plusUnits(oChunk, (ptrdiff_t)Chunk_getUnits(oChunk));
+   return (oNextChunk == oHeapEnd) ? NULL : oNextChunk;
+}
+
+static __inline__ Chunk_T Chunk_getPrevInMem(Chunk_T oChunk,
+                                             Chunk_T oHeapStart)
+{
+   if (oChunk == oHeapStart)
+      return NULL;
+#ifdef CHUNK_FOOTERLESS
+   if (Chunk_getPrevStatus(oChunk) != CHUNK_FREE)
+      return NULL;
+   return Chunk_getFreePrevInMem(oChunk, oHeapStart);
+#else
+   return Chunk_plusUnits(oChunk, -(ptrdiff_t)(oChunk - 1)->uUnits);
+#endif
+}
+
+#endif
@@ -8,6 +8,12 @@
 
 #include <stddef.h>
 
+/* A HeapMgr_T is a heap of its own, apart from the one that
+   HeapMgr_malloc() and the other functions without a HeapMgr_T
+   parameter use. */
+
+typedef struct HeapMgr *HeapMgr_T;
+
 /*--------------------------------------------------------------------*/
 
 /* Allocate and return the address of a region of memory that is large
@@ -26,4 +32,210 @@ void *HeapMgr_malloc(size_t uBytes);
 
 void HeapMgr_free(void *pv);
 
+/*--------------------------------------------------------------------*/
+
+/* Change the size of the region of memory pointed to by pv to uBytes
+   bytes, and return the address of the resized region, which may
+   differ from pv. The contents of the region are unchanged up to the
+   lesser of the old and new sizes; any added bytes are uninitialized.
+   If pv is NULL, behave as HeapMgr_malloc(uBytes). If uBytes is 0,
+   behave as HeapMgr_free(pv) and return NULL. Return NULL if the
+   request cannot be satisfied, in which case the region pointed to by
+   pv is left unchanged. pv should point to a region that was allocated
+   by HeapMgr_malloc(). */
+
+void *HeapMgr_realloc(void *pv, size_t uBytes);
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate and return the address of a region of memory that is large
+   enough to hold an array of uCount objects, each of whose size is
+   uBytes bytes. The region is guaranteed to be properly aligned for
+   data of any type, and every byte of it is 0. Return NULL if uCount
+   or uBytes is 0, if uCount * uBytes overflows, or if the request
+   cannot be satisfied. */
+
+void *HeapMgr_calloc(size_t uCount, size_t uBytes);
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate and return the address of a region of memory that is large
+   enough to hold an object whose size is uBytes bytes, and whose
+   address is a multiple of uAlignment, which must be a power of two.
+   Return NULL if uBytes is 0, if uAlignment is not a power of two, or
+   if the request cannot be satisfied. The region is uninitialized and
+   can be deallocated by HeapMgr_free(). */
+
+void *HeapMgr_memalign(size_t uAlignment, size_t uBytes);
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate a region of memory as HeapMgr_memalign(uAlignment, uBytes)
+   does, and store its address in *ppv. Return 0 if successful, in
+   which case *ppv is NULL if uBytes is 0. Return EINVAL without
+   changing *ppv if uAlignment is not a power of two multiple of
+   sizeof(void*), or ENOMEM if the request cannot be satisfied. */
+
+int HeapMgr_posixMemalign(void **ppv, size_t uAlignment, size_t uBytes);
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate uCount regions of memory, each as HeapMgr_malloc(uBytes)
+   would, and store their addresses in apv[0] through apv[uCount-1].
+   Return the number of regions allocated, which is less than uCount
+   only if the request cannot be satisfied in full; the elements of
+   apv beyond that number are undefined. */
+
+size_t HeapMgr_mallocBatch(size_t uBytes, size_t uCount, void *apv[]);
+
+/*--------------------------------------------------------------------*/
+
+/* Deallocate the uCount regions of memory pointed to by apv[0]
+   through apv[uCount-1], as HeapMgr_free() would. Ignore elements
+   that are NULL. The order of the elements of apv is undefined
+   afterward. */
+
+void HeapMgr_freeBatch(void *apv[], size_t uCount);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of bytes that the region of memory pointed to by
+   pv can hold, which is at least the number of bytes requested for
+   it. The client may use all of them. Return 0 if pv is NULL. */
+
+size_t HeapMgr_usableSize(void *pv);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of bytes that a region allocated by
+   HeapMgr_malloc(uBytes) would be able to hold. Return 0 if uBytes
+   is 0. */
+
+size_t HeapMgr_goodSize(size_t uBytes);
+
+/*--------------------------------------------------------------------*/
+
+/* Deallocate the region of memory pointed to by pv, as HeapMgr_free()
+   would. uBytes must be the number of bytes requested for the region
+   or any larger number up to HeapMgr_usableSize(pv). A small region
+   is freed by uBytes alone, without reading the size that it records,
+   which is only checked against uBytes if NDEBUG is not defined. */
+
+void HeapMgr_freeSized(void *pv, size_t uBytes);
+
+/*--------------------------------------------------------------------*/
+
+/* Return a new, empty heap, or NULL if the request cannot be
+   satisfied. */
+
+HeapMgr_T HeapMgr_new(void);
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate a region of memory in heap oHeap, as HeapMgr_malloc(uBytes)
+   does in its own heap. */
+
+void *HeapMgr_mallocIn(HeapMgr_T oHeap, size_t uBytes);
+
+/*--------------------------------------------------------------------*/
+
+/* Deallocate the region of memory pointed to by pv, which should have
+   been allocated by HeapMgr_mallocIn(oHeap, ...). Do nothing if pv is
+   NULL. */
+
+void HeapMgr_freeIn(HeapMgr_T oHeap, void *pv);
+
+/*--------------------------------------------------------------------*/
+
+/* Deallocate heap oHeap, and with it every region of memory still
+   allocated in it. */
+
+void HeapMgr_destroy(HeapMgr_T oHeap);
+
+/*--------------------------------------------------------------------*/
+
+/* The statistics of a lock that guards part of a heap, when the
+   HeapMgr is built for thread-safe mode. */
+
+struct HeapMgrLockStats
+{
+   /* The number of times that a thread acquired the lock. */
+   unsigned long ulAcquisitions;
+
+   /* The number of those times that the thread found the lock held
+      by another thread and had to wait. */
+   unsigned long ulContentions;
+
+   /* The total number of nanoseconds spent waiting. */
+   unsigned long ulWaitNanos;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Store the statistics of lock iLock of heap oHeap, or of the heap
+   that HeapMgr_malloc() uses if oHeap is NULL, in *psStats. Lock 0
+   guards the end of the heap, and each lock after it guards one bin
+   of free memory. The heap that HeapMgr_malloc() uses has a lock for
+   the slabs of each size of object after those of its bins. Return 1
+   (TRUE) if the lock exists, or 0 (FALSE) if iLock is past the last
+   lock or the HeapMgr is not thread-safe, in which case *psStats is
+   unchanged. */
+
+int HeapMgr_getLockStats(HeapMgr_T oHeap, int iLock,
+                         struct HeapMgrLockStats *psStats);
+
+/*--------------------------------------------------------------------*/
+
+/* Serve requests of uBytes bytes or more to HeapMgr_malloc(),
+   HeapMgr_calloc(), and HeapMgr_realloc() from mappings of their own,
+   which go back to the OS as soon as the regions are freed, and which
+   HeapMgr_realloc() resizes without copying. (size_t)-1 keeps every
+   request in the heap. */
+
+void HeapMgr_setMmapThreshold(size_t uBytes);
+
+/*--------------------------------------------------------------------*/
+
+/* Serve requests of up to uBytes bytes to HeapMgr_malloc() and
+   HeapMgr_calloc() as objects without headers, packed into slabs of
+   objects of the same size, as far as the HeapMgr has slabs for
+   objects that big. 0 gives every region a header of its own. In
+   thread-safe mode, each thread keeps a few free objects of each size
+   to itself, and takes them from the slabs or gives them back a batch
+   at a time. */
+
+void HeapMgr_setSlabThreshold(size_t uBytes);
+
+/*--------------------------------------------------------------------*/
+
+/* Give the memory of the heap that HeapMgr_malloc() uses back to the
+   OS where no region lies in it: shrink the heap to uPad bytes past
+   its last region, and release the pages inside of free memory
+   between regions, keeping the heap layout. The HeapMgr does the
+   same by itself for large free memory. Return 1 (TRUE) if any
+   memory went back, or 0 (FALSE) otherwise. */
+
+int HeapMgr_trim(size_t uPad);
+
+/*--------------------------------------------------------------------*/
+
+/* Start a thread that gives the memory of the heap that
+   HeapMgr_malloc() uses back to the OS in the background, as
+   HeapMgr_trim() does, every ulPeriodMillis milliseconds, once that
+   memory has stayed free for ulAgeMillis milliseconds. Meanwhile
+   frees leave the memory to the thread. Return 1 (TRUE) if the
+   thread started, or 0 (FALSE) if it runs already, if
+   ulPeriodMillis is 0, if it cannot start, or if the HeapMgr is not
+   thread-safe. */
+
+int HeapMgr_startScavenger(unsigned long ulPeriodMillis,
+                           unsigned long ulAgeMillis);
+
+/*--------------------------------------------------------------------*/
+
+/* Stop the thread that HeapMgr_startScavenger() started, if it
+   runs, and wait for it to exit. */
+
+void HeapMgr_stopScavenger(void);
+
 #endif
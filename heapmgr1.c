@@ -36,6 +36,33 @@ static Chunk_T oHeapEnd = NULL;
    ascending order by memory address. */
 static Chunk_T oFreeList = NULL;
 
+#ifdef CHUNK_FOOTERLESS
+/* The status of the last Chunk in memory, which no header after it
+   records. */
+static enum ChunkStatus eLastStatus = CHUNK_INUSE;
+#endif
+
+/*--------------------------------------------------------------------*/
+/* Set the status of oChunk to eStatus, recording it also where the
+   Chunk after it in memory keeps the status of the one before, if
+   Chunks in use have no footers. */
+static void HeapMgr_setStatus(Chunk_T oChunk, enum ChunkStatus eStatus)
+{
+#ifdef CHUNK_FOOTERLESS
+   Chunk_T oNextChunk; /* the next chunk in memory */
+#endif
+
+   Chunk_setStatus(oChunk, eStatus);
+
+#ifdef CHUNK_FOOTERLESS
+   oNextChunk = Chunk_getNextInMem(oChunk, oHeapEnd);
+   if (oNextChunk == NULL)
+      eLastStatus = eStatus;
+   else
+      Chunk_setPrevStatus(oNextChunk, eStatus);
+#endif
+}
+
 /*--------------------------------------------------------------------*/
 /* Request more memory from the operating system -- enough to store
    uUnits units. Create a new chunk, and and return it. */
@@ -60,6 +87,12 @@ static Chunk_T HeapMgr_getMoreMemory(size_t uUnits)
    if (oNewHeapEnd < oHeapEnd)
       return NULL;
 
+   /* Check that the heap stays within what its chunks can span */
+   if (uUnits > Chunk_getMaxUnits()
+                - (size_t)((char*)oHeapEnd - (char*)oHeapStart)
+                  / Chunk_unitsToBytes(1))
+      return NULL;
+
    /* system call: move the program break and error check*/
    if (brk(oNewHeapEnd) == -1)
       return NULL;
@@ -74,6 +107,9 @@ static Chunk_T HeapMgr_getMoreMemory(size_t uUnits)
    Chunk_setUnits(oChunk, uUnits);
    Chunk_setNextInList(oChunk, NULL);
    Chunk_setPrevInList(oChunk, NULL);
+#ifdef CHUNK_FOOTERLESS
+   Chunk_setPrevStatus(oChunk, eLastStatus);
+#endif
    
    return oChunk;
 }
@@ -208,6 +244,9 @@ static Chunk_T HeapMgr_splitGetTail(Chunk_T oChunk, size_t uUnits)
 
    /* set new, post split length of oChunk (the front) */
    Chunk_setUnits(oChunk, uUnits);
+#ifdef CHUNK_FOOTERLESS
+   Chunk_setPrevStatus(oTail, Chunk_getStatus(oChunk));
+#endif
 
    /* the split chunks are individually valid */
    assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
@@ -258,7 +297,7 @@ static Chunk_T HeapMgr_coalesceForward(Chunk_T oChunk)
 
    /* configure header and footer of merged chunk */
    Chunk_setUnits(oChunk, uTotalUnits);
-   Chunk_setStatus(oChunk, CHUNK_FREE);
+   HeapMgr_setStatus(oChunk, CHUNK_FREE);
    
    /* add merged chunk to list and return it */
    HeapMgr_addToList(oChunk);
@@ -294,7 +333,7 @@ static Chunk_T HeapMgr_coalesceBackward(Chunk_T oChunk)
 
    /* properly configure header and footer of merged chunk */
    Chunk_setUnits(oChunk, uTotalUnits);
-   Chunk_setStatus(oChunk, CHUNK_FREE);
+   HeapMgr_setStatus(oChunk, CHUNK_FREE);
 
    /* add merged chunk to list and return it */
    HeapMgr_addToList(oChunk);
@@ -314,7 +353,12 @@ void *HeapMgr_malloc(size_t uBytes)
    /* (1) initialize */
    if (oHeapStart == NULL)
    {
-      oHeapStart = (Chunk_T)sbrk(0);
+      /* start where the payload of a chunk is aligned to a unit */
+      char *pcBreak = (char*)sbrk(0);
+      size_t uUnitBytes = Chunk_unitsToBytes(1);
+      oHeapStart = (Chunk_T)(pcBreak +
+         (Chunk_getStartOffset() + uUnitBytes
+          - (size_t)pcBreak % uUnitBytes) % uUnitBytes);
       oHeapEnd = oHeapStart;
    }
    /* assert checker is valid at leading edge */
@@ -341,11 +385,11 @@ void *HeapMgr_malloc(size_t uBytes)
             oTail = HeapMgr_splitGetTail(oChunk, uUnits);
 
             /* set tail to free and add to list */
-            Chunk_setStatus(oTail, CHUNK_FREE);
+            HeapMgr_setStatus(oTail, CHUNK_FREE);
             HeapMgr_addToList(oTail);
 
             /* set head to in use and then return it */
-            Chunk_setStatus(oChunk, CHUNK_INUSE);
+            HeapMgr_setStatus(oChunk, CHUNK_INUSE);
 
             /* assert checker is valid at trailing edge of malloc */
             assert(Checker_isValid(oHeapStart, oHeapEnd, oFreeList));
@@ -355,7 +399,7 @@ void *HeapMgr_malloc(size_t uBytes)
          }
          /* else if chunk not too big, rm from list and set status */
          oChunk = HeapMgr_removeFromList(oChunk);
-         Chunk_setStatus(oChunk, CHUNK_INUSE);
+         HeapMgr_setStatus(oChunk, CHUNK_INUSE);
 
          /* assert checker is valid at trailing edge of malloc */
          assert(Checker_isValid(oHeapStart, oHeapEnd, oFreeList));   
@@ -373,7 +417,7 @@ void *HeapMgr_malloc(size_t uBytes)
       return NULL;
    }
    /*(4.1) set the status add the newly created chunk to the list */
-   Chunk_setStatus(oChunk, CHUNK_FREE);
+   HeapMgr_setStatus(oChunk, CHUNK_FREE);
    HeapMgr_addToList(oChunk);
 
    /* coalesce backward if needed */
@@ -392,11 +436,11 @@ void *HeapMgr_malloc(size_t uBytes)
       oTail = HeapMgr_splitGetTail(oChunk, uUnits);
 
       /* set tail to free and add to list */
-      Chunk_setStatus(oTail, CHUNK_FREE);
+      HeapMgr_setStatus(oTail, CHUNK_FREE);
       HeapMgr_addToList(oTail);
 
       /* set allocated memory to in use */
-      Chunk_setStatus(oChunk, CHUNK_INUSE);
+      HeapMgr_setStatus(oChunk, CHUNK_INUSE);
 
       /* assert checker is valid at trailing edge of malloc */
       assert(Checker_isValid(oHeapStart, oHeapEnd, oFreeList));
@@ -407,7 +451,7 @@ void *HeapMgr_malloc(size_t uBytes)
    /* else if the chunk is a good size, allocate it! */
    /* remove from list and set to in use */
    (void) HeapMgr_removeFromList(oChunk);
-   Chunk_setStatus(oChunk, CHUNK_INUSE);
+   HeapMgr_setStatus(oChunk, CHUNK_INUSE);
 
    /* assert checker is valid at trailing edge of malloc */
    assert(Checker_isValid(oHeapStart, oHeapEnd, oFreeList));
@@ -430,7 +474,7 @@ void HeapMgr_free(void *pv)
    oChunk = Chunk_fromPayload(pv);
 
    /* (1) set status of the given chunk to free */
-   Chunk_setStatus(oChunk, CHUNK_FREE);
+   HeapMgr_setStatus(oChunk, CHUNK_FREE);
 
    /* (2) Add to the list */
    HeapMgr_addToList(oChunk);
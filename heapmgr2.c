@@ -4,14 +4,63 @@
 /* Author: Narek Galstyan                                             */
 /*--------------------------------------------------------------------*/
 
+/* clock_gettime() and pthread_atfork() are declared only for
+   POSIX.1-2001 and later. */
+#define _POSIX_C_SOURCE 200112L
+
 #include "heapmgr.h"
 #include "checker2.h"
 #include "chunk.h"
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
 #include <assert.h>
 
-#define __USE_XOPEN_EXTENDED
+/* brk(), sbrk() and MAP_ANONYMOUS are BSD extensions, and mremap()
+   a GNU one. */
+#define __USE_MISC
 #include <unistd.h>
+#define __USE_GNU
+#include <sys/mman.h>
+#undef __USE_GNU
+
+#ifdef HEAPMGR_THREADS
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+/* Restartable sequences exist only on Linux, and the ones here only
+   on x86-64, and only under a C library that registers its threads
+   for them. */
+#ifdef HEAPMGR_RSEQ
+#ifndef HEAPMGR_THREADS
+#error "HEAPMGR_RSEQ requires HEAPMGR_THREADS"
+#endif
+#include <sys/rseq.h>
+#endif
+
+/* Thread-owned pages replace the thread and CPU caches. */
+#ifdef HEAPMGR_PAGES
+#ifndef HEAPMGR_THREADS
+#error "HEAPMGR_PAGES requires HEAPMGR_THREADS"
+#endif
+#ifdef HEAPMGR_RSEQ
+#error "HEAPMGR_PAGES and HEAPMGR_RSEQ cannot be used together"
+#endif
+#endif
+
+/* With the links of a free chunk near its header, the free epoch of
+   the chunk shares the unit after the header with its previous link,
+   which needs a unit of two words. */
+#ifdef CHUNK_NEARLINKS
+#ifdef CHUNK_COMPACT
+#error "CHUNK_NEARLINKS cannot be used with CHUNK_COMPACT"
+#endif
+#endif
 
 /* In lieu of a boolean data type. */
 enum {FALSE, TRUE};
@@ -25,390 +74,4513 @@ enum { MIN_UNITS_FROM_OS = 512 };
 /* number of bins in freelist array */
 enum {IBINCOUNT = 1024};
 
+/* The last LARGE_BIN_COUNT bins are large bins: large bin i holds the
+   free chunks whose size in units has its leading bit at bit
+   i + LARGE_BIN_SHIFT, and the bins before them one size each. */
+enum {LARGE_BIN_COUNT = 64};
+enum {SMALL_BIN_COUNT = IBINCOUNT - LARGE_BIN_COUNT};
+enum {LARGE_BIN_SHIFT = 9}; /* the leading bit of SMALL_BIN_COUNT */
 
-/*--------------------------------------------------------------------*/
+/* The number of bins that a word of the bin map covers, and the
+   number of words in it. */
+enum {BIN_MAP_BITS = (int)(sizeof(unsigned long) * CHAR_BIT)};
+enum {BIN_MAP_WORDS = IBINCOUNT / BIN_MAP_BITS};
+
+/* The number of bytes of address space that HeapMgr_new() reserves
+   for a heap. Pages of it take up memory only once they are used. */
+enum {HEAP_RESERVE_BYTES = 1 << 30};
+
+/* The default number of bytes from which on requests to the default
+   heap get mappings of their own. */
+enum {MMAP_THRESHOLD_DEFAULT = 128 * 1024};
+
+/* Small requests to the default heap get objects without headers in
+   slabs: pages of SLAB_BYTES bytes, at multiples of it, each holding
+   objects of one class. Class i holds objects of i + 1 units' worth
+   of bytes. */
+enum {SLAB_BYTES = 4096};
+enum {SLAB_CLASS_COUNT = 16};
+
+/* The default number of bytes up to which requests to the default
+   heap get objects in slabs. */
+enum {SLAB_THRESHOLD_DEFAULT = 256};
+
+/* The number of bytes of address space reserved for the map of the
+   slabs of the default heap, each bit of which covers SLAB_BYTES
+   bytes of the heap. */
+enum {SLAB_MAP_BYTES = 1 << 20};
+
+/* The number of bytes that a free chunk at the end of a heap must
+   reach for the heap to shrink, and the number of them that stay, so
+   that a heap that breathes in and out does not call the OS each
+   time. */
+enum {TRIM_THRESHOLD = 256 * 1024};
+enum {TRIM_PAD = 64 * 1024};
+
+/* The number of bytes that a free chunk inside a heap must reach for
+   its whole pages to go back to the OS. */
+enum {RELEASE_THRESHOLD = 256 * 1024};
+
+#ifdef HEAPMGR_THREADS
+/* The most free chunks whose pages the scavenger releases while it
+   holds the lock of a bin. */
+enum {SCAVENGE_BATCH = 8};
+#endif
+
+#ifdef HEAPMGR_THREADS
+/* The number of times to look at a held lock before yielding the
+   CPU to the thread that holds it. */
+enum {SPINS_BEFORE_YIELD = 100};
+
+/* The number of nanoseconds in a second. */
+enum {NANOS_PER_SECOND = 1000000000};
 
-/* The state of the HeapMgr. */
+/* Chunks of fewer units than this are kept in thread caches. */
+enum {CACHE_BIN_COUNT = 64};
 
-/* The address of the start of the heap. */
-static Chunk_T oHeapStart = NULL;
+/* The most chunks that a bin of a thread cache holds. */
+enum {CACHE_BIN_MAX = 16};
 
-/* The address immediately beyond the end of the heap. */
-static Chunk_T oHeapEnd = NULL;
+/* The number of chunks that move between a bin of a thread cache
+   and the bins of the heap at once. */
+enum {CACHE_BATCH = 8};
+
+/* The most objects of a slab class that a thread cache holds, and
+   the number that move between it and the slabs at once. */
+enum {SLAB_CACHE_MAX = 64};
+enum {SLAB_CACHE_BATCH = 32};
+
+/* While other threads use the heap too, a check of the heap, which
+   stops them, runs once in this many calls. */
+enum {CHECK_PERIOD = 16};
+#endif
+
+#ifndef HEAPMGR_THREADS
+/* Chunks of fewer units than this are kept in fast bins. */
+enum {FAST_BIN_COUNT = 128};
+
+/* The most bytes that the fast bins hold before they are
+   consolidated. */
+enum {FAST_BYTES_MAX = 64 * 1024};
+
+/* The number of chunks that go back to the bins of the heap at once
+   when the fast bins are consolidated. */
+enum {FAST_BATCH = 64};
+
+/* Requests of at most this many units are carved from the last
+   remainder. */
+enum {REMAINDER_UNITS_MAX = 64};
+#endif
+
+#ifdef HEAPMGR_PAGES
+/* The number of bytes in a page of chunks that a thread owns. Pages
+   lie at multiples of it in the page arena. */
+enum {PAGE_BYTES = 64 * 1024};
+
+/* The number of bytes of address space reserved for pages. */
+enum {PAGE_ARENA_BYTES = 1 << 30};
+#endif
 
-/* an array of pointers to structres like oFreeList each of which 
- * stores free memory chunks of a particular size or a range of sizes*/
-static Chunk_T aoBins[IBINCOUNT]; /*in bss so init. all 0*/
 
 /*--------------------------------------------------------------------*/
-/* Request more memory from the operating system -- enough to store
-   uUnits units. Create a new chunk, and and return it. */
-static Chunk_T HeapMgr_getMoreMemory(size_t uUnits)
+
+#ifdef HEAPMGR_THREADS
+/* A spin lock that counts how often threads collide on it. */
+
+struct HeapMgrLock
 {
-   Chunk_T oChunk;
-   Chunk_T oNewHeapEnd;
-   size_t uBytes;
+   /* 1 if a thread holds the lock, or 0 otherwise. */
+   volatile int iHeld;
 
-   /* always use at least 512 units */
-   if (uUnits < (size_t)MIN_UNITS_FROM_OS)
-      uUnits = (size_t)MIN_UNITS_FROM_OS;
+   /* The statistics of the lock, updated by the thread that holds
+      it. */
+   struct HeapMgrLockStats sStats;
+};
+#endif
 
-   /* Convert units to bytes. */
-   uBytes = Chunk_unitsToBytes(uUnits);
-   
-   /* calculate address of potential new heap end*/
-   oNewHeapEnd = (Chunk_T)((char*)oHeapEnd + uBytes);
+/*--------------------------------------------------------------------*/
 
-   /* Check for overflow */
-   if (oNewHeapEnd < oHeapEnd)
-      return NULL;
+/* The state of a HeapMgr. */
 
-   /*system call: move the program break and error check*/
-   if (brk(oNewHeapEnd) == -1)
-      return NULL;
+struct HeapMgr
+{
+   /* The address of the start of the heap. */
+   Chunk_T oHeapStart;
 
-   /* select new chunk for returning */
-   oChunk = oHeapEnd;
+   /* The address immediately beyond the end of the heap. */
+   Chunk_T oHeapEnd;
 
-   /* update global var heap end */
-   oHeapEnd = oNewHeapEnd;
+   /* The address immediately beyond the end of the memory reserved
+    * for the heap to grow into, or NULL if the heap grows by moving
+    * the program break.
+    */
+   Chunk_T oReserveEnd;
 
-   /* Set the fields of the new chunk. */
-   Chunk_setUnits(oChunk, uUnits);
-   Chunk_setNextInList(oChunk, NULL);
-   Chunk_setPrevInList(oChunk, NULL);
-   
-   return oChunk;
-}
+   /* an array of pointers to structres like oFreeList each of which 
+    * stores free memory chunks of a particular size or a range of
+    * sizes*/
+   Chunk_T aoBins[IBINCOUNT];
 
-/* Add oChunk to the front of the Free list ASSUMING
- * its status bit is already set correctly
+   /* Bit i % BIN_MAP_BITS of aulBinMap[i / BIN_MAP_BITS] is set if
+    * bin i holds chunks, and bit j of ulBinSummary if word j of
+    * aulBinMap has any bit set, so that the next bin that holds
+    * chunks is two count-trailing-zeros away rather than a walk over
+    * the bins. A bit changes under the lock of its bin; threads that
+    * look at them without it take them as hints.
+    */
+   volatile unsigned long aulBinMap[BIN_MAP_WORDS];
+   volatile unsigned long ulBinSummary;
+
+   /* The roots of the size trees of the large bins. */
+   Chunk_T aoTrees[LARGE_BIN_COUNT];
+
+   /* The address immediately beyond the end of the highest chunk
+    * that has ever been in use. Memory from one unit past
+    * oFreshStart up to the footer of the last chunk has never been
+    * handed to a client, and the allocator keeps it zero there, as
+    * the OS gave it.
+    */
+   Chunk_T oFreshStart;
+
+#ifdef CHUNK_FOOTERLESS
+   /* The status of the last chunk, which no header after it records,
+    * or CHUNK_INUSE if the heap is empty.
+    */
+   enum ChunkStatus eLastStatus;
+#endif
+
+#ifndef HEAPMGR_THREADS
+   /* The free chunk left over from the last split for a small
+    * request, or NULL. It stays in its bin, but the next small
+    * requests that no chunk of their own size fits are carved from
+    * it in turn, so that chunks allocated together lie together.
+    */
+   Chunk_T oLastRemainder;
+#endif
+
+#ifdef HEAPMGR_THREADS
+   /* The lock of the heap end and of moving the program break. */
+   struct HeapMgrLock sTopLock;
+
+   /* The locks of the bins. Chunks in a bin and their headers and
+    * footers are protected by the lock of the bin; a thread never
+    * holds two of these at once, so no two threads wait for each
+    * other.
+    */
+   struct HeapMgrLock asBinLocks[IBINCOUNT];
+
+#ifdef CHUNK_FOOTERLESS
+   /* The lock of eLastStatus, which a thread takes last, so that the
+    * status of the last chunk moves into the header of a new chunk
+    * past it before another thread sets it.
+    */
+   struct HeapMgrLock sLastLock;
+#endif
+#endif
+};
+
+/* The heap that the functions without a HeapMgr_T parameter use. It
+ * lies at the program break. */
+static struct HeapMgr oDefaultHeap; /*in bss so init. all 0*/
+
+#ifndef HEAPMGR_THREADS
+/* The chunks of the default heap that its client freed most
+ * recently, kept in use and out of its bins, so that they are
+ * allocated again without coalescing and splitting. Bin i holds
+ * chunks of i units, linked by their next in list fields as in
+ * aoBins. A thread cache does the same in thread-safe mode.
+ */
+static Chunk_T aoFastBins[FAST_BIN_COUNT];
+
+/* The number of bytes in the chunks of the fast bins. */
+static size_t uFastBytes = 0;
+#endif
+
+/* Requests of this many bytes or more to the default heap get
+ * mappings of their own, outside of the heap.
  */
-static void HeapMgr_addToList(Chunk_T oChunk)
+static size_t uMmapThreshold = MMAP_THRESHOLD_DEFAULT;
+
+/* Requests of up to this many bytes to the default heap get objects
+ * in slabs, if a class holds objects that big.
+ */
+static size_t uSlabThreshold = SLAB_THRESHOLD_DEFAULT;
+
+/* The number of times that the scavenger has woken up. Each free
+ * chunk of the default heap holds the value it had when the chunk was
+ * freed, in the unit after its header, or RELEASED if the pages of
+ * the chunk went back to the OS since.
+ */
+static volatile size_t uScavengeEpoch = 0;
+enum {RELEASED = -1};
+
+/* The start of the payload of a free chunk in a large bin, which
+ * places the chunk in the size tree of the bin. The tree is a
+ * bitwise trie on the bits of the size below its leading bit: a node
+ * at depth d has its children on either side of bit d of them, so
+ * no path is longer than the number of bits, and each size has one
+ * node. Other chunks of the size of a node hang off it in a ring.
+ */
+struct LargeNode
 {
-   Chunk_T oOldFront; /* chunk to store the old front of the list */
-   size_t  uIndex = Chunk_getUnits(oChunk); /* use to index into bin */
+   /* The free epoch of the chunk; see HeapMgr_setFreeSince(). */
+   size_t uFreeSince;
 
-   /* ceil index @ 1023 */
-   if(uIndex > (size_t) IBINCOUNT - 1) uIndex = (size_t) IBINCOUNT - 1;
+#ifdef CHUNK_NEARLINKS
+   /* The link of the chunk to the previous chunk in its bin, which
+    * the chunk keeps here rather than in its footer. It makes the
+    * node end a unit further into the payload.
+    */
+   Chunk_T oPrevInList;
+#endif
 
-   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
+   /* The parent of the node, the node itself if it is the root, or
+    * NULL if the chunk is in the ring of a node instead.
+    */
+   Chunk_T oParent;
 
-   /* clear chunk links */
-   Chunk_setNextInList(oChunk, NULL);
-   Chunk_setPrevInList(oChunk, NULL);
+   /* The subtrees of sizes with the bit of the node clear and set. */
+   Chunk_T aoChildren[2];
 
-   /* initialize a free list if nessecary */
-   if (aoBins[uIndex] == NULL)
-   {
-      aoBins[uIndex] = oChunk;
-      return;
-   }
+   /* The next and previous chunks in the ring of chunks of the same
+    * size.
+    */
+   Chunk_T oNextSame;
+   Chunk_T oPrevSame;
+};
 
-   /* select nodes of interest */
-   oOldFront = aoBins[uIndex];
-   aoBins[uIndex] = oChunk;
+/* The start of a slab, which is the payload of an in use chunk of the
+ * default heap. Its objects follow, each of them either in use, free
+ * and linked into pvFree by its first word, or never handed out yet.
+ */
+struct HeapMgrSlab
+{
+   /* The free objects. */
+   void *pvFree;
 
-   /* set links */
-   Chunk_setNextInList(aoBins[uIndex], oOldFront);
-   Chunk_setPrevInList(aoBins[uIndex], NULL);
-   Chunk_setPrevInList(oOldFront, aoBins[uIndex]);
+   /* The start of the part of the slab never carved into objects. */
+   char *pcFresh;
 
-   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
-   return;
-}
+   /* The class of the objects. */
+   size_t uClass;
 
-/* Remove oChunk from free list without changing the status bit
- * Return the removed Chunk which is the same as oChunk
+   /* The number of objects in use, and the most the slab holds. */
+   size_t uInUse;
+   size_t uCapacity;
+
+   /* The next and previous slabs of the class with free objects. */
+   struct HeapMgrSlab *psNext;
+   struct HeapMgrSlab *psPrev;
+};
+
+/* The slabs of each class with free objects, the one to allocate
+ * from first at the front.
  */
-static Chunk_T HeapMgr_removeFromList(Chunk_T oChunk)
+static struct HeapMgrSlab *apsSlabs[SLAB_CLASS_COUNT];
+
+/* Bit i % BIN_MAP_BITS of pulSlabMap[i / BIN_MAP_BITS] is set if the
+ * i-th SLAB_BYTES bytes from uSlabBase * SLAB_BYTES on are a slab, so
+ * that a free can tell an object in a slab, which has no header, from
+ * the payload of a chunk. NULL if the map could not be reserved, in
+ * which case there are no slabs.
+ */
+static volatile unsigned long *pulSlabMap = NULL;
+static size_t uSlabBase = 0;
+
+#ifdef HEAPMGR_THREADS
+/* The locks of the slabs of each class. A thread never holds one of
+ * them while it acquires another lock.
+ */
+static struct HeapMgrLock asSlabLocks[SLAB_CLASS_COUNT];
+
+/* The objects in slabs that a thread freed most recently, or took
+ * out of the slabs in a batch, kept out of their slabs, so that the
+ * thread allocates them again without the lock of their class.
+ * Class i holds objects of slab class i, linked by their first
+ * words.
+ */
+struct HeapMgrSlabCache
 {
-   Chunk_T oPrevChunk;
-   Chunk_T oNextChunk;
-   Chunk_T oNewFront;
-   size_t  uIndex = Chunk_getUnits(oChunk);
-   if(uIndex > (size_t) IBINCOUNT - 1) uIndex = (size_t) IBINCOUNT - 1;
-   assert(aoBins[uIndex] != NULL);
-   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
+   /* The cached objects of each class. */
+   void *apvObjects[SLAB_CLASS_COUNT];
 
-   /* case for removing front of list*/
-   if (oChunk == aoBins[uIndex])
-   {
-      oNewFront = Chunk_getNextInList(oChunk);
-      /* case for removing chunk from length one list */
-      if (oNewFront == NULL)
-      {
-         aoBins[uIndex] = NULL;
-         return oChunk;
-      }
-      aoBins[uIndex] = oNewFront;
-      Chunk_setPrevInList(aoBins[uIndex], NULL);
-      Chunk_setNextInList(oChunk, NULL);
-      return oChunk;
-   }
+   /* The number of objects in each class. */
+   size_t auCounts[SLAB_CLASS_COUNT];
 
-   /* get prev and next chunk */
-   oPrevChunk = Chunk_getPrevInList(oChunk);
-   oNextChunk = Chunk_getNextInList(oChunk);
-   assert((oPrevChunk != NULL) || (oNextChunk != NULL));
-   /* case for removing end of list */
-   if (oNextChunk == NULL)
-   {
-      Chunk_setNextInList(oPrevChunk, NULL);
-      Chunk_setPrevInList(oChunk, NULL);
-      return oChunk;
-   }
-   
-   Chunk_setNextInList(oPrevChunk, oNextChunk);
-   Chunk_setPrevInList(oNextChunk, oPrevChunk);
-   Chunk_setNextInList(oChunk, NULL);
-   Chunk_setPrevInList(oChunk, NULL);
+   /* TRUE if the cache is flushed when its thread exits. */
+   int iRegistered;
+};
 
-   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
+/* The slab cache of the calling thread. */
+static __thread struct HeapMgrSlabCache sSlabCache
+   __attribute__((tls_model("initial-exec")));
 
+/* The key whose destructor flushes the slab cache of an exiting
+ * thread. */
+static pthread_key_t iSlabCacheKey;
+#endif
 
-   return oChunk; 
-}
+#if defined(HEAPMGR_THREADS) && ! defined(NDEBUG)
+/* The number of threads writing headers of chunks that belong to
+ * them, without locks, and TRUE while a thread checks the heap, which
+ * keeps more from starting to.
+ */
+static volatile int iChangers = 0;
+static volatile int iChecking = FALSE;
 
+/* The number of calls to check the heap so far. */
+static volatile unsigned long ulChecks = 0;
 
-/* Split oChunk into two valid logical Chunks first of which has 
- * length uUnits and the second has the rest of physical chunks in it
- * The status bits of the two Chunks are undefined.
- * The lengths of the two Chunks are set accordingly so 
- * Chunk_getNextInMemory with the first split Chunk will 
- * return the second split Chunk
+/* The number of threads that have asked to check the heap and have
+ * not exited, and TRUE if the calling thread is one of them.
+ */
+static volatile int iCheckers = 0;
+static __thread int iIsChecker = FALSE;
+
+/* The key whose destructor forgets an exiting thread as one of
+ * them. */
+static pthread_key_t iCheckKey;
+#endif
+
+#ifdef HEAPMGR_THREADS
+/* TRUE if the scavenger thread runs, in which case frees leave the
+ * memory of the default heap to it, or FALSE otherwise.
+ */
+static volatile int iScavenging = FALSE;
+
+/* TRUE once the scavenger thread has been asked to exit. */
+static volatile int iScavengerStopping = FALSE;
+
+/* The scavenger thread. */
+static pthread_t iScavenger;
+
+/* The nanoseconds that the scavenger sleeps between its walks, and
+ * the number of walks that a chunk must stay free before its pages
+ * go back to the OS.
+ */
+static unsigned long ulScavengePeriodNanos;
+static size_t uScavengeAge;
+#endif
+
+#if defined(HEAPMGR_THREADS) && ! defined(HEAPMGR_PAGES)
+/* The chunks that a thread freed most recently, kept in use and out
+ * of the bins of the default heap, so that the thread can allocate
+ * them again without a lock. Bin i holds chunks of i units, linked
+ * by their next in list fields as in aoBins.
  */
-static Chunk_T HeapMgr_splitGetTail(Chunk_T oChunk, size_t uUnits)
+struct HeapMgrCache
 {
-   /* oChunk is used as an alias for oFront after oTail is allocated*/
-   Chunk_T oTail  = NULL;
-   size_t  uBytes;
-   size_t  uTotalUnits;
-   
-   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
-   
-   uBytes = Chunk_unitsToBytes(uUnits);
-   uTotalUnits = Chunk_getUnits(oChunk);
-   oTail = (Chunk_T)((char*)oChunk + uBytes);
-   assert(uTotalUnits > uUnits);
-   Chunk_setUnits(oTail, uTotalUnits - uUnits);
+   /* The cached chunks of each size. */
+   Chunk_T aoBins[CACHE_BIN_COUNT];
 
-   Chunk_setUnits(oChunk, uUnits);
+   /* The number of chunks in each bin. */
+   size_t auCounts[CACHE_BIN_COUNT];
 
-   /* the split chunks are individually valid */
-   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
-   assert(Chunk_isValid(oTail, oHeapStart, oHeapEnd));
+   /* TRUE if the cache is flushed when its thread exits. */
+   int iRegistered;
+};
 
-   /* Their sizes sum up to the total */
-   assert(Chunk_getUnits(oChunk) + Chunk_getUnits(oTail) ==uTotalUnits);
+/* The cache of the calling thread. The initial-exec model keeps a
+ * look at it from allocating. */
+static __thread struct HeapMgrCache sCache
+   __attribute__((tls_model("initial-exec")));
 
-   /* sizes are set correctly and the two are adjacent */
-   assert(Chunk_getNextInMem(oChunk, oHeapEnd) == oTail);
-   assert(Chunk_getPrevInMem(oTail,oHeapStart) == oChunk);
+#endif
 
-   return oTail;
-}
+#ifdef HEAPMGR_THREADS
+/* The key whose destructor flushes the cache of an exiting thread,
+ * or gives up its pages. */
+static pthread_key_t iCacheKey;
+#endif
 
-/* Assume the Chunk which is next to oChunk in memory is free
- * Coalesce the two and add the merged chunk instead of the 
- * two old ones to the Free list. Return the coalesced chunk
- * as a result.
+#ifdef HEAPMGR_PAGES
+struct HeapMgrPages;
+
+/* A page of chunks of one size, carved out of the page arena, that
+ * one thread allocates from and frees to without atomic
+ * instructions. Other threads free to it with one CAS each, onto a
+ * list that the owner takes over in bulk. The chunks are in use as
+ * far as the rest of the HeapMgr is concerned, and never coalesce.
  */
-static Chunk_T HeapMgr_coalesceForward(Chunk_T oChunk)
+struct HeapMgrPage
 {
-   Chunk_T oNext = NULL;
-   size_t  uChunkUnits;
-   size_t  uNextUnits;
-   size_t  uTotalUnits;
-   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
+   /* The pages of the thread that owns the page, or NULL if that
+    * thread exited with chunks of the page still in use. */
+   struct HeapMgrPages *volatile psOwner;
 
-   /* get adjacent chunk*/
-   oNext = Chunk_getNextInMem(oChunk, oHeapEnd);
-   assert(Chunk_isValid(oNext, oHeapStart, oHeapEnd));
-   assert(Chunk_getStatus(oNext) == CHUNK_FREE);
-
-   /* compute total units */
-   uChunkUnits = Chunk_getUnits(oChunk);
-   uNextUnits = Chunk_getUnits(oNext);
-   uTotalUnits = uChunkUnits + uNextUnits;
-
-   /* rm both from list */
-   (void)HeapMgr_removeFromList(oChunk);
-   (void)HeapMgr_removeFromList(oNext);
-
-   /* make chunk valid */
-   Chunk_setUnits(oChunk, uTotalUnits);
-   Chunk_setStatus(oChunk, CHUNK_FREE);
-   /* add back to list */
-   HeapMgr_addToList(oChunk);
-   return oChunk;
-}
+   /* The chunks that other threads freed, linked by their next in
+    * list fields. */
+   Chunk_T volatile oRemoteFree;
+
+   /* The chunks that the owner freed or took over. */
+   Chunk_T oLocalFree;
+
+   /* The start of the part of the page never carved into chunks. */
+   Chunk_T oFresh;
+
+   /* The number of units in each chunk of the page. */
+   size_t uUnits;
+
+   /* The number of chunks of the page in use or in oRemoteFree. */
+   size_t uInUse;
+
+   /* The next page of the owner with chunks of the same size, or the
+    * next free page of the arena. */
+   struct HeapMgrPage *psNext;
+};
+
+/* The pages that a thread owns. */
+struct HeapMgrPages
+{
+   /* The pages with chunks of each number of units, the one to
+    * allocate from first at the front. */
+   struct HeapMgrPage *apsPages[CACHE_BIN_COUNT];
+
+   /* TRUE if the pages are given up when the thread exits. */
+   int iRegistered;
+};
+
+/* The pages of the calling thread. Its address tells the pages of
+ * the thread from those of other threads. */
+static __thread struct HeapMgrPages sPages
+   __attribute__((tls_model("initial-exec")));
+
+/* The reserved address space that pages are carved from, or NULL if
+ * it could not be reserved. */
+static char *pcPageArena = NULL;
+
+/* The number of pages ever carved from the page arena. */
+static size_t uPagesCarved = 0;
+
+/* The pages of the arena that no thread owns any more. */
+static struct HeapMgrPage *psFreePages = NULL;
 
-/* Assume the Chunk which is the previous of oChunk in memory is free
- * Coalesce the two and add the merged chunk instead of the 
- * two old ones to the Free list. Return the coalesced chunk as
- * as a result.
+/* The lock of uPagesCarved and psFreePages. */
+static struct HeapMgrLock sPageLock;
+#endif
+
+#ifdef HEAPMGR_RSEQ
+/* The chunks that threads freed most recently on one CPU, kept as in
+ * struct HeapMgrCache. Only restartable sequences touch it, which
+ * the kernel restarts if their thread leaves the CPU before they
+ * commit, so it needs neither locks nor atomic instructions.
  */
-static Chunk_T HeapMgr_coalesceBackward(Chunk_T oChunk)
+struct HeapMgrCpuCache
 {
-   Chunk_T oPrev = NULL;
-   size_t  uChunkUnits;
-   size_t  uPrevUnits;
-   size_t  uTotalUnits;
+   /* The number of chunks in each bin. */
+   size_t auCounts[CACHE_BIN_COUNT];
 
-   /* get chunk adjacent in memory */
-   oPrev = Chunk_getPrevInMem(oChunk, oHeapStart);
+   /* The cached chunks of each size, the newest last. */
+   Chunk_T aaoSlots[CACHE_BIN_COUNT][CACHE_BIN_MAX];
+};
 
-   /* compute total units */
-   uChunkUnits = Chunk_getUnits(oChunk);
-   uPrevUnits = Chunk_getUnits(oPrev);
-   uTotalUnits = uChunkUnits + uPrevUnits;
+/* The caches of the CPUs, or NULL if the calling thread of
+ * HeapMgr_init() could not run restartable sequences, in which case
+ * the thread caches serve instead. */
+static struct HeapMgrCpuCache *psCpuCaches = NULL;
 
-   /* rm both chunks from list */
-   (void)HeapMgr_removeFromList(oChunk);
-   (void)HeapMgr_removeFromList(oPrev);
+/* The number of caches in psCpuCaches. */
+static size_t uCpuCacheCount = 0;
 
-   /* make chunk valid */
-   oChunk = oPrev;
-   Chunk_setUnits(oChunk, uTotalUnits);
-   Chunk_setStatus(oChunk, CHUNK_FREE);
+/* The results of a restartable sequence on a CPU cache. */
+enum CpuResult
+{
+   CPU_DONE,     /* the sequence committed */
+   CPU_REFUSED,  /* the bin was full, or empty */
+   CPU_ABORTED,  /* the kernel restarted the sequence */
+   CPU_NONE      /* the calling thread cannot use the CPU caches */
+};
+#endif
 
-   /* add back to list */
-   HeapMgr_addToList(oChunk);
-   return oChunk;
+/* Return the index of the bin that holds free chunks of uUnits
+ * units.
+ */
+static size_t HeapMgr_getBinIndex(size_t uUnits)
+{
+   size_t uLeadingBit; /* the position of the leading bit of uUnits */
+
+   if (uUnits < (size_t)SMALL_BIN_COUNT)
+      return uUnits;
+   uLeadingBit = sizeof(unsigned long) * CHAR_BIT - 1
+                 - (size_t)__builtin_clzl((unsigned long)uUnits);
+   return (size_t)SMALL_BIN_COUNT + uLeadingBit
+          - (size_t)LARGE_BIN_SHIFT;
 }
 
-void *HeapMgr_malloc(size_t uBytes)
+#ifndef NDEBUG
+/* Return the number of chunks in the subtree of oNode in the size tree
+ * of a large bin, or (size_t)-1 if the subtree is invalid. oParent
+ * must be the parent of oNode, and the bits of the sizes in the
+ * subtree from bit uBit up must be uPrefix.
+ */
+static size_t HeapMgr_countTree(Chunk_T oNode, Chunk_T oParent,
+                                size_t uPrefix, size_t uBit)
 {
-   size_t uUnits; /* units requested by client */
-   size_t uIndex; /* used to index into a bin */
-   Chunk_T oChunk = NULL; /* chunk pntr to eventually return */
-   Chunk_T oTail  = NULL; /* used for splitting case */
-   
-   if (uBytes == 0)
-      return NULL;
+   struct LargeNode *psNode;
+   struct LargeNode *psSame;
+   Chunk_T oSame; /* a chunk in the ring of oNode */
+   size_t uCount; /* chunks found so far */
+   size_t uSubtree; /* chunks in a subtree of oNode */
+   int i;
 
-   /* (1) initialize */
-   if (oHeapStart == NULL)
+   if (oNode == NULL)
+      return 0;
+   psNode = (struct LargeNode*)Chunk_toPayload(oNode);
+   if ((psNode->oParent != oParent) ||
+       ((Chunk_getUnits(oNode) >> uBit) != uPrefix) ||
+       (Chunk_getStatus(oNode) != CHUNK_FREE))
+      return (size_t)-1;
+
+   /* (1) the ring of chunks of the same size */
+   uCount = 1;
+   for (oSame = psNode->oNextSame; oSame != oNode;
+        oSame = psSame->oNextSame)
    {
-      oHeapStart = (Chunk_T)sbrk(0);
-      oHeapEnd = oHeapStart;
+      psSame = (struct LargeNode*)Chunk_toPayload(oSame);
+      if ((psSame->oParent != NULL) ||
+          (Chunk_getUnits(oSame) != Chunk_getUnits(oNode)) ||
+          (Chunk_getStatus(oSame) != CHUNK_FREE) ||
+          (((struct LargeNode*)Chunk_toPayload(psSame->oPrevSame))
+           ->oNextSame != oSame))
+         return (size_t)-1;
+      uCount++;
    }
-   assert(Checker_isValid(oHeapStart, oHeapEnd, aoBins, IBINCOUNT));
-   /* (2) determine units needed */
-   uUnits = Chunk_bytesToUnits(uBytes);
-   /* assign uIndex properly */
-   uIndex = uUnits;
-   if ( uIndex > (size_t) IBINCOUNT - 1)
-      uIndex = (size_t) IBINCOUNT - 1;
 
-   /* increment if necessary */   
-   while(uIndex < ((size_t) IBINCOUNT - 1) && aoBins[uIndex] == NULL)
-      uIndex++;
+   /* (2) the subtrees, which hold nothing once every bit is used */
+   for (i = 0; i < 2; i++)
+   {
+      if (uBit == 0)
+      {
+         if (psNode->aoChildren[i] != NULL)
+            return (size_t)-1;
+         continue;
+      }
+      uSubtree = HeapMgr_countTree(psNode->aoChildren[i], oNode,
+                                   (uPrefix << 1) | (size_t)i,
+                                   uBit - 1);
+      if (uSubtree == (size_t)-1)
+         return (size_t)-1;
+      uCount += uSubtree;
+   }
+   return uCount;
+}
+#endif
+
+#ifndef NDEBUG
+/* Return 1 (TRUE) if oHeap is in a valid state, or 0 (FALSE)
+ * otherwise. No other thread may change it meanwhile.
+ */
+static int HeapMgr_checkHeap(HeapMgr_T oHeap)
+{
+   size_t uIndex;
+   size_t uWord;
+   size_t uCount; /* chunks in the list of a bin */
+#ifndef HEAPMGR_THREADS
+   size_t uBytes; /* bytes in the chunks of the fast bins */
+#endif
+   int iHasChunks;
+   Chunk_T oChunk;
+   Chunk_T oRoot;
+#ifdef CHUNK_FOOTERLESS
+   Chunk_T oLast = NULL; /* the last chunk in memory */
+#endif
+
+   if (! Checker_isValidBins(oHeap->oHeapStart, oHeap->oHeapEnd,
+                             oHeap->aoBins, IBINCOUNT,
+                             HeapMgr_getBinIndex))
+      return FALSE;
 
-   /* (3) for each chunk in the free list of the correct bin */
-   for (oChunk = aoBins[uIndex];
-        oChunk != NULL;
-        oChunk = Chunk_getNextInList(oChunk))
+   /* the bin map must agree with the bins */
+   for (uIndex = 0; uIndex < (size_t)IBINCOUNT; uIndex++)
+   {
+      uWord = uIndex / (size_t)BIN_MAP_BITS;
+      iHasChunks = ((oHeap->aulBinMap[uWord]
+                     >> (uIndex % (size_t)BIN_MAP_BITS)) & 1UL) != 0;
+      if (iHasChunks != (oHeap->aoBins[uIndex] != NULL))
+      {
+         fprintf(stderr, "The bin map disagrees with bin %lu\n",
+                 (unsigned long)uIndex);
+         return FALSE;
+      }
+   }
+   for (uWord = 0; uWord < (size_t)BIN_MAP_WORDS; uWord++)
+      if ((((oHeap->ulBinSummary >> uWord) & 1UL) != 0) !=
+          (oHeap->aulBinMap[uWord] != 0))
+      {
+         fprintf(stderr,
+                 "The bin map summary disagrees with word %lu\n",
+                 (unsigned long)uWord);
+         return FALSE;
+      }
+
+   /* the size tree of each large bin must hold the chunks of its
+      list */
+   for (uIndex = (size_t)SMALL_BIN_COUNT; uIndex < (size_t)IBINCOUNT;
+        uIndex++)
+   {
+      uCount = 0;
+      for (oChunk = oHeap->aoBins[uIndex]; oChunk != NULL;
+           oChunk = Chunk_getNextInList(oChunk))
+         uCount++;
+      oRoot = oHeap->aoTrees[uIndex - (size_t)SMALL_BIN_COUNT];
+      if (HeapMgr_countTree(oRoot, oRoot, 1,
+             uIndex - (size_t)SMALL_BIN_COUNT + (size_t)LARGE_BIN_SHIFT)
+          != uCount)
       {
-         /* if the current free list chunk is not big enough 
-          * relevant only for bin 1023 
-          */
-         if(Chunk_getUnits(oChunk) < uUnits) continue;
-            
-         /* if the chunk is too big, rm from free list */
-         if ((Chunk_getUnits(oChunk) - uUnits) >= SPLIT_THRESHOLD)
+         fprintf(stderr, "The size tree of bin %lu disagrees with"
+                 " its list\n", (unsigned long)uIndex);
+         return FALSE;
+      }
+   }
+
+#ifndef HEAPMGR_THREADS
+   /* the last remainder must be a free chunk, and so in its bin */
+   oChunk = oHeap->oLastRemainder;
+   if ((oChunk != NULL) &&
+       ((! Chunk_isValid(oChunk, oHeap->oHeapStart, oHeap->oHeapEnd)) ||
+        (Chunk_getStatus(oChunk) != CHUNK_FREE)))
+   {
+      fprintf(stderr, "The last remainder is not a free chunk\n");
+      return FALSE;
+   }
+
+   /* the chunks of the fast bins must be in use, in the bin of their
+      size or of a size less than SPLIT_THRESHOLD units below it, as a
+      sized free puts them, and the bins must add up to uFastBytes */
+   if (oHeap == &oDefaultHeap)
+   {
+      uBytes = 0;
+      for (uIndex = 0; uIndex < (size_t)FAST_BIN_COUNT; uIndex++)
+         for (oChunk = aoFastBins[uIndex];
+              (oChunk != NULL) && (uBytes <= uFastBytes);
+              oChunk = Chunk_getNextInList(oChunk))
          {
-            (void)HeapMgr_removeFromList(oChunk);
-                       
-            /* ochunk needs to be a valid logical chunk */
-            oTail = HeapMgr_splitGetTail(oChunk, uUnits);
-            
-            Chunk_setStatus(oTail, CHUNK_FREE);
-            HeapMgr_addToList(oTail);
-            
-            Chunk_setStatus(oChunk, CHUNK_INUSE);
-            assert(Checker_isValid(oHeapStart, oHeapEnd,
-                                   aoBins, IBINCOUNT));   
-            /* given a head, set in use, set address of payload */
-            return Chunk_toPayload(oChunk);   
+            if ((! Chunk_isValid(oChunk, oHeap->oHeapStart,
+                                 oHeap->oHeapEnd)) ||
+                (Chunk_getStatus(oChunk) != CHUNK_INUSE) ||
+                (Chunk_getUnits(oChunk) < uIndex) ||
+                (Chunk_getUnits(oChunk) - uIndex >= SPLIT_THRESHOLD))
+            {
+               fprintf(stderr, "Fast bin %lu holds a bad chunk\n",
+                       (unsigned long)uIndex);
+               return FALSE;
+            }
+            uBytes += Chunk_unitsToBytes(uIndex);
          }
-         /* if chunk not too big */
-         oChunk = HeapMgr_removeFromList(oChunk);
-         Chunk_setStatus(oChunk, CHUNK_INUSE);
-         
-         assert(Checker_isValid(oHeapStart, oHeapEnd, aoBins, IBINCOUNT));   
-         return Chunk_toPayload(oChunk);   
+      if (uBytes != uFastBytes)
+      {
+         fprintf(stderr, "The fast bins hold %lu bytes, not %lu\n",
+                 (unsigned long)uBytes, (unsigned long)uFastBytes);
+         return FALSE;
       }
-   
-   /* (4) get more memory if needed */
-   oChunk = HeapMgr_getMoreMemory(uUnits);
-   if (oChunk == NULL)
+   }
+#endif
+
+#ifdef CHUNK_FOOTERLESS
+   /* the heap must hold the status of its last chunk, which no header
+      records */
+   for (oChunk = (oHeap->oHeapStart == oHeap->oHeapEnd) ? NULL :
+           oHeap->oHeapStart;
+        oChunk != NULL;
+        oChunk = Chunk_getNextInMem(oChunk, oHeap->oHeapEnd))
+      oLast = oChunk;
+   if (oHeap->eLastStatus !=
+       ((oLast == NULL) ? CHUNK_INUSE : Chunk_getStatus(oLast)))
    {
-      assert(Checker_isValid(oHeapStart, oHeapEnd, aoBins, IBINCOUNT)); 
-      return NULL;
+      fprintf(stderr, "The heap has the wrong status of its last"
+              " chunk\n");
+      return FALSE;
    }
-   /*(4.1) set the status add the newly created chunk to the list*/
-   Chunk_setStatus(oChunk, CHUNK_FREE);
-   HeapMgr_addToList(oChunk);
+#endif
+   return TRUE;
+}
+#endif
 
-   /* coalesce backward if needed */
-   if((Chunk_getPrevInMem(oChunk, oHeapStart) != NULL) &&
-      Chunk_getStatus(Chunk_getPrevInMem(oChunk, oHeapStart))
-      == CHUNK_FREE)
-      oChunk = HeapMgr_coalesceBackward(oChunk);
-   
-   assert(Checker_isValid(oHeapStart, oHeapEnd, aoBins, IBINCOUNT));
-      
-   /* if the chunk is too big, rm from free list */
-   if ((Chunk_getUnits(oChunk) - uUnits) >= SPLIT_THRESHOLD)
+/*--------------------------------------------------------------------*/
+
+#ifdef HEAPMGR_THREADS
+/* Acquire the lock *psLock, counting the acquisition and, if the
+ * lock is held by another thread, the time spent waiting for it.
+ */
+static void HeapMgr_acquire(struct HeapMgrLock *psLock)
+{
+   struct timespec sStart; /* when the wait began */
+   struct timespec sEnd; /* when the wait ended */
+   int iSpins = 0; /* looks at the held lock since the last yield */
+
+   if (__sync_lock_test_and_set(&psLock->iHeld, 1) != 0)
    {
-      oChunk = HeapMgr_removeFromList(oChunk);
-      
-      oTail = HeapMgr_splitGetTail(oChunk, uUnits);
-   
-      Chunk_setStatus(oTail, CHUNK_FREE);
-      HeapMgr_addToList(oTail); /* addToList sets the status bit*/
+      (void)clock_gettime(CLOCK_MONOTONIC, &sStart);
+      do
+      {
+         /* wait without writing to the lock's cache line */
+         while (psLock->iHeld != 0)
+         {
+            if (++iSpins == SPINS_BEFORE_YIELD)
+            {
+               (void)sched_yield();
+               iSpins = 0;
+            }
+         }
+      } while (__sync_lock_test_and_set(&psLock->iHeld, 1) != 0);
+      (void)clock_gettime(CLOCK_MONOTONIC, &sEnd);
 
-      Chunk_setStatus(oChunk, CHUNK_INUSE);
-      assert(Checker_isValid(oHeapStart, oHeapEnd, aoBins, IBINCOUNT));
-      /* given a head, get address of payload */
-      return Chunk_toPayload(oChunk);   
+      psLock->sStats.ulContentions++;
+      psLock->sStats.ulWaitNanos += (unsigned long)
+         ((sEnd.tv_sec - sStart.tv_sec) * (long)NANOS_PER_SECOND
+          + (sEnd.tv_nsec - sStart.tv_nsec));
    }
-   /* remove chunk from free list, update status, and return */
-   (void) HeapMgr_removeFromList(oChunk);
-   Chunk_setStatus(oChunk, CHUNK_INUSE);
+   psLock->sStats.ulAcquisitions++;
+}
 
-   /* assert check is valid at trailing edge of malloc */
-   assert(Checker_isValid(oHeapStart, oHeapEnd, aoBins, IBINCOUNT));
-   return Chunk_toPayload(oChunk);
+/* Release the lock *psLock. */
+static void HeapMgr_release(struct HeapMgrLock *psLock)
+{
+   __sync_lock_release(&psLock->iHeld);
 }
 
-void HeapMgr_free(void *pv)
+/* Acquire the lock of the end of oHeap and the locks of its bins, in
+ * an order that no other thread acquires two of them in.
+ */
+static void HeapMgr_lockHeap(HeapMgr_T oHeap)
 {
-   Chunk_T oChunk = NULL;
-   assert(pv != NULL);
-   assert(Checker_isValid(oHeapStart, oHeapEnd, aoBins, IBINCOUNT));
-   /* (0) get the chunk from payload */
-   oChunk = Chunk_fromPayload(pv);
-   /* (1) set status of the given chunk to free */
-   Chunk_setStatus(oChunk, CHUNK_FREE);
+   int i;
 
-   /* (2) Add to the list */
-   HeapMgr_addToList(oChunk); /* addToList sets the status bit*/
-   
-   /* coalesce forward if needed */
-   if((Chunk_getNextInMem(oChunk, oHeapEnd) != NULL) &&
-      Chunk_getStatus(Chunk_getNextInMem(oChunk, oHeapEnd))
-       == CHUNK_FREE)
-      oChunk = HeapMgr_coalesceForward(oChunk);
+   HeapMgr_acquire(&oHeap->sTopLock);
+   for (i = 0; i < IBINCOUNT; i++)
+      HeapMgr_acquire(&oHeap->asBinLocks[i]);
+#ifdef CHUNK_FOOTERLESS
+   HeapMgr_acquire(&oHeap->sLastLock);
+#endif
+}
+
+/* Release the locks that HeapMgr_lockHeap() acquired. */
+static void HeapMgr_unlockHeap(HeapMgr_T oHeap)
+{
+   int i;
+
+#ifdef CHUNK_FOOTERLESS
+   HeapMgr_release(&oHeap->sLastLock);
+#endif
+   for (i = IBINCOUNT - 1; i >= 0; i--)
+      HeapMgr_release(&oHeap->asBinLocks[i]);
+   HeapMgr_release(&oHeap->sTopLock);
+}
+
+/* Acquire every lock of the default heap, in an order that no other
+ * thread acquires two of them in.
+ */
+static void HeapMgr_lockAll(void)
+{
+   int i;
+
+   HeapMgr_lockHeap(&oDefaultHeap);
+#ifdef HEAPMGR_PAGES
+   HeapMgr_acquire(&sPageLock);
+#endif
+   for (i = 0; i < SLAB_CLASS_COUNT; i++)
+      HeapMgr_acquire(&asSlabLocks[i]);
+}
+
+/* Release every lock of the default heap. */
+static void HeapMgr_unlockAll(void)
+{
+   int i;
+
+   for (i = SLAB_CLASS_COUNT - 1; i >= 0; i--)
+      HeapMgr_release(&asSlabLocks[i]);
+#ifdef HEAPMGR_PAGES
+   HeapMgr_release(&sPageLock);
+#endif
+   HeapMgr_unlockHeap(&oDefaultHeap);
+}
+#endif
+
+/* Start to write headers of chunks that belong to the calling
+ * thread, without locks, in a debug build in thread-safe mode. The
+ * thread must hold no lock, as it waits while another one checks
+ * the heap.
+ */
+static void HeapMgr_startChange(void)
+{
+#if defined(HEAPMGR_THREADS) && ! defined(NDEBUG)
+   for (;;)
+   {
+      (void)__sync_fetch_and_add(&iChangers, 1);
+      if (! iChecking)
+         return;
+      (void)__sync_fetch_and_sub(&iChangers, 1);
+      while (iChecking)
+         (void)sched_yield();
+   }
+#endif
+}
+
+/* Finish what HeapMgr_startChange() started. */
+static void HeapMgr_endChange(void)
+{
+#if defined(HEAPMGR_THREADS) && ! defined(NDEBUG)
+   (void)__sync_fetch_and_sub(&iChangers, 1);
+#endif
+}
+
+#ifndef NDEBUG
+#ifdef HEAPMGR_THREADS
+/* Forget the thread that owns pv, which is exiting, as one that
+ * checks the heap.
+ */
+static void HeapMgr_forgetChecker(void *pv)
+{
+   (void)pv;
+   (void)__sync_fetch_and_sub(&iCheckers, 1);
+}
+
+/* Forget, in a child process, the checks and the changes of threads
+ * that it does not have.
+ */
+static void HeapMgr_forgetChecks(void)
+{
+   iChangers = 0;
+   iChecking = FALSE;
+   iCheckers = iIsChecker ? 1 : 0;
+}
+#endif
+
+/* Return 1 (TRUE) if oHeap is in a valid state, or 0 (FALSE)
+ * otherwise. In thread-safe mode, the caller must hold no lock. The
+ * check waits for the other threads to finish writing headers of
+ * their own chunks, and holds every lock, so while they use the heap
+ * too, only every ulPeriod-th call checks it, and the rest return
+ * TRUE.
+ */
+static int HeapMgr_isValidEvery(HeapMgr_T oHeap, unsigned long ulPeriod)
+{
+#ifdef HEAPMGR_THREADS
+   int iValid;
+
+   /* the key exists once the default heap does */
+   if ((! iIsChecker) && (oDefaultHeap.oHeapStart != NULL))
+   {
+      iIsChecker = TRUE;
+      (void)__sync_fetch_and_add(&iCheckers, 1);
+      (void)pthread_setspecific(iCheckKey, &iIsChecker);
+   }
+   if ((iCheckers > 1) &&
+       (__sync_fetch_and_add(&ulChecks, 1UL) % ulPeriod != 0))
+      return TRUE;
+
+   /* one thread checks at a time */
+   if (__sync_val_compare_and_swap(&iChecking, FALSE, TRUE) != FALSE)
+      return TRUE;
+   while (iChangers != 0)
+      (void)sched_yield();
+   HeapMgr_lockAll();
+   if (oHeap != &oDefaultHeap)
+      HeapMgr_lockHeap(oHeap);
+   iValid = HeapMgr_checkHeap(oHeap);
+   if (oHeap != &oDefaultHeap)
+      HeapMgr_unlockHeap(oHeap);
+   HeapMgr_unlockAll();
+   __sync_lock_release(&iChecking);
+   return iValid;
+#else
+   (void)ulPeriod;
+   return HeapMgr_checkHeap(oHeap);
+#endif
+}
+
+/* Return 1 (TRUE) if oHeap is in a valid state, or 0 (FALSE)
+ * otherwise, as HeapMgr_isValidEvery() does every CHECK_PERIOD-th
+ * time while other threads use the heap.
+ */
+static int HeapMgr_isValid(HeapMgr_T oHeap)
+{
+#ifdef HEAPMGR_THREADS
+   return HeapMgr_isValidEvery(oHeap, (unsigned long)CHECK_PERIOD);
+#else
+   return HeapMgr_checkHeap(oHeap);
+#endif
+}
+#endif
+
+#if defined(HEAPMGR_THREADS) && ! defined(HEAPMGR_PAGES)
+/* Move uCount chunks, or all of them if there are fewer, out of bin
+ * uIndex of *psCache and back to the bins of the default heap.
+ */
+static void HeapMgr_flushCache(struct HeapMgrCache *psCache,
+                               size_t uIndex, size_t uCount)
+{
+   void *apv[CACHE_BIN_MAX]; /* the payloads of the chunks to move */
+   Chunk_T oChunk = NULL;
+   size_t i;
+
+   assert(uCount <= (size_t)CACHE_BIN_MAX);
+
+   for (i = 0; (i < uCount) && (psCache->aoBins[uIndex] != NULL); i++)
+   {
+      oChunk = psCache->aoBins[uIndex];
+      psCache->aoBins[uIndex] = Chunk_getNextInList(oChunk);
+      apv[i] = Chunk_toPayload(oChunk);
+   }
+   psCache->auCounts[uIndex] -= i;
+
+   /* neighbors freed together coalesce before they reach the bins */
+   HeapMgr_freeBatch(apv, i);
+}
+
+/* Flush all of pv, the cache of a thread that is exiting. */
+static void HeapMgr_flushAll(void *pv)
+{
+   struct HeapMgrCache *psCache = (struct HeapMgrCache*)pv;
+   size_t uIndex;
+
+   for (uIndex = 0; uIndex < (size_t)CACHE_BIN_COUNT; uIndex++)
+      HeapMgr_flushCache(psCache, uIndex, (size_t)CACHE_BIN_MAX);
+
+   /* a later destructor may fill it again */
+   psCache->iRegistered = FALSE;
+}
+
+/* Put oChunk in bin uIndex of the cache of the calling thread, first
+ * giving a few chunks back to the heap if the bin is full.
+ */
+static void HeapMgr_pushThread(size_t uIndex, Chunk_T oChunk)
+{
+   if (! sCache.iRegistered)
+   {
+      sCache.iRegistered = TRUE;
+      (void)pthread_setspecific(iCacheKey, &sCache);
+   }
+
+   /* a full bin gives back its oldest few chunks at once */
+   if (sCache.auCounts[uIndex] == (size_t)CACHE_BIN_MAX)
+      HeapMgr_flushCache(&sCache, uIndex, (size_t)CACHE_BATCH);
+
+   Chunk_setNextInList(oChunk, sCache.aoBins[uIndex]);
+   sCache.aoBins[uIndex] = oChunk;
+   sCache.auCounts[uIndex]++;
+}
+
+/* Take a chunk out of bin uIndex of the cache of the calling thread.
+ * Return it, or NULL if the bin is empty.
+ */
+static Chunk_T HeapMgr_popThread(size_t uIndex)
+{
+   Chunk_T oChunk = NULL;
+
+   oChunk = sCache.aoBins[uIndex];
+   if (oChunk != NULL)
+   {
+      sCache.aoBins[uIndex] = Chunk_getNextInList(oChunk);
+      sCache.auCounts[uIndex]--;
+   }
+   return oChunk;
+}
+#endif
+
+#ifdef HEAPMGR_RSEQ
+/* Return the restartable sequence area that the C library
+ * registered for the calling thread. It lies at __rseq_offset from
+ * the thread pointer.
+ */
+static struct rseq *HeapMgr_getRseq(void)
+{
+   char *pcThread; /* the thread pointer */
+
+   __asm__ ("movq %%fs:0, %0" : "=r" (pcThread));
+   return (struct rseq*)(pcThread + __rseq_offset);
+}
+
+/* Return the CPU cache of the CPU that the calling thread ran on
+ * last, and store the number of that CPU in *puiCpu, or return NULL
+ * if the thread cannot use the CPU caches.
+ */
+static struct HeapMgrCpuCache *HeapMgr_getCpuCache(
+   struct rseq *psRseq, unsigned int *puiCpu)
+{
+   /* the kernel writes both fields behind the compiler's back */
+   *puiCpu = *(volatile unsigned int*)&psRseq->cpu_id_start;
+   if ((psCpuCaches == NULL) ||
+       ((int)*(volatile unsigned int*)&psRseq->cpu_id < 0) ||
+       ((size_t)*puiCpu >= uCpuCacheCount))
+      return NULL;
+   return &psCpuCaches[*puiCpu];
+}
+
+/* Put oChunk in bin uIndex of the cache of the CPU that runs the
+ * calling thread. Return CPU_DONE if so, CPU_REFUSED if the bin is
+ * full, or CPU_NONE if the thread cannot use the CPU caches.
+ */
+static enum CpuResult HeapMgr_pushCpu(size_t uIndex, Chunk_T oChunk)
+{
+   struct rseq *psRseq = HeapMgr_getRseq();
+   struct HeapMgrCpuCache *psCpu; /* the cache of the CPU */
+   unsigned int uiCpu; /* the CPU that the sequence must run on */
+   int iResult;
+
+   do
+   {
+      psCpu = HeapMgr_getCpuCache(psRseq, &uiCpu);
+      if (psCpu == NULL)
+         return CPU_NONE;
+
+      /* Describe the sequence from 1 up to 2 to the kernel, with its
+         abort handler at 4, behind the signature that the kernel
+         checks. Then, if the thread still runs on uiCpu, store
+         oChunk in the first empty slot of the bin, and commit by
+         storing the new count. */
+      __asm__ __volatile__ (
+         ".pushsection __rseq_cs, \"aw\"\n\t"
+         ".balign 32\n\t"
+         "3:\n\t"
+         ".long 0, 0\n\t"
+         ".quad 1f, 2f - 1f, 4f\n\t"
+         ".popsection\n\t"
+         "leaq 3b(%%rip), %%rax\n\t"
+         "movq %%rax, %c[csoff](%[rseq])\n\t"
+         "1:\n\t"
+         "cmpl %[cpu], %c[cpuoff](%[rseq])\n\t"
+         "jnz 4f\n\t"
+         "movq (%[count]), %%rcx\n\t"
+         "cmpq %[max], %%rcx\n\t"
+         "jae 5f\n\t"
+         "movq %[chunk], (%[slots], %%rcx, 8)\n\t"
+         "incq %%rcx\n\t"
+         "movq %%rcx, (%[count])\n\t"
+         "2:\n\t"
+         "movl %[done], %[result]\n\t"
+         "jmp 6f\n\t"
+         ".long %c[sig]\n\t"
+         "4:\n\t"
+         "movl %[aborted], %[result]\n\t"
+         "jmp 6f\n\t"
+         "5:\n\t"
+         "movl %[refused], %[result]\n\t"
+         "6:\n\t"
+         : [result] "=&r" (iResult)
+         : [rseq] "r" (psRseq),
+           [cpu] "r" (uiCpu),
+           [count] "r" (&psCpu->auCounts[uIndex]),
+           [slots] "r" (psCpu->aaoSlots[uIndex]),
+           [chunk] "r" (oChunk),
+           [max] "i" (CACHE_BIN_MAX),
+           [csoff] "i" (offsetof(struct rseq, rseq_cs)),
+           [cpuoff] "i" (offsetof(struct rseq, cpu_id)),
+           [sig] "i" (RSEQ_SIG),
+           [done] "i" (CPU_DONE),
+           [aborted] "i" (CPU_ABORTED),
+           [refused] "i" (CPU_REFUSED)
+         : "rax", "rcx", "memory", "cc");
+   } while (iResult == CPU_ABORTED);
+
+   return (enum CpuResult)iResult;
+}
+
+/* Take the newest chunk out of bin uIndex of the cache of the CPU
+ * that runs the calling thread, and store it in *poChunk. Return
+ * CPU_DONE if so, CPU_REFUSED if the bin is empty, or CPU_NONE if
+ * the thread cannot use the CPU caches.
+ */
+static enum CpuResult HeapMgr_popCpu(size_t uIndex, Chunk_T *poChunk)
+{
+   struct rseq *psRseq = HeapMgr_getRseq();
+   struct HeapMgrCpuCache *psCpu; /* the cache of the CPU */
+   unsigned int uiCpu; /* the CPU that the sequence must run on */
+   Chunk_T oChunk = NULL;
+   int iResult;
+
+   do
+   {
+      psCpu = HeapMgr_getCpuCache(psRseq, &uiCpu);
+      if (psCpu == NULL)
+         return CPU_NONE;
+
+      /* As in HeapMgr_pushCpu(), but load the chunk in the last
+         full slot of the bin, and commit by storing the new count. */
+      __asm__ __volatile__ (
+         ".pushsection __rseq_cs, \"aw\"\n\t"
+         ".balign 32\n\t"
+         "3:\n\t"
+         ".long 0, 0\n\t"
+         ".quad 1f, 2f - 1f, 4f\n\t"
+         ".popsection\n\t"
+         "leaq 3b(%%rip), %%rax\n\t"
+         "movq %%rax, %c[csoff](%[rseq])\n\t"
+         "1:\n\t"
+         "cmpl %[cpu], %c[cpuoff](%[rseq])\n\t"
+         "jnz 4f\n\t"
+         "movq (%[count]), %%rcx\n\t"
+         "testq %%rcx, %%rcx\n\t"
+         "jz 5f\n\t"
+         "movq -8(%[slots], %%rcx, 8), %[chunk]\n\t"
+         "decq %%rcx\n\t"
+         "movq %%rcx, (%[count])\n\t"
+         "2:\n\t"
+         "movl %[done], %[result]\n\t"
+         "jmp 6f\n\t"
+         ".long %c[sig]\n\t"
+         "4:\n\t"
+         "movl %[aborted], %[result]\n\t"
+         "jmp 6f\n\t"
+         "5:\n\t"
+         "movl %[refused], %[result]\n\t"
+         "6:\n\t"
+         : [result] "=&r" (iResult),
+           [chunk] "+&r" (oChunk)
+         : [rseq] "r" (psRseq),
+           [cpu] "r" (uiCpu),
+           [count] "r" (&psCpu->auCounts[uIndex]),
+           [slots] "r" (psCpu->aaoSlots[uIndex]),
+           [csoff] "i" (offsetof(struct rseq, rseq_cs)),
+           [cpuoff] "i" (offsetof(struct rseq, cpu_id)),
+           [sig] "i" (RSEQ_SIG),
+           [done] "i" (CPU_DONE),
+           [aborted] "i" (CPU_ABORTED),
+           [refused] "i" (CPU_REFUSED)
+         : "rax", "rcx", "memory", "cc");
+   } while (iResult == CPU_ABORTED);
+
+   *poChunk = oChunk;
+   return (enum CpuResult)iResult;
+}
+
+/* Put oChunk in bin uIndex of the cache of the CPU that runs the
+ * calling thread, first giving a few chunks back to the heap if the
+ * bin is full. Return FALSE if the thread cannot use the CPU caches.
+ */
+static int HeapMgr_cacheOnCpu(size_t uIndex, Chunk_T oChunk)
+{
+   void *apv[CACHE_BATCH]; /* the payloads of the chunks to give back */
+   Chunk_T oOld = NULL;
+   enum CpuResult eResult;
+   size_t i;
+
+   for (;;)
+   {
+      eResult = HeapMgr_pushCpu(uIndex, oChunk);
+      if (eResult != CPU_REFUSED)
+         return eResult == CPU_DONE;
+
+      /* the thread may move to another CPU in between; any chunks
+         will do */
+      for (i = 0; i < (size_t)CACHE_BATCH; i++)
+      {
+         if (HeapMgr_popCpu(uIndex, &oOld) != CPU_DONE)
+            break;
+         apv[i] = Chunk_toPayload(oOld);
+      }
+      HeapMgr_freeBatch(apv, i);
+   }
+}
+
+/* Make the caches of the CPUs, if the C library registered the
+ * calling thread for restartable sequences.
+ */
+static void HeapMgr_initCpuCaches(void)
+{
+   long lCpuCount; /* the number of CPUs that the system may have */
+   void *pv;
+
+   if ((__rseq_size == 0) ||
+       ((int)HeapMgr_getRseq()->cpu_id < 0))
+      return;
+
+   lCpuCount = sysconf(_SC_NPROCESSORS_CONF);
+   if (lCpuCount <= 0)
+      return;
+   pv = mmap(NULL, (size_t)lCpuCount * sizeof(struct HeapMgrCpuCache),
+             PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+   if (pv == MAP_FAILED)
+      return;
+
+   uCpuCacheCount = (size_t)lCpuCount;
+   psCpuCaches = (struct HeapMgrCpuCache*)pv;
+}
+#endif
+
+#ifdef HEAPMGR_PAGES
+/* Return the pages of the calling thread, arranging for them to be
+ * given up when the thread exits.
+ */
+static struct HeapMgrPages *HeapMgr_getPages(void)
+{
+   if (! sPages.iRegistered)
+   {
+      sPages.iRegistered = TRUE;
+      (void)pthread_setspecific(iCacheKey, &sPages);
+   }
+   return &sPages;
+}
+
+/* Return the page that holds oChunk. */
+static struct HeapMgrPage *HeapMgr_getPage(Chunk_T oChunk)
+{
+   size_t uOffset; /* the offset of oChunk in the page arena */
+
+   uOffset = (size_t)((char*)oChunk - pcPageArena);
+   return (struct HeapMgrPage*)
+      (pcPageArena + uOffset - uOffset % (size_t)PAGE_BYTES);
+}
+
+/* Return a page for chunks of uUnits units, owned by psPages, or
+ * NULL if the page arena is used up.
+ */
+static struct HeapMgrPage *HeapMgr_newPage(struct HeapMgrPages *psPages,
+                                           size_t uUnits)
+{
+   struct HeapMgrPage *psPage = NULL;
+   size_t uUnitBytes; /* bytes per unit */
+
+   if (pcPageArena == NULL)
+      return NULL;
+
+   HeapMgr_acquire(&sPageLock);
+   if (psFreePages != NULL)
+   {
+      psPage = psFreePages;
+      psFreePages = psPage->psNext;
+   }
+   else if (uPagesCarved < (size_t)(PAGE_ARENA_BYTES / PAGE_BYTES))
+   {
+      psPage = (struct HeapMgrPage*)
+         (pcPageArena + uPagesCarved * (size_t)PAGE_BYTES);
+      uPagesCarved++;
+   }
+   HeapMgr_release(&sPageLock);
+   if (psPage == NULL)
+      return NULL;
+
+   /* the chunks start past the state where their payloads are
+      aligned to a unit */
+   uUnitBytes = Chunk_unitsToBytes(1);
+   psPage->psOwner = psPages;
+   psPage->oRemoteFree = NULL;
+   psPage->oLocalFree = NULL;
+   psPage->oFresh = (Chunk_T)((char*)psPage +
+      ((sizeof(struct HeapMgrPage) + uUnitBytes - 1) / uUnitBytes)
+      * uUnitBytes + Chunk_getStartOffset());
+   psPage->uUnits = uUnits;
+   psPage->uInUse = 0;
+   psPage->psNext = NULL;
+   return psPage;
+}
+
+/* Give psPage, none of whose chunks are in use, back to the page
+ * arena.
+ */
+static void HeapMgr_releasePage(struct HeapMgrPage *psPage)
+{
+   assert(psPage->uInUse == 0);
+
+   HeapMgr_acquire(&sPageLock);
+   psPage->psNext = psFreePages;
+   psFreePages = psPage;
+   HeapMgr_release(&sPageLock);
+}
+
+/* Take the chunks that other threads freed to psPage, which the
+ * calling thread owns, over into its local free list, with one
+ * atomic exchange.
+ */
+static void HeapMgr_drainPage(struct HeapMgrPage *psPage)
+{
+   Chunk_T oList = NULL; /* the chunks taken over */
+   Chunk_T oNext = NULL;
+
+   oList = (Chunk_T)__sync_lock_test_and_set(&psPage->oRemoteFree,
+                                             (Chunk_T)NULL);
+   for (; oList != NULL; oList = oNext)
+   {
+      oNext = Chunk_getNextInList(oList);
+      Chunk_setNextInList(oList, psPage->oLocalFree);
+      psPage->oLocalFree = oList;
+      psPage->uInUse--;
+   }
+}
+
+/* Take psPage, which the calling thread has just come to own, into
+ * its pages, or give it back to the arena if none of its chunks are
+ * in use.
+ */
+static void HeapMgr_adoptPage(struct HeapMgrPage *psPage)
+{
+   struct HeapMgrPages *psPages = HeapMgr_getPages();
+
+   HeapMgr_drainPage(psPage);
+   if (psPage->uInUse == 0)
+   {
+      HeapMgr_releasePage(psPage);
+      return;
+   }
+   psPage->psNext = psPages->apsPages[psPage->uUnits];
+   psPages->apsPages[psPage->uUnits] = psPage;
+}
+
+/* Give up the pages of pv, the pages of a thread that is exiting.
+ * Pages with chunks still in use stay behind for the first thread
+ * that frees one of those chunks to adopt.
+ */
+static void HeapMgr_abandonPages(void *pv)
+{
+   struct HeapMgrPages *psPages = (struct HeapMgrPages*)pv;
+   struct HeapMgrPage *psPage = NULL;
+   struct HeapMgrPage *psNext = NULL;
+   size_t uIndex;
+
+   for (uIndex = 0; uIndex < (size_t)CACHE_BIN_COUNT; uIndex++)
+   {
+      for (psPage = psPages->apsPages[uIndex];
+           psPage != NULL;
+           psPage = psNext)
+      {
+         psNext = psPage->psNext;
+         for (;;)
+         {
+            HeapMgr_drainPage(psPage);
+            if (psPage->uInUse == 0)
+            {
+               HeapMgr_releasePage(psPage);
+               break;
+            }
+
+            /* A thread that freed a chunk to the page just now may
+               have seen the page still owned. At least one of the
+               two sees the other's store after the fence, and the
+               page is drained again by whoever wins it. */
+            psPage->psOwner = NULL;
+            __sync_synchronize();
+            if ((psPage->oRemoteFree == NULL) ||
+                (! __sync_bool_compare_and_swap(&psPage->psOwner,
+                      (struct HeapMgrPages*)NULL, psPages)))
+               break;
+         }
+      }
+      psPages->apsPages[uIndex] = NULL;
+   }
+
+   /* a later destructor may allocate again */
+   psPages->iRegistered = FALSE;
+}
+
+/* Return a chunk of uUnits units from a page of the calling thread,
+ * or NULL if the page arena is used up.
+ */
+static Chunk_T HeapMgr_mallocInPage(size_t uUnits)
+{
+   struct HeapMgrPages *psPages = HeapMgr_getPages();
+   struct HeapMgrPage *psPage = NULL;
+   struct HeapMgrPage *psPrev = NULL;
+   Chunk_T oChunk = NULL;
+   size_t uBytes; /* bytes in a chunk */
+
+   uBytes = Chunk_unitsToBytes(uUnits);
+
+   /* (1) find a page with a free chunk, or room for a new one */
+   for (psPage = psPages->apsPages[uUnits];
+        psPage != NULL;
+        psPrev = psPage, psPage = psPage->psNext)
+   {
+      if ((psPage->oLocalFree == NULL) && (psPage->oRemoteFree != NULL))
+         HeapMgr_drainPage(psPage);
+      if (psPage->oLocalFree != NULL)
+      {
+         oChunk = psPage->oLocalFree;
+         psPage->oLocalFree = Chunk_getNextInList(oChunk);
+         break;
+      }
+      if ((char*)psPage->oFresh + uBytes
+          <= (char*)psPage + PAGE_BYTES)
+         break;
+   }
+
+   /* (2) if there is none, start a new page */
+   if (psPage == NULL)
+   {
+      psPage = HeapMgr_newPage(psPages, uUnits);
+      if (psPage == NULL)
+         return NULL;
+      psPage->psNext = psPages->apsPages[uUnits];
+      psPages->apsPages[uUnits] = psPage;
+   }
+   /* or else allocate from the page first next time */
+   else if (psPrev != NULL)
+   {
+      psPrev->psNext = psPage->psNext;
+      psPage->psNext = psPages->apsPages[uUnits];
+      psPages->apsPages[uUnits] = psPage;
+   }
+
+   /* (3) carve a new chunk if no free one was found */
+   if (oChunk == NULL)
+   {
+      oChunk = psPage->oFresh;
+      psPage->oFresh = (Chunk_T)((char*)oChunk + uBytes);
+      Chunk_setStatus(oChunk, CHUNK_INUSE);
+      Chunk_setUnits(oChunk, uUnits);
+   }
+
+   psPage->uInUse++;
+   return oChunk;
+}
+
+/* Free oChunk, a chunk in a page, to its page. */
+static void HeapMgr_freeInPage(Chunk_T oChunk)
+{
+   struct HeapMgrPage *psPage = HeapMgr_getPage(oChunk);
+   struct HeapMgrPage **ppsPage = NULL; /* the link to psPage */
+   Chunk_T oHead = NULL;
+
+   assert(Chunk_getUnits(oChunk) == psPage->uUnits);
+
+   /* (1) the owner frees to the page without atomic instructions,
+      giving the page back to the arena once it is empty, unless it
+      is the one to allocate from first */
+   if (psPage->psOwner == &sPages)
+   {
+      Chunk_setNextInList(oChunk, psPage->oLocalFree);
+      psPage->oLocalFree = oChunk;
+      psPage->uInUse--;
+      if ((psPage->uInUse == 0) &&
+          (sPages.apsPages[psPage->uUnits] != psPage))
+      {
+         for (ppsPage = &sPages.apsPages[psPage->uUnits];
+              *ppsPage != psPage;
+              ppsPage = &(*ppsPage)->psNext)
+            ;
+         *ppsPage = psPage->psNext;
+         HeapMgr_releasePage(psPage);
+      }
+      return;
+   }
+
+   /* (2) any other thread pushes the chunk onto the remote free list
+      of the page with one CAS */
+   do
+   {
+      oHead = psPage->oRemoteFree;
+      Chunk_setNextInList(oChunk, oHead);
+   } while (__sync_val_compare_and_swap(&psPage->oRemoteFree,
+                                        oHead, oChunk) != oHead);
+
+   /* (3) the owner of the page may have exited; if so, the first
+      thread to free to the page after that adopts it */
+   if ((psPage->psOwner == NULL) &&
+       __sync_bool_compare_and_swap(&psPage->psOwner,
+                                    (struct HeapMgrPages*)NULL,
+                                    HeapMgr_getPages()))
+      HeapMgr_adoptPage(psPage);
+}
+
+/* Reserve the page arena. */
+static void HeapMgr_initPages(void)
+{
+   void *pv;
+
+   pv = mmap(NULL, (size_t)PAGE_ARENA_BYTES, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if (pv != MAP_FAILED)
+      pcPageArena = (char*)pv;
+}
+#endif
+
+/* Return TRUE if oChunk lies in a page of a thread, in thread-owned
+ * pages mode, or FALSE otherwise.
+ */
+static int HeapMgr_isInPage(Chunk_T oChunk)
+{
+#ifdef HEAPMGR_PAGES
+   return (pcPageArena != NULL) &&
+          ((char*)oChunk >= pcPageArena) &&
+          ((char*)oChunk < pcPageArena + PAGE_ARENA_BYTES);
+#else
+   (void)oChunk;
+   return FALSE;
+#endif
+}
+
+/* If oChunk, an in use chunk that its client freed, lies in a page
+ * of a thread, free it to its page and return TRUE. Return FALSE
+ * otherwise.
+ */
+static int HeapMgr_freeIfInPage(Chunk_T oChunk)
+{
+#ifdef HEAPMGR_PAGES
+   if (! HeapMgr_isInPage(oChunk))
+      return FALSE;
+   HeapMgr_freeInPage(oChunk);
+   return TRUE;
+#else
+   (void)oChunk;
+   return FALSE;
+#endif
+}
+
+/* Return the number of bytes in a mapping that holds a chunk with
+ * room for uBytes payload bytes, uOffset bytes past the start of the
+ * mapping, or 0 if there is no such number.
+ */
+static size_t HeapMgr_getMapBytes(size_t uBytes, size_t uOffset)
+{
+   size_t uPageBytes; /* bytes per page of memory */
+   size_t uUnitBytes; /* bytes per unit */
+
+   uPageBytes = (size_t)sysconf(_SC_PAGESIZE);
+   uUnitBytes = Chunk_unitsToBytes(1);
+   if (uBytes > ((size_t)-1) / 2 - uOffset - uPageBytes
+                - 3 * uUnitBytes)
+      return 0;
+   uBytes = uOffset + Chunk_unitsToBytes(Chunk_bytesToUnits(uBytes));
+   uBytes = ((uBytes + uPageBytes - 1) / uPageBytes) * uPageBytes;
+
+   /* the chunk must not outgrow its header */
+   if (uBytes / uUnitBytes > Chunk_getMaxUnits())
+      return 0;
+   return uBytes;
+}
+
+/* Return the start of the mapping of oChunk, an in use chunk with a
+ * mapping of its own. The chunk starts in the first page of it.
+ */
+static char *HeapMgr_getMapStart(Chunk_T oChunk)
+{
+   size_t uPageBytes; /* bytes per page of memory */
+
+   uPageBytes = (size_t)sysconf(_SC_PAGESIZE);
+   return (char*)oChunk - (size_t)oChunk % uPageBytes;
+}
+
+/* Return the number of bytes in the mapping of oChunk, an in use
+ * chunk with a mapping of its own, which ends in its last page.
+ */
+static size_t HeapMgr_getMapLength(Chunk_T oChunk)
+{
+   size_t uPageBytes; /* bytes per page of memory */
+   size_t uBytes; /* bytes from the start of the mapping */
+
+   uPageBytes = (size_t)sysconf(_SC_PAGESIZE);
+   uBytes = (size_t)((char*)oChunk - HeapMgr_getMapStart(oChunk))
+            + Chunk_unitsToBytes(Chunk_getUnits(oChunk));
+   return ((uBytes + uPageBytes - 1) / uPageBytes) * uPageBytes;
+}
+
+/* Return TRUE if oChunk, an in use chunk of the default heap, has a
+ * mapping of its own, or FALSE otherwise. The heap never grows over
+ * a mapping, so chunks outside of it are mapped.
+ */
+static int HeapMgr_isMapped(Chunk_T oChunk)
+{
+   return (oChunk < oDefaultHeap.oHeapStart) ||
+          (oChunk >= oDefaultHeap.oHeapEnd);
+}
+
+/* Return an in use chunk with room for uBytes payload bytes, in a
+ * mapping of its own, or NULL if the request cannot be satisfied.
+ * Its payload is zero, as the OS gave it.
+ */
+static Chunk_T HeapMgr_mapChunk(size_t uBytes)
+{
+   size_t uMapBytes; /* bytes in the mapping */
+   void *pv;
+
+   size_t uOffset; /* bytes from the mapping to the chunk */
+   Chunk_T oChunk = NULL;
+
+   uOffset = Chunk_getStartOffset();
+   uMapBytes = HeapMgr_getMapBytes(uBytes, uOffset);
+   if (uMapBytes == 0)
+      return NULL;
+   pv = mmap(NULL, uMapBytes, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (pv == MAP_FAILED)
+      return NULL;
+
+   /* the chunk spans the rest of the mapping past where its payload
+      is aligned */
+   oChunk = (Chunk_T)((char*)pv + uOffset);
+   Chunk_setStatus(oChunk, CHUNK_INUSE);
+   Chunk_setUnits(oChunk,
+                  (uMapBytes - uOffset) / Chunk_unitsToBytes(1));
+   return oChunk;
+}
+
+/* Return an in use chunk with room for uBytes payload bytes, whose
+ * payload is a multiple of uAlignment, a power of two, in a mapping
+ * of its own, or NULL if the request cannot be satisfied. Its payload
+ * is zero, as the OS gave it. The mapping is made uAlignment bytes
+ * too big, and the pages in front of the page where the chunk starts
+ * and past its end go back, so that the chunk starts in the first
+ * page of the mapping, as one from HeapMgr_mapChunk() does.
+ */
+static Chunk_T HeapMgr_mapAlignedChunk(size_t uAlignment,
+                                       size_t uBytes)
+{
+   size_t uPageBytes; /* bytes per page of memory */
+   size_t uOverBytes; /* bytes in the mapping with room to align */
+   size_t uMapBytes; /* bytes in the part of it that is kept */
+   size_t uOffset; /* bytes from the part that is kept to the chunk */
+   char *pcOver; /* the start of the mapping */
+   char *pcStart; /* the start of the part that is kept */
+   char *pcPayload; /* the aligned payload */
+   void *pv;
+   Chunk_T oChunk = NULL;
+
+   /* the chunk starts less than a page into the part that is kept,
+      which starts less than uAlignment bytes into the mapping */
+   uPageBytes = (size_t)sysconf(_SC_PAGESIZE);
+   uOverBytes = HeapMgr_getMapBytes(uBytes, uPageBytes);
+   if ((uOverBytes == 0) || (uOverBytes > ((size_t)-1) - uAlignment))
+      return NULL;
+   uOverBytes += uAlignment;
+   pv = mmap(NULL, uOverBytes, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (pv == MAP_FAILED)
+      return NULL;
+   pcOver = (char*)pv;
+
+   /* the first aligned payload with room for a header in front */
+   pcPayload = (char*)Chunk_toPayload((Chunk_T)pcOver);
+   pcPayload += (uAlignment - (size_t)pcPayload % uAlignment)
+                % uAlignment;
+   oChunk = Chunk_fromPayload(pcPayload);
+   pcStart = (char*)oChunk - (size_t)oChunk % uPageBytes;
+   uOffset = (size_t)((char*)oChunk - pcStart);
+   uMapBytes = HeapMgr_getMapBytes(uBytes, uOffset);
+   assert((uMapBytes != 0) &&
+          (pcStart + uMapBytes <= pcOver + uOverBytes));
+
+   /* give back the pages around the part that is kept */
+   if (pcStart > pcOver)
+      (void)munmap(pcOver, (size_t)(pcStart - pcOver));
+   if (pcStart + uMapBytes < pcOver + uOverBytes)
+      (void)munmap(pcStart + uMapBytes,
+                   (size_t)(pcOver + uOverBytes
+                            - (pcStart + uMapBytes)));
+
+   Chunk_setStatus(oChunk, CHUNK_INUSE);
+   Chunk_setUnits(oChunk,
+                  (uMapBytes - uOffset) / Chunk_unitsToBytes(1));
+   return oChunk;
+}
+
+/* If oChunk, an in use chunk of the default heap that its client
+ * freed, has a mapping of its own, give the mapping back to the OS
+ * and return TRUE. Return FALSE otherwise.
+ */
+static int HeapMgr_unmapIfMapped(Chunk_T oChunk)
+{
+   if (! HeapMgr_isMapped(oChunk))
+      return FALSE;
+   (void)munmap(HeapMgr_getMapStart(oChunk),
+                HeapMgr_getMapLength(oChunk));
+   return TRUE;
+}
+
+/* Move the region pv of the default heap, which holds uOldBytes
+ * bytes, to a new one with room for uBytes bytes. Return the new
+ * region, or NULL, leaving pv as it was, if the request cannot be
+ * satisfied.
+ */
+static void *HeapMgr_moveChunk(void *pv, size_t uOldBytes,
+                               size_t uBytes)
+{
+   void *pvNew = NULL;
+
+   pvNew = HeapMgr_malloc(uBytes);
+   if (pvNew == NULL)
+      return NULL;
+   memcpy(pvNew, pv, uOldBytes < uBytes ? uOldBytes : uBytes);
+   HeapMgr_free(pv);
+   return pvNew;
+}
+
+/* Resize oChunk, an in use chunk of the default heap with a mapping
+ * of its own, to hold uBytes payload bytes. The OS moves the pages
+ * of the mapping, if it must move it, without copying them. Chunks
+ * that shrink below the mmap threshold move into the heap. Return
+ * the new payload, or NULL, leaving oChunk as it was, if the request
+ * cannot be satisfied.
+ */
+static void *HeapMgr_remapChunk(Chunk_T oChunk, size_t uBytes)
+{
+   size_t uMapBytes; /* bytes in the new mapping */
+   size_t uOffset; /* bytes from the mapping to the chunk */
+   char *pcStart; /* the start of the mapping */
+   void *pv;
+
+   if (uBytes < uMmapThreshold)
+      return HeapMgr_moveChunk(Chunk_toPayload(oChunk),
+         Chunk_unitsToPayloadBytes(Chunk_getUnits(oChunk)), uBytes);
+
+   /* the chunk keeps its place in the first page of the mapping */
+   pcStart = HeapMgr_getMapStart(oChunk);
+   uOffset = (size_t)((char*)oChunk - pcStart);
+   uMapBytes = HeapMgr_getMapBytes(uBytes, uOffset);
+   if (uMapBytes == 0)
+      return NULL;
+   pv = mremap(pcStart, HeapMgr_getMapLength(oChunk), uMapBytes,
+               MREMAP_MAYMOVE);
+   if (pv == MAP_FAILED)
+      return NULL;
+   oChunk = (Chunk_T)((char*)pv + uOffset);
+   Chunk_setUnits(oChunk,
+                  (uMapBytes - uOffset) / Chunk_unitsToBytes(1));
+   return Chunk_toPayload(oChunk);
+}
+
+#ifndef HEAPMGR_THREADS
+/* Free the chunks of the fast bins to the bins of the default heap,
+ * a batch at a time, so that neighbors coalesce before they reach
+ * the bins.
+ */
+static void HeapMgr_consolidate(void)
+{
+   void *apv[FAST_BATCH]; /* the payloads of a batch */
+   size_t uIndex;
+   size_t uCount = 0; /* chunks in the batch so far */
+   Chunk_T oChunk = NULL;
+
+   for (uIndex = 0; uIndex < (size_t)FAST_BIN_COUNT; uIndex++)
+      while (aoFastBins[uIndex] != NULL)
+      {
+         oChunk = aoFastBins[uIndex];
+         aoFastBins[uIndex] = Chunk_getNextInList(oChunk);
+         uFastBytes -= Chunk_unitsToBytes(uIndex);
+         apv[uCount++] = Chunk_toPayload(oChunk);
+         if (uCount == (size_t)FAST_BATCH)
+         {
+            HeapMgr_freeBatch(apv, uCount);
+            uCount = 0;
+         }
+      }
+   HeapMgr_freeBatch(apv, uCount);
+}
+#endif
+
+#if ! defined(HEAPMGR_PAGES)
+/* Put oChunk, an in use chunk of the default heap that its client
+ * freed, in bin uUnits of the cache of the CPU that runs the calling
+ * thread, or else of the cache of the thread, in thread-safe mode, or
+ * in fast bin uUnits otherwise. oChunk holds at least uUnits units
+ * and fewer than uUnits + SPLIT_THRESHOLD, as every chunk cut for
+ * uUnits units does. Return TRUE if so, or FALSE if uUnits is too big
+ * to cache. The header of oChunk is not read, so a client that knows
+ * the size of a chunk can free it without loading the header.
+ */
+static int HeapMgr_cacheUnits(Chunk_T oChunk, size_t uUnits)
+{
+   assert(Chunk_getStatus(oChunk) == CHUNK_INUSE);
+   assert((Chunk_getUnits(oChunk) >= uUnits) &&
+          (Chunk_getUnits(oChunk) - uUnits < SPLIT_THRESHOLD));
+
+#ifdef HEAPMGR_THREADS
+   if (uUnits >= (size_t)CACHE_BIN_COUNT)
+      return FALSE;
+
+#ifdef HEAPMGR_RSEQ
+   if (HeapMgr_cacheOnCpu(uUnits, oChunk))
+      return TRUE;
+#endif
+   HeapMgr_pushThread(uUnits, oChunk);
+   return TRUE;
+#else
+   if (uUnits >= (size_t)FAST_BIN_COUNT)
+      return FALSE;
+
+   Chunk_setNextInList(oChunk, aoFastBins[uUnits]);
+   aoFastBins[uUnits] = oChunk;
+   uFastBytes += Chunk_unitsToBytes(uUnits);
+
+   /* too much memory kept out of the bins fragments the heap */
+   if (uFastBytes > (size_t)FAST_BYTES_MAX)
+      HeapMgr_consolidate();
+   return TRUE;
+#endif
+}
+#endif
+
+/* Put oChunk, an in use chunk of the default heap that its client
+ * freed, in the cache of the CPU that runs the calling thread, or
+ * else in the cache of the thread, in thread-safe mode, or free it
+ * to its page in thread-owned pages mode, or put it in a fast bin
+ * otherwise. Return TRUE if so, or FALSE if it is too big to cache
+ * or lies in no page.
+ */
+static int HeapMgr_cacheChunk(Chunk_T oChunk)
+{
+#if defined(HEAPMGR_PAGES)
+   return HeapMgr_freeIfInPage(oChunk);
+#elif defined(HEAPMGR_THREADS)
+   assert(Chunk_getStatus(oChunk) == CHUNK_INUSE);
+
+   return HeapMgr_cacheUnits(oChunk, Chunk_getUnits(oChunk));
+#else
+   size_t uUnits; /* units in oChunk, and its fast bin */
+   Chunk_T oNext = NULL; /* next chunk in memory */
+
+   assert(Chunk_getStatus(oChunk) == CHUNK_INUSE);
+
+   uUnits = Chunk_getUnits(oChunk);
+   if (uUnits >= (size_t)FAST_BIN_COUNT)
+      return FALSE;
+
+   /* a chunk at the free end of the heap while the fast bins hold
+      others goes back at once, and they with it, so that the heap
+      can shrink once its client frees all of it */
+   oNext = Chunk_getNextInMem(oChunk, oDefaultHeap.oHeapEnd);
+   if ((uFastBytes != 0) &&
+       ((oNext == NULL) ||
+        ((Chunk_getStatus(oNext) == CHUNK_FREE) &&
+         (Chunk_getNextInMem(oNext, oDefaultHeap.oHeapEnd) == NULL))))
+   {
+      HeapMgr_consolidate();
+      return FALSE;
+   }
+
+   return HeapMgr_cacheUnits(oChunk, uUnits);
+#endif
+}
+
+/* Return an in use chunk of uUnits units of the default heap from
+ * the cache of the CPU that runs the calling thread, or else from
+ * the cache of the thread, in thread-safe mode, refilling the cache
+ * from the bins of the heap if it has none, or from a page of the
+ * thread in thread-owned pages mode, or from a fast bin otherwise.
+ * Return NULL if uUnits is too big to cache or no memory is left,
+ * or if the fast bin is empty.
+ */
+static Chunk_T HeapMgr_getCachedChunk(size_t uUnits)
+{
+#if defined(HEAPMGR_PAGES)
+   if (uUnits >= (size_t)CACHE_BIN_COUNT)
+      return NULL;
+   return HeapMgr_mallocInPage(uUnits);
+#elif defined(HEAPMGR_THREADS)
+   void *apv[CACHE_BATCH]; /* the payloads of a refill */
+   Chunk_T oChunk = NULL;
+   size_t uCount;
+   size_t i;
+#ifdef HEAPMGR_RSEQ
+   enum CpuResult eResult;
+#endif
+
+   if (uUnits >= (size_t)CACHE_BIN_COUNT)
+      return NULL;
+
+#ifdef HEAPMGR_RSEQ
+   eResult = HeapMgr_popCpu(uUnits, &oChunk);
+   if (eResult == CPU_DONE)
+      return oChunk;
+   if (eResult == CPU_NONE)
+      oChunk = HeapMgr_popThread(uUnits);
+#else
+   oChunk = HeapMgr_popThread(uUnits);
+#endif
+   if (oChunk != NULL)
+      return oChunk;
+
+   /* carve a few chunks out of the heap at once, keeping all but
+      the first; the last one may hold a remainder, and so belong in
+      another bin, or in none */
+   uCount = HeapMgr_mallocBatch(Chunk_unitsToPayloadBytes(uUnits),
+                                (size_t)CACHE_BATCH, apv);
+   if (uCount == 0)
+      return NULL;
+   for (i = 1; i < uCount; i++)
+      if (! HeapMgr_cacheChunk(Chunk_fromPayload(apv[i])))
+         HeapMgr_freeIn(&oDefaultHeap, apv[i]);
+   return Chunk_fromPayload(apv[0]);
+#else
+   Chunk_T oChunk = NULL;
+
+   if (uUnits >= (size_t)FAST_BIN_COUNT)
+      return NULL;
+
+   oChunk = aoFastBins[uUnits];
+   if (oChunk == NULL)
+      return NULL;
+   aoFastBins[uUnits] = Chunk_getNextInList(oChunk);
+   uFastBytes -= Chunk_unitsToBytes(uUnits);
+   return oChunk;
+#endif
+}
+
+/* Acquire the lock of the slabs of class uClass, in thread-safe
+ * mode.
+ */
+static void HeapMgr_lockSlabs(size_t uClass)
+{
+#ifdef HEAPMGR_THREADS
+   HeapMgr_acquire(&asSlabLocks[uClass]);
+#else
+   (void)uClass;
+#endif
+}
+
+/* Release the lock of the slabs of class uClass, in thread-safe
+ * mode.
+ */
+static void HeapMgr_unlockSlabs(size_t uClass)
+{
+#ifdef HEAPMGR_THREADS
+   HeapMgr_release(&asSlabLocks[uClass]);
+#else
+   (void)uClass;
+#endif
+}
+
+/* Reserve the map of the slabs of the default heap, whose first
+ * chunk starts at oHeapStart.
+ */
+static void HeapMgr_initSlabs(Chunk_T oHeapStart)
+{
+   void *pv;
+
+   pv = mmap(NULL, (size_t)SLAB_MAP_BYTES, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if (pv == MAP_FAILED)
+      return;
+   uSlabBase = (size_t)oHeapStart / (size_t)SLAB_BYTES;
+   pulSlabMap = (volatile unsigned long*)pv;
+}
+
+/* Return the index of the bit of the slab map that covers pv, or
+ * (size_t)-1 if none does.
+ */
+static size_t HeapMgr_getSlabPage(void *pv)
+{
+   size_t uPage;
+
+   uPage = (size_t)pv / (size_t)SLAB_BYTES - uSlabBase;
+   if (uPage >= (size_t)SLAB_MAP_BYTES * CHAR_BIT)
+      return (size_t)-1;
+   return uPage;
+}
+
+/* Set the bit of the slab map that covers psSlab if iIsSlab, or clear
+ * it otherwise.
+ */
+static void HeapMgr_markSlab(struct HeapMgrSlab *psSlab, int iIsSlab)
+{
+   size_t uPage = HeapMgr_getSlabPage(psSlab);
+   volatile unsigned long *pulWord;
+   unsigned long ulBit;
+
+   assert(uPage != (size_t)-1);
+
+   pulWord = &pulSlabMap[uPage / (size_t)BIN_MAP_BITS];
+   ulBit = 1UL << (uPage % (size_t)BIN_MAP_BITS);
+#ifdef HEAPMGR_THREADS
+   /* the word covers slabs of other classes too */
+   if (iIsSlab)
+      (void)__sync_fetch_and_or(pulWord, ulBit);
+   else
+      (void)__sync_fetch_and_and(pulWord, ~ulBit);
+#else
+   if (iIsSlab)
+      *pulWord |= ulBit;
+   else
+      *pulWord &= ~ulBit;
+#endif
+}
+
+/* Return TRUE if pv, the address that a client got from the default
+ * heap, is of an object in a slab, or FALSE otherwise.
+ */
+static int HeapMgr_isInSlab(void *pv)
+{
+   size_t uPage;
+
+   if ((pulSlabMap == NULL) ||
+       ((Chunk_T)pv < oDefaultHeap.oHeapStart) ||
+       ((Chunk_T)pv >= oDefaultHeap.oHeapEnd))
+      return FALSE;
+   uPage = HeapMgr_getSlabPage(pv);
+   if (uPage == (size_t)-1)
+      return FALSE;
+   return (int)((pulSlabMap[uPage / (size_t)BIN_MAP_BITS]
+                 >> (uPage % (size_t)BIN_MAP_BITS)) & 1UL);
+}
+
+/* Return the slab that holds pv, an object in a slab. */
+static struct HeapMgrSlab *HeapMgr_getSlab(void *pv)
+{
+   return (struct HeapMgrSlab*)
+      ((char*)pv - (size_t)pv % (size_t)SLAB_BYTES);
+}
+
+/* Return the number of bytes that pv, an object in a slab, holds. */
+static size_t HeapMgr_getSlabBytes(void *pv)
+{
+   return Chunk_unitsToBytes(HeapMgr_getSlab(pv)->uClass + 1);
+}
+
+/* Return a new, empty slab for objects of class uClass, made of a
+ * chunk of the default heap, or NULL if no memory is left, the slab
+ * map does not cover the chunk, or the chunk has a mapping of its
+ * own.
+ */
+static struct HeapMgrSlab *HeapMgr_newSlab(size_t uClass)
+{
+   struct HeapMgrSlab *psSlab = NULL;
+   size_t uUnitBytes; /* bytes per unit */
+   size_t uHeaderBytes; /* bytes in front of the objects */
+   size_t uSlabBytes; /* bytes in the payload of the slab */
+
+   /* the chunk spans SLAB_BYTES with its header and footer, so that
+      the payload of the chunk after it is aligned for the next slab
+      as well */
+   uUnitBytes = Chunk_unitsToBytes(1);
+   uSlabBytes = Chunk_unitsToPayloadBytes((size_t)SLAB_BYTES
+                                          / uUnitBytes);
+   psSlab = (struct HeapMgrSlab*)
+      HeapMgr_memalign((size_t)SLAB_BYTES, uSlabBytes);
+   if (psSlab == NULL)
+      return NULL;
+   if ((pulSlabMap == NULL) ||
+       (HeapMgr_getSlabPage(psSlab) == (size_t)-1) ||
+       HeapMgr_isMapped(Chunk_fromPayload(psSlab)))
+   {
+      HeapMgr_free(psSlab);
+      return NULL;
+   }
+
+   /* the objects start at the first unit boundary past the state */
+   uHeaderBytes = ((sizeof(struct HeapMgrSlab) + uUnitBytes - 1)
+                   / uUnitBytes) * uUnitBytes;
+   psSlab->pvFree = NULL;
+   psSlab->pcFresh = (char*)psSlab + uHeaderBytes;
+   psSlab->uClass = uClass;
+   psSlab->uInUse = 0;
+   psSlab->uCapacity = (uSlabBytes - uHeaderBytes)
+                       / Chunk_unitsToBytes(uClass + 1);
+   psSlab->psNext = NULL;
+   psSlab->psPrev = NULL;
+
+   HeapMgr_markSlab(psSlab, TRUE);
+   return psSlab;
+}
+
+/* Add psSlab to the front of the slabs of its class with free
+ * objects. The lock of the class must be held.
+ */
+static void HeapMgr_addSlab(struct HeapMgrSlab *psSlab)
+{
+   size_t uClass = psSlab->uClass;
+
+   psSlab->psPrev = NULL;
+   psSlab->psNext = apsSlabs[uClass];
+   if (apsSlabs[uClass] != NULL)
+      apsSlabs[uClass]->psPrev = psSlab;
+   apsSlabs[uClass] = psSlab;
+}
+
+/* Remove psSlab from the slabs of its class with free objects. The
+ * lock of the class must be held.
+ */
+static void HeapMgr_removeSlab(struct HeapMgrSlab *psSlab)
+{
+   if (psSlab->psPrev == NULL)
+      apsSlabs[psSlab->uClass] = psSlab->psNext;
+   else
+      psSlab->psPrev->psNext = psSlab->psNext;
+   if (psSlab->psNext != NULL)
+      psSlab->psNext->psPrev = psSlab->psPrev;
+   psSlab->psNext = NULL;
+   psSlab->psPrev = NULL;
+}
+
+/* Take an object of class uClass out of the slabs of its class,
+ * making a new slab, without the lock, if none has a free object.
+ * The lock of the class must be held. Return the object, or NULL if
+ * no slab is left.
+ */
+static void *HeapMgr_takeFromSlab(size_t uClass)
+{
+   struct HeapMgrSlab *psSlab = NULL;
+   void *pv = NULL;
+
+   /* (1) the first slab of the class with a free object, or else a
+      new one */
+   psSlab = apsSlabs[uClass];
+   if (psSlab == NULL)
+   {
+      HeapMgr_unlockSlabs(uClass);
+      psSlab = HeapMgr_newSlab(uClass);
+      HeapMgr_lockSlabs(uClass);
+      if (psSlab == NULL)
+         return NULL;
+      HeapMgr_addSlab(psSlab);
+   }
+
+   /* (2) a freed object, or else one carved from the fresh part */
+   if (psSlab->pvFree != NULL)
+   {
+      pv = psSlab->pvFree;
+      psSlab->pvFree = *(void**)pv;
+   }
+   else
+   {
+      pv = psSlab->pcFresh;
+      psSlab->pcFresh += Chunk_unitsToBytes(uClass + 1);
+   }
+
+   /* (3) a full slab leaves the list until an object is freed */
+   psSlab->uInUse++;
+   if (psSlab->uInUse == psSlab->uCapacity)
+      HeapMgr_removeSlab(psSlab);
+   return pv;
+}
+
+/* Give pv, an object in a slab, back to its slab. The lock of its
+ * class must be held. An empty slab stays only while no other slab
+ * of its class has free objects; one that goes is put on *ppsEmpty,
+ * a list linked by psNext, for the caller to give back to the heap
+ * once the lock is released.
+ */
+static void HeapMgr_putInSlab(void *pv, struct HeapMgrSlab **ppsEmpty)
+{
+   struct HeapMgrSlab *psSlab = HeapMgr_getSlab(pv);
+   struct HeapMgrSlab *psEmpty = NULL; /* slab to give back */
+   size_t uClass = psSlab->uClass; /* the class of the object */
+
+   assert(psSlab->uInUse > 0);
+   *(void**)pv = psSlab->pvFree;
+   psSlab->pvFree = pv;
+
+   /* (1) a full slab rejoins the list, in front of an empty one that
+      then is no longer needed */
+   if (psSlab->uInUse == psSlab->uCapacity)
+   {
+      psEmpty = apsSlabs[uClass];
+      if ((psEmpty != NULL) && (psEmpty->uInUse == 0))
+         HeapMgr_removeSlab(psEmpty);
+      else
+         psEmpty = NULL;
+      HeapMgr_addSlab(psSlab);
+   }
+
+   /* (2) a slab that empties goes unless it is the only one left */
+   psSlab->uInUse--;
+   if ((psSlab->uInUse == 0) &&
+       ((apsSlabs[uClass] != psSlab) || (psSlab->psNext != NULL)))
+   {
+      HeapMgr_removeSlab(psSlab);
+      psEmpty = psSlab;
+   }
+
+   if (psEmpty != NULL)
+   {
+      psEmpty->psNext = *ppsEmpty;
+      *ppsEmpty = psEmpty;
+   }
+}
+
+/* Give the slabs of psEmpty, a list of empty slabs linked by psNext,
+ * back to the default heap.
+ */
+static void HeapMgr_freeSlabs(struct HeapMgrSlab *psEmpty)
+{
+   struct HeapMgrSlab *psNext = NULL;
+
+   for (; psEmpty != NULL; psEmpty = psNext)
+   {
+      psNext = psEmpty->psNext;
+      HeapMgr_markSlab(psEmpty, FALSE);
+      HeapMgr_freeIn(&oDefaultHeap, psEmpty);
+   }
+}
+
+#ifdef HEAPMGR_THREADS
+/* Arrange for the slab cache of the calling thread to be flushed
+ * when the thread exits. The default heap must be initialized.
+ */
+static void HeapMgr_registerSlabCache(void)
+{
+   if (! sSlabCache.iRegistered)
+   {
+      sSlabCache.iRegistered = TRUE;
+      (void)pthread_setspecific(iSlabCacheKey, &sSlabCache);
+   }
+}
+
+/* Take up to SLAB_CACHE_BATCH objects of class uClass out of its
+ * slabs and into the slab cache of the calling thread, under one hold
+ * of the lock of the class.
+ */
+static void HeapMgr_fillSlabCache(size_t uClass)
+{
+   void *pv = NULL;
+   size_t i;
+
+   HeapMgr_lockSlabs(uClass);
+   for (i = 0; i < (size_t)SLAB_CACHE_BATCH; i++)
+   {
+      pv = HeapMgr_takeFromSlab(uClass);
+      if (pv == NULL)
+         break;
+      *(void**)pv = sSlabCache.apvObjects[uClass];
+      sSlabCache.apvObjects[uClass] = pv;
+   }
+   sSlabCache.auCounts[uClass] += i;
+   HeapMgr_unlockSlabs(uClass);
+
+   /* a slab exists, so the heap is initialized */
+   if (i > 0)
+      HeapMgr_registerSlabCache();
+}
+
+/* Give uCount objects, or all of them if there are fewer, out of
+ * class uClass of *psCache back to their slabs, under one hold of
+ * the lock of the class.
+ */
+static void HeapMgr_flushSlabCache(struct HeapMgrSlabCache *psCache,
+                                   size_t uClass, size_t uCount)
+{
+   struct HeapMgrSlab *psEmpty = NULL; /* slabs to give back */
+   void *pv = NULL;
+   size_t i;
+
+   HeapMgr_lockSlabs(uClass);
+   for (i = 0; (i < uCount) && (psCache->apvObjects[uClass] != NULL);
+        i++)
+   {
+      pv = psCache->apvObjects[uClass];
+      psCache->apvObjects[uClass] = *(void**)pv;
+      HeapMgr_putInSlab(pv, &psEmpty);
+   }
+   psCache->auCounts[uClass] -= i;
+   HeapMgr_unlockSlabs(uClass);
+
+   HeapMgr_freeSlabs(psEmpty);
+}
+
+/* Flush all of pv, the slab cache of a thread that is exiting. */
+static void HeapMgr_flushSlabCaches(void *pv)
+{
+   struct HeapMgrSlabCache *psCache = (struct HeapMgrSlabCache*)pv;
+   size_t uClass;
+
+   for (uClass = 0; uClass < (size_t)SLAB_CLASS_COUNT; uClass++)
+      HeapMgr_flushSlabCache(psCache, uClass, (size_t)SLAB_CACHE_MAX);
+
+   /* a later destructor may fill it again */
+   psCache->iRegistered = FALSE;
+}
+#endif
+
+/* Return an object of uBytes bytes in a slab of the default heap, or
+ * NULL if uBytes is 0, is above the slab threshold or too big for any
+ * class, or if no slab is left. In thread-safe mode, the object comes
+ * from the slab cache of the calling thread, which takes a batch of
+ * objects out of the slabs when it runs out.
+ */
+static void *HeapMgr_mallocInSlab(size_t uBytes)
+{
+   size_t uClass; /* the class of the object */
+   void *pv = NULL;
+
+   if ((uBytes == 0) || (uBytes > uSlabThreshold))
+      return NULL;
+   uClass = (uBytes - 1) / Chunk_unitsToBytes(1);
+   if (uClass >= (size_t)SLAB_CLASS_COUNT)
+      return NULL;
+
+#ifdef HEAPMGR_THREADS
+   if (sSlabCache.apvObjects[uClass] == NULL)
+      HeapMgr_fillSlabCache(uClass);
+   pv = sSlabCache.apvObjects[uClass];
+   if (pv != NULL)
+   {
+      sSlabCache.apvObjects[uClass] = *(void**)pv;
+      sSlabCache.auCounts[uClass]--;
+   }
+#else
+   pv = HeapMgr_takeFromSlab(uClass);
+#endif
+   return pv;
+}
+
+/* If pv, the address that a client of the default heap freed, is of
+ * an object in a slab, free it and return TRUE. Return FALSE
+ * otherwise. In thread-safe mode, the object goes to the slab cache
+ * of the calling thread, which gives a batch of objects back to the
+ * slabs when it is full; otherwise it goes to its slab at once.
+ */
+static int HeapMgr_freeIfInSlab(void *pv)
+{
+#ifdef HEAPMGR_THREADS
+   size_t uClass; /* the class of the object */
+#else
+   struct HeapMgrSlab *psEmpty = NULL; /* slab to give back */
+#endif
+
+   if (! HeapMgr_isInSlab(pv))
+      return FALSE;
+
+#ifdef HEAPMGR_THREADS
+   uClass = HeapMgr_getSlab(pv)->uClass;
+   HeapMgr_registerSlabCache();
+   if (sSlabCache.auCounts[uClass] == (size_t)SLAB_CACHE_MAX)
+      HeapMgr_flushSlabCache(&sSlabCache, uClass,
+                             (size_t)SLAB_CACHE_BATCH);
+   *(void**)pv = sSlabCache.apvObjects[uClass];
+   sSlabCache.apvObjects[uClass] = pv;
+   sSlabCache.auCounts[uClass]++;
+#else
+   HeapMgr_putInSlab(pv, &psEmpty);
+   HeapMgr_freeSlabs(psEmpty);
+#endif
+   return TRUE;
+}
+
+/* Give the empty slab that each class may keep back to the default
+ * heap. Return TRUE if there was any, or FALSE otherwise.
+ */
+static int HeapMgr_trimSlabs(void)
+{
+   struct HeapMgrSlab *psEmpty = NULL; /* slab to give back */
+   size_t uClass;
+   int iTrimmed = FALSE;
+
+   for (uClass = 0; uClass < (size_t)SLAB_CLASS_COUNT; uClass++)
+   {
+      HeapMgr_lockSlabs(uClass);
+      psEmpty = apsSlabs[uClass];
+      if ((psEmpty != NULL) && (psEmpty->uInUse == 0))
+         HeapMgr_removeSlab(psEmpty);
+      else
+         psEmpty = NULL;
+      HeapMgr_unlockSlabs(uClass);
+
+      if (psEmpty != NULL)
+      {
+         HeapMgr_markSlab(psEmpty, FALSE);
+         HeapMgr_freeIn(&oDefaultHeap, psEmpty);
+         iTrimmed = TRUE;
+      }
+   }
+   return iTrimmed;
+}
+
+/* Acquire the lock of the end of oHeap, in thread-safe mode. */
+static void HeapMgr_lockTop(HeapMgr_T oHeap)
+{
+#ifdef HEAPMGR_THREADS
+   HeapMgr_acquire(&oHeap->sTopLock);
+#else
+   (void)oHeap;
+#endif
+}
+
+/* Release the lock of the end of oHeap, in thread-safe mode. */
+static void HeapMgr_unlockTop(HeapMgr_T oHeap)
+{
+#ifdef HEAPMGR_THREADS
+   HeapMgr_release(&oHeap->sTopLock);
+#else
+   (void)oHeap;
+#endif
+}
+
+#ifdef CHUNK_FOOTERLESS
+/* Acquire the lock of the status of the last chunk of oHeap, in
+ * thread-safe mode.
+ */
+static void HeapMgr_lockLast(HeapMgr_T oHeap)
+{
+#ifdef HEAPMGR_THREADS
+   HeapMgr_acquire(&oHeap->sLastLock);
+#else
+   (void)oHeap;
+#endif
+}
+
+/* Release the lock of the status of the last chunk of oHeap, in
+ * thread-safe mode.
+ */
+static void HeapMgr_unlockLast(HeapMgr_T oHeap)
+{
+#ifdef HEAPMGR_THREADS
+   HeapMgr_release(&oHeap->sLastLock);
+#else
+   (void)oHeap;
+#endif
+}
+#endif
+
+/* Acquire the lock of bin uIndex of oHeap, in thread-safe mode. */
+static void HeapMgr_lockBin(HeapMgr_T oHeap, size_t uIndex)
+{
+#ifdef HEAPMGR_THREADS
+   HeapMgr_acquire(&oHeap->asBinLocks[uIndex]);
+#else
+   (void)oHeap;
+   (void)uIndex;
+#endif
+}
+
+/* Release the lock of bin uIndex of oHeap, in thread-safe mode. */
+static void HeapMgr_unlockBin(HeapMgr_T oHeap, size_t uIndex)
+{
+#ifdef HEAPMGR_THREADS
+   HeapMgr_release(&oHeap->asBinLocks[uIndex]);
+#else
+   (void)oHeap;
+   (void)uIndex;
+#endif
+}
+
+/* Keep the CPU and the compiler from moving memory accesses across
+ * the call, in thread-safe mode.
+ */
+static void HeapMgr_fence(void)
+{
+#ifdef HEAPMGR_THREADS
+   __sync_synchronize();
+#endif
+}
+
+/* Return the position of the leading bit of the sizes of the chunks
+ * in large bin uIndex.
+ */
+static size_t HeapMgr_getLeadingBit(size_t uIndex)
+{
+   assert(uIndex >= (size_t)SMALL_BIN_COUNT);
+   return uIndex - (size_t)SMALL_BIN_COUNT + (size_t)LARGE_BIN_SHIFT;
+}
+
+/* Record in the bin map of oHeap that bin uIndex holds chunks. The
+ * lock of the bin must be held.
+ */
+static void HeapMgr_markBin(HeapMgr_T oHeap, size_t uIndex)
+{
+   size_t uWord = uIndex / (size_t)BIN_MAP_BITS;
+   unsigned long ulBit = 1UL << (uIndex % (size_t)BIN_MAP_BITS);
+
+#ifdef HEAPMGR_THREADS
+   (void)__sync_fetch_and_or(&oHeap->aulBinMap[uWord], ulBit);
+   (void)__sync_fetch_and_or(&oHeap->ulBinSummary, 1UL << uWord);
+#else
+   oHeap->aulBinMap[uWord] |= ulBit;
+   oHeap->ulBinSummary |= 1UL << uWord;
+#endif
+}
+
+/* Record in the bin map of oHeap that bin uIndex is empty. The lock
+ * of the bin must be held.
+ */
+static void HeapMgr_unmarkBin(HeapMgr_T oHeap, size_t uIndex)
+{
+   size_t uWord = uIndex / (size_t)BIN_MAP_BITS;
+   unsigned long ulBit = 1UL << (uIndex % (size_t)BIN_MAP_BITS);
+
+#ifdef HEAPMGR_THREADS
+   if (__sync_and_and_fetch(&oHeap->aulBinMap[uWord], ~ulBit) != 0)
+      return;
+   (void)__sync_fetch_and_and(&oHeap->ulBinSummary, ~(1UL << uWord));
+
+   /* a thread that marked another bin of the word meanwhile may have
+      set the summary bit before it was cleared */
+   if (oHeap->aulBinMap[uWord] != 0)
+      (void)__sync_fetch_and_or(&oHeap->ulBinSummary, 1UL << uWord);
+#else
+   oHeap->aulBinMap[uWord] &= ~ulBit;
+   if (oHeap->aulBinMap[uWord] == 0)
+      oHeap->ulBinSummary &= ~(1UL << uWord);
+#endif
+}
+
+/* Return the index of the first bin of oHeap from uIndex on that
+ * holds chunks, or IBINCOUNT if there is none.
+ */
+static size_t HeapMgr_nextBin(HeapMgr_T oHeap, size_t uIndex)
+{
+   size_t uWord; /* the word of the bin map to look in */
+   unsigned long ulBits; /* the bins of it that may hold chunks */
+   unsigned long ulWords; /* the words after it that have some */
+
+   if (uIndex >= (size_t)IBINCOUNT)
+      return (size_t)IBINCOUNT;
+
+   /* (1) the bins from uIndex to the end of its word */
+   uWord = uIndex / (size_t)BIN_MAP_BITS;
+   ulBits = oHeap->aulBinMap[uWord] &
+            (~0UL << (uIndex % (size_t)BIN_MAP_BITS));
+
+   /* (2) else the first word after it that has any; under threads
+      the word may be empty again by the time it is read */
+   while (ulBits == 0)
+   {
+      if (++uWord == (size_t)BIN_MAP_WORDS)
+         return (size_t)IBINCOUNT;
+      ulWords = oHeap->ulBinSummary & (~0UL << uWord);
+      if (ulWords == 0)
+         return (size_t)IBINCOUNT;
+      uWord = (size_t)__builtin_ctzl(ulWords);
+      ulBits = oHeap->aulBinMap[uWord];
+   }
+
+   return uWord * (size_t)BIN_MAP_BITS + (size_t)__builtin_ctzl(ulBits);
+}
+
+/*--------------------------------------------------------------------*/
+/* Request more memory from the operating system -- enough to store
+   uUnits units. Create a new chunk, and and return it. The lock of
+   the heap end must be held. */
+static Chunk_T HeapMgr_getMoreMemory(HeapMgr_T oHeap, size_t uUnits)
+{
+   Chunk_T oChunk;
+   Chunk_T oNewHeapEnd;
+   size_t uBytes;
+
+   /* always use at least 512 units */
+   if (uUnits < (size_t)MIN_UNITS_FROM_OS)
+      uUnits = (size_t)MIN_UNITS_FROM_OS;
+
+   /* Convert units to bytes. */
+   uBytes = Chunk_unitsToBytes(uUnits);
+   
+   /* calculate address of potential new heap end*/
+   oNewHeapEnd = (Chunk_T)((char*)oHeap->oHeapEnd + uBytes);
+
+   /* Check for overflow */
+   if (oNewHeapEnd < oHeap->oHeapEnd)
+      return NULL;
+
+   /* Check that the heap stays within what its chunks can span */
+   if (uUnits > Chunk_getMaxUnits()
+                - (size_t)((char*)oHeap->oHeapEnd
+                           - (char*)oHeap->oHeapStart)
+                  / Chunk_unitsToBytes(1))
+      return NULL;
+
+   if (oHeap->oReserveEnd != NULL)
+   {
+      /* the memory is mapped already; stay inside the reservation */
+      if (uBytes > (size_t)((char*)oHeap->oReserveEnd -
+                            (char*)oHeap->oHeapEnd))
+         return NULL;
+   }
+   /*system call: move the program break and error check*/
+   else if (brk(oNewHeapEnd) == -1)
+      return NULL;
+
+   /* select new chunk for returning */
+   oChunk = oHeap->oHeapEnd;
+
+   /* Set the fields of the new chunk; it is in use until the caller
+      decides what to do with it. */
+   Chunk_setStatus(oChunk, CHUNK_INUSE);
+   Chunk_setUnits(oChunk, uUnits);
+   Chunk_setNextInList(oChunk, NULL);
+   Chunk_setPrevInList(oChunk, NULL);
+#ifdef CHUNK_FOOTERLESS
+   /* the new chunk takes over the status of the last chunk, and
+      becomes the last chunk itself, before another thread sets that
+      status */
+   HeapMgr_lockLast(oHeap);
+   Chunk_setPrevStatus(oChunk, oHeap->eLastStatus);
+   oHeap->eLastStatus = CHUNK_INUSE;
+#endif
+
+   /* update global var heap end; other threads look at it without
+      the lock, so the new chunk must be complete first */
+   HeapMgr_fence();
+   oHeap->oHeapEnd = oNewHeapEnd;
+#ifdef CHUNK_FOOTERLESS
+   HeapMgr_unlockLast(oHeap);
+#endif
+   
+   return oChunk;
+}
+
+/* Return the node of oChunk, a free chunk in a large bin. */
+static struct LargeNode *HeapMgr_getNode(Chunk_T oChunk)
+{
+   return (struct LargeNode*)Chunk_toPayload(oChunk);
+}
+
+/* Add oChunk, a free chunk, to the size tree of uIndex, the large bin
+ * that it belongs in.
+ */
+static void HeapMgr_addToTree(HeapMgr_T oHeap, Chunk_T oChunk,
+                              size_t uIndex)
+{
+   struct LargeNode *psNode = HeapMgr_getNode(oChunk);
+   struct LargeNode *psParent;
+   Chunk_T *poSlot; /* where a node for oChunk would go */
+   Chunk_T oParent = NULL;
+   size_t uUnits = Chunk_getUnits(oChunk);
+   size_t uBit = HeapMgr_getLeadingBit(uIndex);
+
+   psNode->aoChildren[0] = NULL;
+   psNode->aoChildren[1] = NULL;
+   psNode->oNextSame = oChunk;
+   psNode->oPrevSame = oChunk;
+
+   /* (1) follow the bits of the size down the tree; every bit is
+      used up by the time a node of the same size turns up */
+   for (poSlot = &oHeap->aoTrees[uIndex - (size_t)SMALL_BIN_COUNT];
+        *poSlot != NULL;
+        poSlot = &psParent->aoChildren[(uUnits >> uBit) & 1])
+   {
+      oParent = *poSlot;
+      psParent = HeapMgr_getNode(oParent);
+
+      /* (2) join the ring of the node of the same size */
+      if (Chunk_getUnits(oParent) == uUnits)
+      {
+         psNode->oParent = NULL;
+         psNode->oNextSame = psParent->oNextSame;
+         psNode->oPrevSame = oParent;
+         HeapMgr_getNode(psParent->oNextSame)->oPrevSame = oChunk;
+         psParent->oNextSame = oChunk;
+         return;
+      }
+      assert(uBit > 0);
+      uBit--;
+   }
+
+   /* (3) else become a leaf */
+   psNode->oParent = (oParent == NULL) ? oChunk : oParent;
+   *poSlot = oChunk;
+}
+
+/* Remove oChunk, a free chunk, from the size tree of uIndex, the
+ * large bin that it is in.
+ */
+static void HeapMgr_removeFromTree(HeapMgr_T oHeap, Chunk_T oChunk,
+                                   size_t uIndex)
+{
+   struct LargeNode *psNode = HeapMgr_getNode(oChunk);
+   struct LargeNode *psReplacement;
+   Chunk_T *poSlot = NULL; /* the link to a leaf below oChunk */
+   Chunk_T oReplacement = NULL; /* the chunk to take its place */
+   int i;
+
+   /* (1) unlink the chunk from its ring; a chunk in the ring of a
+      node has no place in the tree */
+   HeapMgr_getNode(psNode->oNextSame)->oPrevSame = psNode->oPrevSame;
+   HeapMgr_getNode(psNode->oPrevSame)->oNextSame = psNode->oNextSame;
+   if (psNode->oParent == NULL)
+      return;
+
+   /* (2) a node gives its place to the next chunk of its ring, or
+      else to a leaf below it, whose bits match the path down to the
+      place as those of any chunk below it do */
+   if (psNode->oNextSame != oChunk)
+      oReplacement = psNode->oNextSame;
+   else
+   {
+      for (oReplacement = oChunk;;)
+      {
+         psReplacement = HeapMgr_getNode(oReplacement);
+         if (psReplacement->aoChildren[1] != NULL)
+            poSlot = &psReplacement->aoChildren[1];
+         else if (psReplacement->aoChildren[0] != NULL)
+            poSlot = &psReplacement->aoChildren[0];
+         else
+            break;
+         oReplacement = *poSlot;
+      }
+      if (oReplacement == oChunk)
+         oReplacement = NULL;
+      else
+         *poSlot = NULL;
+   }
+
+   /* (3) link the replacement, if any, to the parent and children of
+      the node */
+   if (psNode->oParent == oChunk)
+      oHeap->aoTrees[uIndex - (size_t)SMALL_BIN_COUNT] = oReplacement;
+   else
+   {
+      i = (HeapMgr_getNode(psNode->oParent)->aoChildren[0] == oChunk)
+          ? 0 : 1;
+      HeapMgr_getNode(psNode->oParent)->aoChildren[i] = oReplacement;
+   }
+   if (oReplacement == NULL)
+      return;
+   psReplacement = HeapMgr_getNode(oReplacement);
+   psReplacement->oParent = (psNode->oParent == oChunk) ?
+                            oReplacement : psNode->oParent;
+   for (i = 0; i < 2; i++)
+   {
+      psReplacement->aoChildren[i] = psNode->aoChildren[i];
+      if (psNode->aoChildren[i] != NULL)
+         HeapMgr_getNode(psNode->aoChildren[i])->oParent =
+            oReplacement;
+   }
+}
+
+/* Return the smallest chunk in the size tree of large bin uIndex of
+ * oHeap that has at least uUnits units, or NULL if there is none.
+ * The lock of the bin must be held.
+ */
+static Chunk_T HeapMgr_findInTree(HeapMgr_T oHeap, size_t uIndex,
+                                  size_t uUnits)
+{
+   struct LargeNode *psNode;
+   Chunk_T oNode; /* the node looked at */
+   Chunk_T oBest = NULL; /* the best fit so far */
+   Chunk_T oBigger = NULL; /* the last subtree passed of bigger sizes */
+   size_t uBit = HeapMgr_getLeadingBit(uIndex);
+   int iSide;
+
+   /* every chunk of a bin past that of uUnits is big enough */
+   if (HeapMgr_getBinIndex(uUnits) < uIndex)
+      uUnits = 0;
+
+   /* (1) follow the bits of uUnits down the tree as far as it goes */
+   oNode = oHeap->aoTrees[uIndex - (size_t)SMALL_BIN_COUNT];
+   while (oNode != NULL)
+   {
+      if ((Chunk_getUnits(oNode) >= uUnits) &&
+          ((oBest == NULL) ||
+           (Chunk_getUnits(oNode) < Chunk_getUnits(oBest))))
+      {
+         oBest = oNode;
+         if (Chunk_getUnits(oNode) == uUnits)
+            return oBest;
+      }
+      if (uBit == 0)
+         break;
+      uBit--;
+
+      psNode = HeapMgr_getNode(oNode);
+      iSide = (int)((uUnits >> uBit) & 1);
+      if ((iSide == 0) && (psNode->aoChildren[1] != NULL))
+         oBigger = psNode->aoChildren[1];
+      oNode = psNode->aoChildren[iSide];
+   }
+
+   /* (2) else the sizes in the last subtree passed on its bigger side
+      are all bigger than uUnits; find the smallest of them, down
+      its smaller side where there is one */
+   for (oNode = oBigger; oNode != NULL;
+        oNode = (psNode->aoChildren[0] != NULL) ?
+                psNode->aoChildren[0] : psNode->aoChildren[1])
+   {
+      psNode = HeapMgr_getNode(oNode);
+      if ((oBest == NULL) ||
+          (Chunk_getUnits(oNode) < Chunk_getUnits(oBest)))
+         oBest = oNode;
+   }
+   return oBest;
+}
+
+/* Add oChunk to the front of the Free list ASSUMING
+ * its status bit is already set correctly
+ */
+static void HeapMgr_addToList(HeapMgr_T oHeap, Chunk_T oChunk)
+{
+   Chunk_T oOldFront; /* chunk to store the old front of the list */
+   size_t  uIndex; /* use to index into bin */
+
+   uIndex = HeapMgr_getBinIndex(Chunk_getUnits(oChunk));
+
+   assert(Chunk_isValid(oChunk, oHeap->oHeapStart, oHeap->oHeapEnd));
+
+   /* clear chunk links */
+   Chunk_setNextInList(oChunk, NULL);
+   Chunk_setPrevInList(oChunk, NULL);
+
+   /* the chunks of large bins are in the size trees too */
+   if (uIndex >= (size_t)SMALL_BIN_COUNT)
+      HeapMgr_addToTree(oHeap, oChunk, uIndex);
+
+   /* initialize a free list if nessecary */
+   if (oHeap->aoBins[uIndex] == NULL)
+   {
+      oHeap->aoBins[uIndex] = oChunk;
+      HeapMgr_markBin(oHeap, uIndex);
+      return;
+   }
+
+   /* select nodes of interest */
+   oOldFront = oHeap->aoBins[uIndex];
+   oHeap->aoBins[uIndex] = oChunk;
+
+   /* set links */
+   Chunk_setNextInList(oHeap->aoBins[uIndex], oOldFront);
+   Chunk_setPrevInList(oHeap->aoBins[uIndex], NULL);
+   Chunk_setPrevInList(oOldFront, oHeap->aoBins[uIndex]);
+
+   assert(Chunk_isValid(oChunk, oHeap->oHeapStart, oHeap->oHeapEnd));
+   return;
+}
+
+/* Remove oChunk from free list without changing the status bit
+ * Return the removed Chunk which is the same as oChunk
+ */
+static Chunk_T HeapMgr_removeFromList(HeapMgr_T oHeap, Chunk_T oChunk)
+{
+   Chunk_T oPrevChunk;
+   Chunk_T oNextChunk;
+   Chunk_T oNewFront;
+   char *pcNode; /* the first byte of the node to clear */
+   char *pcNodeEnd; /* the byte immediately beyond the node */
+   char *pcFresh; /* fresh memory that is zero starts here */
+   size_t  uIndex = HeapMgr_getBinIndex(Chunk_getUnits(oChunk));
+   assert(oHeap->aoBins[uIndex] != NULL);
+   assert(Chunk_isValid(oChunk, oHeap->oHeapStart, oHeap->oHeapEnd));
+
+   /* get prev and next chunk, before the node, which may hold a
+      link, is cleared */
+   oPrevChunk = Chunk_getPrevInList(oChunk);
+   oNextChunk = Chunk_getNextInList(oChunk);
+
+#ifndef HEAPMGR_THREADS
+   /* a remainder taken out of its bin is one no more */
+   if (oChunk == oHeap->oLastRemainder)
+      oHeap->oLastRemainder = NULL;
+#endif
+
+   /* the part of the node in fresh memory must not outlive its time
+      in the tree, as calloc() counts on fresh memory being zero; with
+      small units, or with the previous link in the node, the node of
+      a chunk that starts below the fresh memory can still reach into
+      it */
+   if (uIndex >= (size_t)SMALL_BIN_COUNT)
+   {
+      HeapMgr_removeFromTree(oHeap, oChunk, uIndex);
+      pcNode = (char*)Chunk_toPayload(oChunk);
+      pcFresh = (char*)oHeap->oFreshStart + Chunk_unitsToBytes(1);
+      if (pcNode < pcFresh)
+         pcNode = pcFresh;
+      pcNodeEnd = (char*)Chunk_toPayload(oChunk)
+                  + sizeof(struct LargeNode);
+      if (pcNode < pcNodeEnd)
+         memset(pcNode, 0, (size_t)(pcNodeEnd - pcNode));
+   }
+
+   /* case for removing front of list*/
+   if (oChunk == oHeap->aoBins[uIndex])
+   {
+      oNewFront = Chunk_getNextInList(oChunk);
+      /* case for removing chunk from length one list */
+      if (oNewFront == NULL)
+      {
+         oHeap->aoBins[uIndex] = NULL;
+         HeapMgr_unmarkBin(oHeap, uIndex);
+         return oChunk;
+      }
+      oHeap->aoBins[uIndex] = oNewFront;
+      Chunk_setPrevInList(oHeap->aoBins[uIndex], NULL);
+      Chunk_setNextInList(oChunk, NULL);
+      return oChunk;
+   }
+
+   assert((oPrevChunk != NULL) || (oNextChunk != NULL));
+   /* case for removing end of list */
+   if (oNextChunk == NULL)
+   {
+      Chunk_setNextInList(oPrevChunk, NULL);
+      Chunk_setPrevInList(oChunk, NULL);
+      return oChunk;
+   }
+   
+   Chunk_setNextInList(oPrevChunk, oNextChunk);
+   Chunk_setPrevInList(oNextChunk, oPrevChunk);
+   Chunk_setNextInList(oChunk, NULL);
+   Chunk_setPrevInList(oChunk, NULL);
+
+   assert(Chunk_isValid(oChunk, oHeap->oHeapStart, oHeap->oHeapEnd));
+
+
+   return oChunk; 
+}
+
+/* Record eStatus as the status of the chunk of oHeap that ends at
+ * oEnd, if chunks in use have no footers: in the header of the chunk
+ * that starts at oEnd, or in oHeap if oEnd is the end of the heap.
+ * The header may belong to another thread, which sets its other bits
+ * in one atomic step each, as this one does.
+ */
+static void HeapMgr_setStatusBefore(HeapMgr_T oHeap, Chunk_T oEnd,
+                                    enum ChunkStatus eStatus)
+{
+#ifdef CHUNK_FOOTERLESS
+   /* the heap end moves past oEnd only with the lock held, and never
+      back to it, so an end short of it needs no lock */
+   if (oEnd == oHeap->oHeapEnd)
+   {
+      HeapMgr_lockLast(oHeap);
+      if (oEnd == oHeap->oHeapEnd)
+      {
+         oHeap->eLastStatus = eStatus;
+         HeapMgr_unlockLast(oHeap);
+         return;
+      }
+      HeapMgr_unlockLast(oHeap);
+   }
+   Chunk_setPrevStatus(oEnd, eStatus);
+#else
+   (void)oHeap;
+   (void)oEnd;
+   (void)eStatus;
+#endif
+}
+
+/* Set the status of oChunk, a chunk of oHeap, to eStatus, recording
+ * it with the chunk after it as well.
+ */
+static void HeapMgr_setStatus(HeapMgr_T oHeap, Chunk_T oChunk,
+                              enum ChunkStatus eStatus)
+{
+   Chunk_setStatus(oChunk, eStatus);
+   HeapMgr_setStatusBefore(oHeap, (Chunk_T)((char*)oChunk +
+      Chunk_unitsToBytes(Chunk_getUnits(oChunk))), eStatus);
+}
+
+/* Split oChunk into two valid logical Chunks first of which has 
+ * length uUnits and the second has the rest of physical chunks in it
+ * The status bit of the first Chunk is unchanged, and the second
+ * Chunk is in use, so that no other thread takes it for free.
+ * The lengths of the two Chunks are set accordingly so 
+ * Chunk_getNextInMemory with the first split Chunk will 
+ * return the second split Chunk
+ */
+static Chunk_T HeapMgr_splitGetTail(HeapMgr_T oHeap, Chunk_T oChunk,
+                                    size_t uUnits)
+{
+   /* oChunk is used as an alias for oFront after oTail is allocated*/
+   Chunk_T oTail  = NULL;
+   size_t  uBytes;
+   size_t  uTotalUnits;
+   
+   assert(Chunk_isValid(oChunk, oHeap->oHeapStart, oHeap->oHeapEnd));
    
+   uBytes = Chunk_unitsToBytes(uUnits);
+   uTotalUnits = Chunk_getUnits(oChunk);
+   oTail = (Chunk_T)((char*)oChunk + uBytes);
+   assert(uTotalUnits > uUnits);
+   HeapMgr_startChange();
+   Chunk_setStatus(oTail, CHUNK_INUSE);
+   Chunk_setUnits(oTail, uTotalUnits - uUnits);
+   HeapMgr_setStatusBefore(oHeap, oTail, Chunk_getStatus(oChunk));
+   HeapMgr_setStatusBefore(oHeap, (Chunk_T)((char*)oChunk +
+      Chunk_unitsToBytes(uTotalUnits)), CHUNK_INUSE);
+
+   Chunk_setUnits(oChunk, uUnits);
+   HeapMgr_endChange();
+
+   /* the split chunks are individually valid */
+   assert(Chunk_isValid(oChunk, oHeap->oHeapStart, oHeap->oHeapEnd));
+   assert(Chunk_isValid(oTail, oHeap->oHeapStart, oHeap->oHeapEnd));
+
+   /* Their sizes sum up to the total */
+   assert(Chunk_getUnits(oChunk) + Chunk_getUnits(oTail) ==uTotalUnits);
+
+   /* sizes are set correctly and the two are adjacent */
+   assert(Chunk_getNextInMem(oChunk, oHeap->oHeapEnd) == oTail);
+#ifndef CHUNK_FOOTERLESS
+   assert(Chunk_getPrevInMem(oTail, oHeap->oHeapStart) == oChunk);
+#endif
+
+   return oTail;
+}
+
+/* Return TRUE if the header of oChunk says that it is free, or FALSE
+ * otherwise. A header that merging cleared says that it is free but
+ * holds no units, so it is not taken for one.
+ */
+static int HeapMgr_isFree(Chunk_T oChunk)
+{
+   return (Chunk_getStatus(oChunk) == CHUNK_FREE) &&
+          (Chunk_getUnits(oChunk) >= (size_t)MIN_UNITS_PER_CHUNK);
+}
+
+/* If oChunk, which starts where a chunk starts, is free, take it out
+ * of the Free list and set it in use, so that it belongs to the
+ * caller. Return TRUE if so, or FALSE otherwise.
+ */
+static int HeapMgr_takeIfFree(HeapMgr_T oHeap, Chunk_T oChunk)
+{
+   size_t uIndex; /* the bin that the status suggests */
+
+   /* Look without a lock first. Only free chunks change status or
+    * size in another thread's hands, and only while it holds the
+    * lock of the bin they are in, so the look is final once that
+    * lock is held.
+    */
+   while (HeapMgr_isFree(oChunk))
+   {
+      uIndex = HeapMgr_getBinIndex(Chunk_getUnits(oChunk));
+      HeapMgr_lockBin(oHeap, uIndex);
+      if (HeapMgr_isFree(oChunk) &&
+          (HeapMgr_getBinIndex(Chunk_getUnits(oChunk)) == uIndex))
+      {
+         (void)HeapMgr_removeFromList(oHeap, oChunk);
+         HeapMgr_setStatus(oHeap, oChunk, CHUNK_INUSE);
+         HeapMgr_unlockBin(oHeap, uIndex);
+         return TRUE;
+      }
+      HeapMgr_unlockBin(oHeap, uIndex);
+   }
+   return FALSE;
+}
+
+/* Return the chunk before oChunk in memory if its header says that
+ * it is free, or NULL otherwise. Without the lock of its bin, the
+ * answer is only a hint.
+ */
+static Chunk_T HeapMgr_getFreePrev(HeapMgr_T oHeap, Chunk_T oChunk)
+{
+   Chunk_T oPrev = NULL; /* the chunk that oChunk's footer suggests */
+
+   /* The header may be a stale one that a client has written over
+    * since, so it is checked only against oChunk, without
+    * Chunk_getNextInMem().
+    */
+#ifdef CHUNK_FOOTERLESS
+   /* no header past the last chunk records its status, and the
+      memory there may not be mapped */
+   if (oChunk == oHeap->oHeapEnd)
+      oPrev = (oHeap->eLastStatus != CHUNK_FREE) ? NULL
+              : Chunk_getFreePrevInMem(oChunk, oHeap->oHeapStart);
+   else
+#endif
+   oPrev = Chunk_getPrevInMem(oChunk, oHeap->oHeapStart);
+   if ((oPrev == NULL) || (! HeapMgr_isFree(oPrev)) ||
+       ((char*)oPrev + Chunk_unitsToBytes(Chunk_getUnits(oPrev))
+        != (char*)oChunk))
+      return NULL;
+   return oPrev;
+}
+
+/* If the chunk before oChunk in memory is free, take it out of the
+ * Free list and set it in use, as HeapMgr_takeIfFree() does. Return
+ * the chunk if so, or NULL otherwise. oChunk must belong to the
+ * caller.
+ */
+static Chunk_T HeapMgr_takePrevIfFree(HeapMgr_T oHeap, Chunk_T oChunk)
+{
+   Chunk_T oPrev = NULL; /* the chunk that oChunk's footer suggests */
+   size_t uIndex; /* the bin that the status suggests */
+
+   /* The footer in front of oChunk is the one of the chunk before
+    * it, but that chunk may be changing hands, so its header is
+    * trusted only if it is free in the bin whose lock is held, and
+    * agrees with the footer read after it. Headers left inside
+    * chunks by merging are never free, as only chunks in use merge.
+    */
+   oPrev = HeapMgr_getFreePrev(oHeap, oChunk);
+   if (oPrev == NULL)
+      return NULL;
+
+   uIndex = HeapMgr_getBinIndex(Chunk_getUnits(oPrev));
+   HeapMgr_lockBin(oHeap, uIndex);
+   if ((HeapMgr_getFreePrev(oHeap, oChunk) != oPrev) ||
+       (HeapMgr_getBinIndex(Chunk_getUnits(oPrev)) != uIndex))
+   {
+      /* the chunk changed hands; whoever frees it next coalesces */
+      HeapMgr_unlockBin(oHeap, uIndex);
+      return NULL;
+   }
+   HeapMgr_fence();
+   if (HeapMgr_getFreePrev(oHeap, oChunk) != oPrev)
+   {
+      HeapMgr_unlockBin(oHeap, uIndex);
+      return NULL;
+   }
+
+   (void)HeapMgr_removeFromList(oHeap, oPrev);
+   HeapMgr_setStatus(oHeap, oPrev, CHUNK_INUSE);
+   HeapMgr_unlockBin(oHeap, uIndex);
+   return oPrev;
+}
+
+/* Merge oBack, the chunk that follows oFront in memory, into oFront.
+ * Both must belong to the caller.
+ */
+static void HeapMgr_merge(HeapMgr_T oHeap, Chunk_T oFront,
+                          Chunk_T oBack)
+{
+   assert(Chunk_getNextInMem(oFront, oHeap->oHeapEnd) == oBack);
+
+   HeapMgr_startChange();
+   Chunk_setUnits(oFront,
+                  Chunk_getUnits(oFront) + Chunk_getUnits(oBack));
+
+   /* the footer of oFront and the header of oBack are now inside
+      the merged chunk; clear them if they lie in fresh memory */
+   if (oBack > oHeap->oFreshStart)
+      memset((char*)oBack - Chunk_unitsToBytes(1), 0,
+             Chunk_unitsToBytes(2));
+   HeapMgr_endChange();
+}
+
+/* If the Chunk which is next to oChunk in memory is free, take it
+ * out of the Free list and merge it into oChunk, which must belong
+ * to the caller. Return TRUE if so, or FALSE otherwise.
+ */
+static int HeapMgr_coalesceForward(HeapMgr_T oHeap, Chunk_T oChunk)
+{
+   Chunk_T oNext = NULL;
+
+   assert(Chunk_isValid(oChunk, oHeap->oHeapStart, oHeap->oHeapEnd));
+   assert(Chunk_getStatus(oChunk) == CHUNK_INUSE);
+
+   /* get adjacent chunk*/
+   oNext = Chunk_getNextInMem(oChunk, oHeap->oHeapEnd);
+   if ((oNext == NULL) || (! HeapMgr_takeIfFree(oHeap, oNext)))
+      return FALSE;
+
+   HeapMgr_merge(oHeap, oChunk, oNext);
+   return TRUE;
+}
+
+/* If the Chunk which is the previous of oChunk in memory is free,
+ * take it out of the Free list and merge oChunk, which must belong
+ * to the caller, into it. Return the merged chunk, or oChunk if the
+ * previous Chunk is not free.
+ */
+static Chunk_T HeapMgr_coalesceBackward(HeapMgr_T oHeap,
+                                        Chunk_T oChunk)
+{
+   Chunk_T oPrev = NULL;
+
+   assert(Chunk_getStatus(oChunk) == CHUNK_INUSE);
+
+   /* get chunk adjacent in memory */
+   oPrev = HeapMgr_takePrevIfFree(oHeap, oChunk);
+   if (oPrev == NULL)
+      return oChunk;
+
+   HeapMgr_merge(oHeap, oPrev, oChunk);
+   return oPrev;
+}
+
+/* Initialize the heap to be empty, starting at the current program
+ * break, unless it is initialized already.
+ */
+static void HeapMgr_init(HeapMgr_T oHeap)
+{
+   size_t uPageBytes; /* bytes per page of memory */
+   size_t uUnitBytes; /* bytes per unit */
+   char *pcBreak; /* the initial program break */
+   Chunk_T oHeapStart; /* the start of the heap */
+
+   if (oHeap->oHeapStart != NULL)
+      return;
+
+   HeapMgr_lockTop(oHeap);
+   if (oHeap->oHeapStart != NULL)
+   {
+      HeapMgr_unlockTop(oHeap);
+      return;
+   }
+
+   /* start at the first place past the break where the payload of a
+      chunk is aligned to a unit, so that every payload is */
+   pcBreak = (char*)sbrk(0);
+   uUnitBytes = Chunk_unitsToBytes(1);
+   oHeapStart = (Chunk_T)(pcBreak +
+      (Chunk_getStartOffset() + uUnitBytes
+       - (size_t)pcBreak % uUnitBytes) % uUnitBytes);
+   oHeap->oHeapEnd = oHeapStart;
+#ifdef CHUNK_FOOTERLESS
+   oHeap->eLastStatus = CHUNK_INUSE;
+#endif
+
+   /* The rest of the page holding the initial break may have been
+      used by whoever moved the break before us, so only memory
+      from the next page on is known to be fresh. */
+   uPageBytes = (size_t)sysconf(_SC_PAGESIZE);
+   oHeap->oFreshStart = (Chunk_T)((char*)oHeapStart +
+      uPageBytes - ((size_t)oHeapStart % uPageBytes));
+
+#ifdef HEAPMGR_THREADS
+   /* a child process must not inherit a lock held by a thread that
+      it does not have */
+   (void)pthread_atfork(HeapMgr_lockAll, HeapMgr_unlockAll,
+                        HeapMgr_unlockAll);
+
+#ifdef HEAPMGR_PAGES
+   /* the pages of an exiting thread are given up */
+   (void)pthread_key_create(&iCacheKey, HeapMgr_abandonPages);
+   HeapMgr_initPages();
+#else
+   /* the cache of an exiting thread goes back to the heap */
+   (void)pthread_key_create(&iCacheKey, HeapMgr_flushAll);
+#endif
+
+   /* and so does its slab cache, to the slabs */
+   (void)pthread_key_create(&iSlabCacheKey, HeapMgr_flushSlabCaches);
+#ifndef NDEBUG
+   /* an exiting thread no longer counts as one that checks the
+      heap, and a child process forgets the checks of the threads
+      that it does not have */
+   (void)pthread_key_create(&iCheckKey, HeapMgr_forgetChecker);
+   (void)pthread_atfork(NULL, NULL, HeapMgr_forgetChecks);
+#endif
+#endif
+#ifdef HEAPMGR_RSEQ
+   HeapMgr_initCpuCaches();
+#endif
+   HeapMgr_initSlabs(oHeapStart);
+
+   /* other threads look at oHeapStart without the lock */
+   HeapMgr_fence();
+   oHeap->oHeapStart = oHeapStart;
+   HeapMgr_unlockTop(oHeap);
+}
+
+/* Record that oChunk is in use by a client, so memory below its end
+ * is no longer fresh. Return the address where fresh memory started
+ * before.
+ */
+static Chunk_T HeapMgr_markUsed(HeapMgr_T oHeap, Chunk_T oChunk)
+{
+   Chunk_T oChunkEnd; /* address immediately beyond oChunk */
+   Chunk_T oOldFreshStart; /* oFreshStart before the call */
+
+   oChunkEnd = (Chunk_T)((char*)oChunk +
+                         Chunk_unitsToBytes(Chunk_getUnits(oChunk)));
+
+#ifdef HEAPMGR_THREADS
+   do
+   {
+      oOldFreshStart = oHeap->oFreshStart;
+      if (oChunkEnd <= oOldFreshStart)
+         break;
+   } while (__sync_val_compare_and_swap(&oHeap->oFreshStart,
+                                        oOldFreshStart, oChunkEnd)
+            != oOldFreshStart);
+#else
+   oOldFreshStart = oHeap->oFreshStart;
+   if (oChunkEnd > oOldFreshStart)
+      oHeap->oFreshStart = oChunkEnd;
+#endif
+
+   return oOldFreshStart;
+}
+
+/* Request enough memory from the operating system to make a new
+ * chunk of at least uUnits units at the end of the heap, and merge
+ * the last chunk of the old heap into it if that chunk is free.
+ * Return the resulting chunk, which is in use and belongs to the
+ * caller, or NULL if the request cannot be satisfied.
+ */
+static Chunk_T HeapMgr_growHeap(HeapMgr_T oHeap, size_t uUnits)
+{
+   Chunk_T oChunk = NULL; /* chunk to eventually return */
+
+   HeapMgr_lockTop(oHeap);
+   oChunk = HeapMgr_getMoreMemory(oHeap, uUnits);
+   HeapMgr_unlockTop(oHeap);
+   if (oChunk == NULL)
+      return NULL;
+
    /* coalesce backward if needed */
-   if((Chunk_getPrevInMem(oChunk, oHeapStart) != NULL) &&
-      Chunk_getStatus(Chunk_getPrevInMem(oChunk, oHeapStart))
-      == CHUNK_FREE)
-      oChunk = HeapMgr_coalesceBackward(oChunk);
+   return HeapMgr_coalesceBackward(oHeap, oChunk);
+}
+
+/* If oChunk, a chunk of oHeap that belongs to the caller, ends at
+ * the end of the heap, give all of it but its first unit and uPadBytes
+ * bytes after that back to the OS, a page at a time. Return TRUE if
+ * the heap shrank, or FALSE otherwise.
+ */
+static int HeapMgr_trimChunk(HeapMgr_T oHeap, Chunk_T oChunk,
+                             size_t uPadBytes)
+{
+   size_t uPageBytes; /* bytes per page of memory */
+   size_t uBytes; /* bytes in oChunk */
+   char *pcEnd; /* the end of oChunk */
+   char *pcNewEnd; /* the end of oChunk and the heap once trimmed */
+   char *pcDropFrom; /* the first page past pcNewEnd */
+   int iTrimmed = FALSE;
+
+   uPageBytes = (size_t)sysconf(_SC_PAGESIZE);
+   uBytes = Chunk_unitsToBytes(Chunk_getUnits(oChunk));
+   if (uPadBytes >= uBytes - Chunk_unitsToBytes(MIN_UNITS_PER_CHUNK))
+      return FALSE;
+
+   /* (1) keep the chunk whole, with its header where its neighbor
+      looks for it, up to where a chunk would start past the next page
+      boundary past the pad; only the pages after that go back */
+   pcEnd = (char*)oChunk + uBytes;
+   pcNewEnd = (char*)oChunk + Chunk_unitsToBytes(MIN_UNITS_PER_CHUNK)
+              + uPadBytes;
+   pcNewEnd += (uPageBytes - ((size_t)pcNewEnd % uPageBytes))
+               % uPageBytes;
+   pcNewEnd += Chunk_getStartOffset();
+   pcDropFrom = pcNewEnd
+                + (uPageBytes - ((size_t)pcNewEnd % uPageBytes))
+                  % uPageBytes;
+   if (pcDropFrom >= pcEnd)
+      return FALSE;
+
+   /* (2) the heap may have grown past oChunk meanwhile */
+   HeapMgr_lockTop(oHeap);
+   if (pcEnd == (char*)oHeap->oHeapEnd)
+   {
+      if (oHeap->oReserveEnd != NULL)
+         iTrimmed = (madvise(pcDropFrom, (size_t)(pcEnd - pcDropFrom),
+                             MADV_DONTNEED) == 0);
+      /* someone else may have moved the break past the heap */
+      else if ((char*)sbrk(0) == pcEnd)
+         iTrimmed = (brk(pcNewEnd) == 0);
+   }
+   if (iTrimmed)
+   {
+      Chunk_setUnits(oChunk, (size_t)(pcNewEnd - (char*)oChunk)
+                             / Chunk_unitsToBytes(1));
+
+      /* the OS gives zeroed pages when the heap grows back, past the
+         page that it keeps */
+      if ((char*)oHeap->oFreshStart > pcDropFrom)
+         oHeap->oFreshStart = (Chunk_T)pcDropFrom;
+      HeapMgr_fence();
+      oHeap->oHeapEnd = (Chunk_T)pcNewEnd;
+   }
+   HeapMgr_unlockTop(oHeap);
+   return iTrimmed;
+}
+
+/* Give the whole pages of the part of oChunk, a chunk that belongs
+ * to the caller, from pcFrom to pcTo back to the OS, keeping the
+ * header, the node after it, and the footer of oChunk. A pcFrom or
+ * pcTo inside oChunk was a boundary of a chunk whose pages went back
+ * before, so the page that holds it goes back too. Return TRUE if
+ * any page went back, or FALSE otherwise.
+ */
+static int HeapMgr_releasePages(Chunk_T oChunk, char *pcFrom,
+                                char *pcTo)
+{
+   size_t uPageBytes; /* bytes per page of memory */
+   size_t uUnitBytes; /* bytes per unit */
+   char *pcStart; /* the first byte past the node */
+   char *pcEnd; /* the footer */
+
+   uPageBytes = (size_t)sysconf(_SC_PAGESIZE);
+   uUnitBytes = Chunk_unitsToBytes(1);
+   pcStart = (char*)Chunk_toPayload(oChunk) + sizeof(struct LargeNode);
+   pcEnd = (char*)oChunk + Chunk_unitsToBytes(Chunk_getUnits(oChunk))
+           - uUnitBytes;
+
+   if (pcFrom > pcStart)
+      pcFrom -= (size_t)pcFrom % uPageBytes;
+   if (pcFrom < pcStart)
+      pcFrom = pcStart;
+   pcFrom += (uPageBytes - ((size_t)pcFrom % uPageBytes)) % uPageBytes;
+   if (pcTo < pcEnd)
+      pcTo += (uPageBytes - ((size_t)pcTo % uPageBytes)) % uPageBytes;
+   if (pcTo > pcEnd)
+      pcTo = pcEnd;
+   pcTo -= (size_t)pcTo % uPageBytes;
+   if (pcFrom >= pcTo)
+      return FALSE;
+
+   return madvise(pcFrom, (size_t)(pcTo - pcFrom), MADV_DONTNEED) == 0;
+}
+
+/* Record uEpoch as the value of uScavengeEpoch when oChunk, a chunk
+ * of oHeap that belongs to the caller, was freed. Fresh memory must
+ * stay zero for calloc(), and holds no pages to give back anyway, so
+ * a chunk that starts in it records nothing.
+ */
+static void HeapMgr_setFreeSince(HeapMgr_T oHeap, Chunk_T oChunk,
+                                 size_t uEpoch)
+{
+   size_t *puSince = (size_t*)Chunk_toPayload(oChunk);
+
+   if ((char*)puSince < (char*)oHeap->oFreshStart)
+      *puSince = uEpoch;
+}
+
+/* Free oChunk, an in use chunk of oHeap, as HeapMgr_freeChunk() does.
+ * If the merged chunk ends at the end of the heap with at least
+ * uTrimBytes bytes, shrink the heap, keeping uPadBytes of them. If
+ * uTrimBytes is (size_t)-1, give no memory back at all.
+ */
+static void HeapMgr_freeAndTrim(HeapMgr_T oHeap, Chunk_T oChunk,
+                                size_t uTrimBytes, size_t uPadBytes)
+{
+   Chunk_T oNext = NULL; /* next chunk in memory */
+   char *pcFreed; /* the start of the memory freed now */
+   char *pcFreedEnd; /* the end of the memory freed now */
+   size_t uIndex; /* the bin of the merged chunk */
+   size_t uBytes; /* bytes in the merged chunk */
+
+   assert(Chunk_getStatus(oChunk) == CHUNK_INUSE);
+
+   for (;;)
+   {
+      /* (1) coalesce with the neighbors if needed */
+      pcFreed = (char*)oChunk;
+      pcFreedEnd = pcFreed + Chunk_unitsToBytes(Chunk_getUnits(oChunk));
+      (void)HeapMgr_coalesceForward(oHeap, oChunk);
+      oChunk = HeapMgr_coalesceBackward(oHeap, oChunk);
+
+      /* (2) give big free chunks back to the OS: a chunk at the end
+         by shrinking the heap, and others by releasing their pages,
+         which the neighbors it merged with released already if they
+         were big too */
+      uBytes = Chunk_unitsToBytes(Chunk_getUnits(oChunk));
+      HeapMgr_setFreeSince(oHeap, oChunk, uScavengeEpoch);
+      if ((uBytes < uTrimBytes) ||
+          (! HeapMgr_trimChunk(oHeap, oChunk, uPadBytes)))
+      {
+         if ((uBytes >= (size_t)RELEASE_THRESHOLD) &&
+             (uTrimBytes != (size_t)-1))
+            (void)HeapMgr_releasePages(oChunk,
+               (pcFreed - (char*)oChunk >= RELEASE_THRESHOLD) ?
+                  pcFreed : (char*)oChunk,
+               ((char*)oChunk + uBytes - pcFreedEnd
+                >= RELEASE_THRESHOLD) ?
+                  pcFreedEnd : (char*)oChunk + uBytes);
+      }
+
+      /* (2) set status of the chunk to free and add it to the list */
+      uIndex = HeapMgr_getBinIndex(Chunk_getUnits(oChunk));
+      HeapMgr_lockBin(oHeap, uIndex);
+      HeapMgr_setStatus(oHeap, oChunk, CHUNK_FREE);
+      HeapMgr_addToList(oHeap, oChunk);
+
+      /* (3) a neighbor freed by another thread at the same time may
+         have looked at oChunk before it was free. At least one of
+         the two threads sees the other chunk free after the fence,
+         and takes its own chunk back to coalesce again. No other
+         thread can take oChunk while the lock is held, so its
+         neighbors are still its neighbors. */
+      HeapMgr_fence();
+      oNext = Chunk_getNextInMem(oChunk, oHeap->oHeapEnd);
+      if (((oNext == NULL) || (! HeapMgr_isFree(oNext))) &&
+          (HeapMgr_getFreePrev(oHeap, oChunk) == NULL))
+      {
+         HeapMgr_unlockBin(oHeap, uIndex);
+         return;
+      }
+      (void)HeapMgr_removeFromList(oHeap, oChunk);
+      HeapMgr_setStatus(oHeap, oChunk, CHUNK_INUSE);
+      HeapMgr_unlockBin(oHeap, uIndex);
+   }
+}
+
+/* Free oChunk, an in use chunk of oHeap, coalescing it with its free
+ * neighbors, and give the memory of the merged chunk back to the OS
+ * if it is big.
+ */
+static void HeapMgr_freeChunk(HeapMgr_T oHeap, Chunk_T oChunk)
+{
+#ifdef HEAPMGR_THREADS
+   /* the scavenger gives the memory back later, off the free path */
+   if (iScavenging && (oHeap == &oDefaultHeap))
+   {
+      HeapMgr_freeAndTrim(oHeap, oChunk, (size_t)-1, 0);
+      return;
+   }
+#endif
+   HeapMgr_freeAndTrim(oHeap, oChunk, (size_t)TRIM_THRESHOLD,
+                       (size_t)TRIM_PAD);
+}
+
+#ifdef HEAPMGR_THREADS
+/* Return the value of uScavengeEpoch when oChunk, a free chunk of
+ * oHeap, was freed, or RELEASED.
+ */
+static size_t HeapMgr_getFreeSince(HeapMgr_T oHeap, Chunk_T oChunk)
+{
+   size_t *puSince = (size_t*)Chunk_toPayload(oChunk);
+
+   if ((char*)puSince >= (char*)oHeap->oFreshStart)
+      return (size_t)RELEASED;
+   return *puSince;
+}
+
+/* Release the pages of the free chunks of bin uIndex of the default
+ * heap that have been free for uScavengeAge walks of the scavenger,
+ * a few at a time under the lock of the bin.
+ */
+static void HeapMgr_scavengeBin(size_t uIndex)
+{
+   HeapMgr_T oHeap = &oDefaultHeap; /* the heap to scavenge */
+   Chunk_T oChunk = NULL;
+   size_t uEpoch; /* the current walk of the scavenger */
+   size_t uSince; /* the walk when a chunk was freed */
+   size_t uReleased; /* chunks released under the lock */
+
+   uEpoch = uScavengeEpoch;
+   do
+   {
+      /* a pass that stops at SCAVENGE_BATCH chunks starts over, past
+         the chunks that it released */
+      uReleased = 0;
+      HeapMgr_lockBin(oHeap, uIndex);
+      for (oChunk = oHeap->aoBins[uIndex];
+           (oChunk != NULL) && (uReleased < (size_t)SCAVENGE_BATCH);
+           oChunk = Chunk_getNextInList(oChunk))
+      {
+         uSince = HeapMgr_getFreeSince(oHeap, oChunk);
+         if ((uSince == (size_t)RELEASED) ||
+             (uEpoch - uSince < uScavengeAge))
+            continue;
+         (void)HeapMgr_releasePages(oChunk, (char*)oChunk,
+            (char*)oChunk + Chunk_unitsToBytes(Chunk_getUnits(oChunk)));
+         HeapMgr_setFreeSince(oHeap, oChunk, (size_t)RELEASED);
+         uReleased++;
+      }
+      HeapMgr_unlockBin(oHeap, uIndex);
+   } while (uReleased == (size_t)SCAVENGE_BATCH);
+}
+
+/* Shrink the default heap if the free chunk at its end has been free
+ * for uScavengeAge walks of the scavenger.
+ */
+static void HeapMgr_scavengeTop(void)
+{
+   HeapMgr_T oHeap = &oDefaultHeap; /* the heap to scavenge */
+   Chunk_T oChunk = NULL; /* the free chunk at the end of the heap */
+   size_t uSince; /* the walk when the chunk was freed */
+
+   /* look before taking the chunk, as freeing it again makes it
+      young; the lock of the heap end keeps the footer in front of it
+      in place, where another thread could merge it away or trim it
+      off with the heap */
+   HeapMgr_lockTop(oHeap);
+   oChunk = HeapMgr_getFreePrev(oHeap, oHeap->oHeapEnd);
+   if (oChunk != NULL)
+   {
+      uSince = HeapMgr_getFreeSince(oHeap, oChunk);
+      if ((uSince == (size_t)RELEASED) ||
+          (uScavengeEpoch - uSince >= uScavengeAge))
+         oChunk = HeapMgr_takePrevIfFree(oHeap, oHeap->oHeapEnd);
+      else
+         oChunk = NULL;
+   }
+   HeapMgr_unlockTop(oHeap);
+
+   if (oChunk != NULL)
+      HeapMgr_freeAndTrim(oHeap, oChunk, 0, (size_t)TRIM_PAD);
+}
+
+/* Give the memory of the default heap that stays free back to the OS
+ * every ulScavengePeriodNanos nanoseconds until asked to stop. pv is
+ * unused. Return NULL.
+ */
+static void *HeapMgr_scavenge(void *pv)
+{
+   struct timespec sPeriod;
+   size_t uIndex;
+
+   (void)pv;
+   sPeriod.tv_sec = (time_t)(ulScavengePeriodNanos / NANOS_PER_SECOND);
+   sPeriod.tv_nsec = (long)(ulScavengePeriodNanos % NANOS_PER_SECOND);
+
+   for (;;)
+   {
+      (void)nanosleep(&sPeriod, NULL);
+      if (iScavengerStopping)
+         return NULL;
+      uScavengeEpoch++;
+
+      /* only chunks that span a page have pages to release */
+      for (uIndex = HeapMgr_nextBin(&oDefaultHeap, HeapMgr_getBinIndex(
+              Chunk_bytesToUnits((size_t)sysconf(_SC_PAGESIZE))));
+           uIndex < (size_t)IBINCOUNT;
+           uIndex = HeapMgr_nextBin(&oDefaultHeap, uIndex + 1))
+         HeapMgr_scavengeBin(uIndex);
+      HeapMgr_scavengeTop();
+   }
+}
+
+/* Forget the scavenger in a child process, which has no such
+ * thread.
+ */
+static void HeapMgr_forgetScavenger(void)
+{
+   iScavenging = FALSE;
+}
+#endif
+
+/* Set the chunk oChunk, which is in use and belongs to the caller,
+ * to uUnits units, giving the rest back to the Free list if it is at
+ * least SPLIT_THRESHOLD units. Return the address where fresh memory
+ * started before oChunk was used.
+ */
+static Chunk_T HeapMgr_useChunk(HeapMgr_T oHeap, Chunk_T oChunk,
+                                size_t uUnits)
+{
+   Chunk_T oTail = NULL; /* used for splitting case */
+   Chunk_T oOldFreshStart; /* where fresh memory started before */
+#ifdef CHUNK_FOOTERLESS
+   char *pcLast; /* the last unit of oChunk */
+#endif
+
+   assert(Chunk_getStatus(oChunk) == CHUNK_INUSE);
+   assert(Chunk_getUnits(oChunk) >= uUnits);
+
+   /* if the chunk is too big, split off the tail */
+   if ((Chunk_getUnits(oChunk) - uUnits) >= SPLIT_THRESHOLD)
+      oTail = HeapMgr_splitGetTail(oHeap, oChunk, uUnits);
+
+   oOldFreshStart = HeapMgr_markUsed(oHeap, oChunk);
+
+#ifdef CHUNK_FOOTERLESS
+   /* the last unit is payload now, but may hold the footer that the
+      chunk had while free; fresh memory must read as zero */
+   pcLast = (char*)oChunk
+            + Chunk_unitsToBytes(Chunk_getUnits(oChunk) - 1);
+   if (pcLast > (char*)oOldFreshStart)
+      memset(pcLast, 0, Chunk_unitsToBytes(1));
+#endif
+
+   /* give the tail back to the list */
+   if (oTail != NULL)
+      HeapMgr_freeChunk(oHeap, oTail);
+
+#ifndef HEAPMGR_THREADS
+   /* the next small requests go right after this one */
+   if ((oTail != NULL) && (uUnits <= (size_t)REMAINDER_UNITS_MAX) &&
+       HeapMgr_isFree(oTail))
+      oHeap->oLastRemainder = oTail;
+#endif
+   return oOldFreshStart;
+}
+
+/* Shrink the in use chunk oChunk to uUnits units if that frees at
+ * least SPLIT_THRESHOLD units. The freed tail is added to the Free
+ * list and coalesced with the next chunk in memory if that chunk is
+ * free.
+ */
+static void HeapMgr_shrinkInUse(HeapMgr_T oHeap, Chunk_T oChunk,
+                                size_t uUnits)
+{
+   assert(Chunk_getStatus(oChunk) == CHUNK_INUSE);
+   assert(Chunk_getUnits(oChunk) >= uUnits);
+
+   if ((Chunk_getUnits(oChunk) - uUnits) < SPLIT_THRESHOLD)
+      return;
+
+   HeapMgr_freeChunk(oHeap,
+                     HeapMgr_splitGetTail(oHeap, oChunk, uUnits));
+}
+
+/* Compare the addresses that pvFirst and pvSecond point to, as qsort()
+ * requires. Return a negative, zero, or positive number as the first
+ * address is below, equal to, or above the second.
+ */
+static int HeapMgr_compareAddresses(const void *pvFirst,
+                                    const void *pvSecond)
+{
+   const char *pcFirst = *(char * const *)pvFirst;
+   const char *pcSecond = *(char * const *)pvSecond;
+
+   if (pcFirst < pcSecond)
+      return -1;
+   if (pcFirst > pcSecond)
+      return 1;
+   return 0;
+}
+
+/* Return a chunk of at least uUnits units, taken out of the Free
+ * list or made of more memory from the operating system if no bin
+ * holds one, even once the fast bins are consolidated. The chunk is
+ * in use and belongs to the caller. Return NULL if the request
+ * cannot be satisfied.
+ */
+static Chunk_T HeapMgr_findChunk(HeapMgr_T oHeap, size_t uUnits)
+{
+   size_t uIndex; /* used to index into a bin */
+   Chunk_T oChunk = NULL; /* chunk pntr to eventually return */
+
+#ifndef HEAPMGR_THREADS
+   /* (2) a small request that no chunk of its own size fits is
+      carved from the last remainder, if it is big enough */
+   oChunk = oHeap->oLastRemainder;
+   if ((oChunk != NULL) && (uUnits <= (size_t)REMAINDER_UNITS_MAX) &&
+       (oHeap->aoBins[HeapMgr_getBinIndex(uUnits)] == NULL) &&
+       (Chunk_getUnits(oChunk) >= uUnits))
+   {
+      (void)HeapMgr_removeFromList(oHeap, oChunk);
+      HeapMgr_setStatus(oHeap, oChunk, CHUNK_INUSE);
+      return oChunk;
+   }
+#endif
+
+   /* skip empty bins without taking their locks */
+   for (uIndex = HeapMgr_nextBin(oHeap, HeapMgr_getBinIndex(uUnits));
+        uIndex < (size_t)IBINCOUNT;
+        uIndex = HeapMgr_nextBin(oHeap, uIndex + 1))
+   {
+      /* (3) every chunk of a small bin is big enough; a large bin
+         gives the smallest of its chunks that is */
+      HeapMgr_lockBin(oHeap, uIndex);
+      if (uIndex < (size_t)SMALL_BIN_COUNT)
+         oChunk = oHeap->aoBins[uIndex];
+      else
+         oChunk = HeapMgr_findInTree(oHeap, uIndex, uUnits);
+
+      if (oChunk != NULL)
+      {
+         (void)HeapMgr_removeFromList(oHeap, oChunk);
+         HeapMgr_setStatus(oHeap, oChunk, CHUNK_INUSE);
+      }
+      HeapMgr_unlockBin(oHeap, uIndex);
+
+      if (oChunk != NULL)
+         return oChunk;
+   }
+
+#ifndef HEAPMGR_THREADS
+   /* (4) the chunks of the fast bins may coalesce into one big
+      enough; look again once they have */
+   if ((oHeap == &oDefaultHeap) && (uFastBytes != 0))
+   {
+      HeapMgr_consolidate();
+      return HeapMgr_findChunk(oHeap, uUnits);
+   }
+#endif
+
+   /* (5) get more memory if needed */
+   return HeapMgr_growHeap(oHeap, uUnits);
+}
+
+void *HeapMgr_mallocIn(HeapMgr_T oHeap, size_t uBytes)
+{
+   size_t uUnits; /* units requested by client */
+   Chunk_T oChunk = NULL; /* chunk pntr to eventually return */
+   
+   assert(oHeap != NULL);
+
+   if (uBytes == 0)
+      return NULL;
+
+   /* (1) initialize */
+   HeapMgr_init(oHeap);
+   assert(HeapMgr_isValid(oHeap));
+   /* (2) determine units needed */
+   uUnits = Chunk_bytesToUnits(uBytes);
+
+   /* (3) find a big enough free chunk, getting more memory if
+      needed */
+   oChunk = HeapMgr_findChunk(oHeap, uUnits);
+   if (oChunk == NULL)
+   {
+      assert(HeapMgr_isValid(oHeap)); 
+      return NULL;
+   }
+
+   /* (4) use the chunk, splitting if it is too big */
+   (void)HeapMgr_useChunk(oHeap, oChunk, uUnits);
+
+   /* assert check is valid at trailing edge of malloc */
+   assert(HeapMgr_isValid(oHeap));
+   return Chunk_toPayload(oChunk);
+}
+
+void *HeapMgr_malloc(size_t uBytes)
+{
+   Chunk_T oChunk = NULL; /* chunk from the thread cache */
+   void *pv = NULL; /* object from a slab */
+
+   /* big chunks get mappings of their own */
+   if ((uBytes != 0) && (uBytes >= uMmapThreshold))
+   {
+      oChunk = HeapMgr_mapChunk(uBytes);
+      return (oChunk == NULL) ? NULL : Chunk_toPayload(oChunk);
+   }
+
+   /* small objects go in slabs, without headers */
+   pv = HeapMgr_mallocInSlab(uBytes);
+   if (pv != NULL)
+      return pv;
 
-   assert(Checker_isValid(oHeapStart, oHeapEnd, aoBins, IBINCOUNT));
+   /* small chunks come from the cache of the calling thread, without
+      a lock, if there is one */
+   if (uBytes != 0)
+      oChunk = HeapMgr_getCachedChunk(Chunk_bytesToUnits(uBytes));
+   if (oChunk != NULL)
+      return Chunk_toPayload(oChunk);
+
+   return HeapMgr_mallocIn(&oDefaultHeap, uBytes);
+}
+
+void HeapMgr_freeIn(HeapMgr_T oHeap, void *pv)
+{
+   assert(oHeap != NULL);
+
+   if (pv == NULL)
+      return;
+
+   assert(HeapMgr_isValid(oHeap));
+   assert(((Chunk_T)pv > oHeap->oHeapStart) &&
+          ((Chunk_T)pv < oHeap->oHeapEnd));
+   /* (0) get the chunk from payload and free it */
+   HeapMgr_freeChunk(oHeap, Chunk_fromPayload(pv));
+
+   assert(HeapMgr_isValid(oHeap));
    return;
 }
+
+void HeapMgr_free(void *pv)
+{
+   /* objects in slabs go back to their slabs */
+   if ((pv != NULL) && HeapMgr_freeIfInSlab(pv))
+      return;
+
+   /* small chunks go to the cache of the calling thread, if there is
+      one */
+   if ((pv != NULL) && HeapMgr_cacheChunk(Chunk_fromPayload(pv)))
+      return;
+
+   /* big chunks give their mappings back to the OS */
+   if ((pv != NULL) && HeapMgr_unmapIfMapped(Chunk_fromPayload(pv)))
+      return;
+
+   HeapMgr_freeIn(&oDefaultHeap, pv);
+}
+
+void *HeapMgr_realloc(void *pv, size_t uBytes)
+{
+   HeapMgr_T oHeap = &oDefaultHeap; /* the heap to use */
+   size_t uUnits; /* units requested by client */
+   size_t uOldUnits; /* units in the chunk before resizing */
+   Chunk_T oChunk = NULL; /* chunk that owns payload pv */
+   Chunk_T oNew = NULL; /* new memory at the end of the heap */
+   void *pvNew = NULL; /* payload of the new chunk when copying */
+
+   if (pv == NULL)
+      return HeapMgr_malloc(uBytes);
+   if (uBytes == 0)
+   {
+      HeapMgr_free(pv);
+      return NULL;
+   }
+
+   /* an object in a slab keeps its size, so it moves to grow */
+   if (HeapMgr_isInSlab(pv))
+   {
+      if (uBytes <= HeapMgr_getSlabBytes(pv))
+         return pv;
+      return HeapMgr_moveChunk(pv, HeapMgr_getSlabBytes(pv), uBytes);
+   }
+
+   assert(HeapMgr_isValid(oHeap));
+   /* (0) get the chunk from payload */
+   oChunk = Chunk_fromPayload(pv);
+   assert(Chunk_getStatus(oChunk) == CHUNK_INUSE);
+   uUnits = Chunk_bytesToUnits(uBytes);
+   uOldUnits = Chunk_getUnits(oChunk);
+
+   /* (1) a chunk in a page of a thread keeps its size, so it moves
+      to grow, and a chunk with a mapping of its own is remapped */
+   if (HeapMgr_isInPage(oChunk))
+   {
+      if (uUnits <= uOldUnits)
+         return pv;
+      return HeapMgr_moveChunk(pv,
+         Chunk_unitsToPayloadBytes(uOldUnits), uBytes);
+   }
+   if (HeapMgr_isMapped(oChunk))
+      return HeapMgr_remapChunk(oChunk, uBytes);
+
+   /* (2) shrink in place, giving the tail back to the bins */
+   if (uUnits <= uOldUnits)
+   {
+      HeapMgr_shrinkInUse(oHeap, oChunk, uUnits);
+      assert(HeapMgr_isValid(oHeap));
+      return pv;
+   }
+
+   /* (3) the chunk can grow into the next chunk in memory if free */
+   (void)HeapMgr_coalesceForward(oHeap, oChunk);
+
+   /* (4) if that is not enough but nothing else lies between the
+      chunk and the heap end, move the break for the rest, unless the
+      chunk grows big enough for a mapping of its own */
+   if ((Chunk_getUnits(oChunk) < uUnits) &&
+       (uBytes < uMmapThreshold) &&
+       (Chunk_getNextInMem(oChunk, oHeap->oHeapEnd) == NULL))
+   {
+      oNew = HeapMgr_growHeap(oHeap, uUnits - Chunk_getUnits(oChunk));
+
+      /* another thread may have moved the break in between */
+      if (oNew == Chunk_getNextInMem(oChunk, oHeap->oHeapEnd))
+         HeapMgr_merge(oHeap, oChunk, oNew);
+      else if (oNew != NULL)
+         HeapMgr_freeChunk(oHeap, oNew);
+   }
+
+   /* (5) grow in place, then give back excess */
+   if (Chunk_getUnits(oChunk) >= uUnits)
+   {
+      HeapMgr_shrinkInUse(oHeap, oChunk, uUnits);
+      (void)HeapMgr_markUsed(oHeap, oChunk);
+      assert(HeapMgr_isValid(oHeap));
+      return pv;
+   }
+
+   /* (6) fall back to moving the contents to a new chunk */
+   pvNew = HeapMgr_moveChunk(pv, Chunk_unitsToPayloadBytes(uOldUnits),
+                             uBytes);
+   if (pvNew == NULL)
+   {
+      /* give back what the chunk took in */
+      HeapMgr_shrinkInUse(oHeap, oChunk, uOldUnits);
+      assert(HeapMgr_isValid(oHeap));
+   }
+   return pvNew;
+}
+
+void *HeapMgr_calloc(size_t uCount, size_t uBytes)
+{
+   HeapMgr_T oHeap = &oDefaultHeap; /* the heap to use */
+   size_t uTotalBytes; /* bytes requested by client */
+   size_t uUnits; /* units requested by client */
+   Chunk_T oChunk = NULL; /* chunk pntr to eventually return */
+   char *pcFresh; /* payload bytes from here on are already zero */
+   char *pcPayload; /* payload to eventually return */
+   void *pv = NULL; /* object from a slab */
+
+   if ((uCount == 0) || (uBytes == 0))
+      return NULL;
+
+   /* Check for overflow */
+   if (uCount > ((size_t)-1) / uBytes)
+      return NULL;
+   uTotalBytes = uCount * uBytes;
+
+   /* big chunks get mappings of their own, which are zero already */
+   if (uTotalBytes >= uMmapThreshold)
+   {
+      oChunk = HeapMgr_mapChunk(uTotalBytes);
+      return (oChunk == NULL) ? NULL : Chunk_toPayload(oChunk);
+   }
+
+   /* small objects go in slabs, whose memory is recycled */
+   pv = HeapMgr_mallocInSlab(uTotalBytes);
+   if (pv != NULL)
+   {
+      memset(pv, 0, uTotalBytes);
+      return pv;
+   }
+
+   /* (1) initialize */
+   HeapMgr_init(oHeap);
+   assert(HeapMgr_isValid(oHeap));
+   /* (2) determine units needed */
+   uUnits = Chunk_bytesToUnits(uTotalBytes);
+
+   /* (3) find a big enough free chunk, getting more memory if
+      needed */
+   oChunk = HeapMgr_findChunk(oHeap, uUnits);
+   if (oChunk == NULL)
+   {
+      assert(HeapMgr_isValid(oHeap));
+      return NULL;
+   }
+
+   /* (4) use the chunk, noting where fresh memory started before:
+      the part of the chunk carved from there holds zeros past its
+      header */
+   pcFresh = (char*)HeapMgr_useChunk(oHeap, oChunk, uUnits) +
+             Chunk_unitsToBytes(1);
+   pcPayload = (char*)Chunk_toPayload(oChunk);
+
+   /* zero only the part of the payload that was recycled */
+   if (pcPayload < pcFresh)
+   {
+      if ((size_t)(pcFresh - pcPayload) < uTotalBytes)
+         uTotalBytes = (size_t)(pcFresh - pcPayload);
+      memset(pcPayload, 0, uTotalBytes);
+   }
+
+   assert(HeapMgr_isValid(oHeap));
+   return pcPayload;
+}
+
+void *HeapMgr_memalign(size_t uAlignment, size_t uBytes)
+{
+   HeapMgr_T oHeap = &oDefaultHeap; /* the heap to use */
+   size_t uUnits; /* units requested by client */
+   size_t uUnitBytes; /* bytes per unit */
+   size_t uGapBytes; /* bytes from the chunk to the aligned chunk */
+   Chunk_T oChunk = NULL; /* chunk pntr to eventually return */
+   Chunk_T oLead = NULL; /* the gap in front of the aligned chunk */
+
+   if (uBytes == 0)
+      return NULL;
+
+   /* the alignment must be a power of two */
+   if ((uAlignment == 0) || ((uAlignment & (uAlignment - 1)) != 0))
+      return NULL;
+
+   /* every payload is aligned to a unit already */
+   uUnitBytes = Chunk_unitsToBytes(1);
+   if (uAlignment <= uUnitBytes)
+      return HeapMgr_malloc(uBytes);
+
+   /* big chunks get mappings of their own, with room to align them */
+   if ((uBytes >= uMmapThreshold) ||
+       (uAlignment >= uMmapThreshold - uBytes))
+   {
+      oChunk = HeapMgr_mapAlignedChunk(uAlignment, uBytes);
+      return (oChunk == NULL) ? NULL : Chunk_toPayload(oChunk);
+   }
+
+   /* (1) initialize */
+   HeapMgr_init(oHeap);
+   assert(HeapMgr_isValid(oHeap));
+   /* (2) determine units needed */
+   uUnits = Chunk_bytesToUnits(uBytes);
+
+   /* (3) find a chunk with room for the request behind a gap that is
+      big enough to be a chunk of its own */
+   oChunk = HeapMgr_findChunk(oHeap, uUnits + uAlignment / uUnitBytes
+                              + MIN_UNITS_PER_CHUNK);
+   if (oChunk == NULL)
+   {
+      assert(HeapMgr_isValid(oHeap));
+      return NULL;
+   }
+
+   /* (4) split the gap in front of the first aligned payload off as
+      a free chunk */
+   uGapBytes = (uAlignment -
+                ((size_t)Chunk_toPayload(oChunk) % uAlignment))
+               % uAlignment;
+   if (uGapBytes != 0)
+   {
+      while (uGapBytes < Chunk_unitsToBytes(MIN_UNITS_PER_CHUNK))
+         uGapBytes += uAlignment;
+      oLead = oChunk;
+      oChunk = HeapMgr_splitGetTail(oHeap, oLead,
+                                    uGapBytes / uUnitBytes);
+      HeapMgr_freeChunk(oHeap, oLead);
+   }
+   assert((size_t)Chunk_toPayload(oChunk) % uAlignment == 0);
+
+   /* (5) give the rest of the chunk back to the bins */
+   HeapMgr_shrinkInUse(oHeap, oChunk, uUnits);
+   (void)HeapMgr_markUsed(oHeap, oChunk);
+
+   assert(HeapMgr_isValid(oHeap));
+   return Chunk_toPayload(oChunk);
+}
+
+int HeapMgr_posixMemalign(void **ppv, size_t uAlignment, size_t uBytes)
+{
+   void *pv = NULL; /* payload to eventually return */
+
+   assert(ppv != NULL);
+
+   /* the alignment must be a power of two multiple of sizeof(void*) */
+   if ((uAlignment % sizeof(void*) != 0) ||
+       ((uAlignment & (uAlignment - 1)) != 0) || (uAlignment == 0))
+      return EINVAL;
+
+   if (uBytes != 0)
+   {
+      pv = HeapMgr_memalign(uAlignment, uBytes);
+      if (pv == NULL)
+         return ENOMEM;
+   }
+   *ppv = pv;
+   return 0;
+}
+
+size_t HeapMgr_mallocBatch(size_t uBytes, size_t uCount, void *apv[])
+{
+   HeapMgr_T oHeap = &oDefaultHeap; /* the heap to use */
+   size_t uUnits; /* units per chunk requested by client */
+   size_t uLeftUnits; /* units of the big chunk not yet handed out */
+   size_t i;
+   Chunk_T oChunk = NULL; /* the next chunk to hand out */
+   Chunk_T oNext = NULL; /* the chunk following oChunk */
+
+   assert(apv != NULL);
+
+   if ((uBytes == 0) || (uCount == 0))
+      return 0;
+
+   /* (1) initialize */
+   HeapMgr_init(oHeap);
+   assert(HeapMgr_isValid(oHeap));
+   /* (2) determine units needed */
+   uUnits = Chunk_bytesToUnits(uBytes);
+
+   /* (3) find one free chunk big enough for the whole batch, getting
+      more memory for all of it at once if needed */
+   if (uCount <= ((size_t)-1) / Chunk_unitsToBytes(uUnits))
+      oChunk = HeapMgr_findChunk(oHeap, uUnits * uCount);
+
+   /* if there is none, allocate the chunks one at a time */
+   if (oChunk == NULL)
+   {
+      for (i = 0; i < uCount; i++)
+      {
+         apv[i] = HeapMgr_mallocIn(oHeap, uBytes);
+         if (apv[i] == NULL)
+            break;
+      }
+      return i;
+   }
+
+   /* (4) carve the batch off the front of the chunk in one pass; each
+      piece is set in use before its size shows */
+   uLeftUnits = Chunk_getUnits(oChunk);
+   HeapMgr_startChange();
+   for (i = 0; i < uCount; i++)
+   {
+      uLeftUnits -= uUnits;
+      oNext = (Chunk_T)((char*)oChunk + Chunk_unitsToBytes(uUnits));
+
+      /* the last chunk keeps a remainder too small to split off */
+      Chunk_setStatus(oChunk, CHUNK_INUSE);
+      if ((i == uCount - 1) && (uLeftUnits < SPLIT_THRESHOLD))
+      {
+         Chunk_setUnits(oChunk, uUnits + uLeftUnits);
+         uLeftUnits = 0;
+      }
+      else
+      {
+         Chunk_setUnits(oChunk, uUnits);
+         HeapMgr_setStatusBefore(oHeap, oNext, CHUNK_INUSE);
+      }
+      apv[i] = Chunk_toPayload(oChunk);
+
+      if (i < uCount - 1)
+         oChunk = oNext;
+   }
+   (void)HeapMgr_markUsed(oHeap, oChunk);
+
+   /* (5) give the remainder back to the bins */
+   if (uLeftUnits > 0)
+   {
+      Chunk_setStatus(oNext, CHUNK_INUSE);
+      Chunk_setUnits(oNext, uLeftUnits);
+   }
+   HeapMgr_endChange();
+   if (uLeftUnits > 0)
+      HeapMgr_freeChunk(oHeap, oNext);
+
+   assert(HeapMgr_isValid(oHeap));
+   return uCount;
+}
+
+void HeapMgr_freeBatch(void *apv[], size_t uCount)
+{
+   HeapMgr_T oHeap = &oDefaultHeap; /* the heap to use */
+   size_t i;
+   size_t uRunUnits; /* units in the run of chunks starting at oRun */
+   Chunk_T oRun = NULL; /* first chunk of a run adjacent in memory */
+   Chunk_T oChunk = NULL; /* the chunk following the run so far */
+
+   assert(apv != NULL);
+   assert(HeapMgr_isValid(oHeap));
+
+   /* (0) objects in slabs go back to their slabs, chunks in pages of
+      threads to their pages, and chunks with mappings of their own to
+      the OS */
+   for (i = 0; i < uCount; i++)
+      if ((apv[i] != NULL) &&
+          (HeapMgr_freeIfInSlab(apv[i]) ||
+           HeapMgr_freeIfInPage(Chunk_fromPayload(apv[i])) ||
+           HeapMgr_unmapIfMapped(Chunk_fromPayload(apv[i]))))
+         apv[i] = NULL;
+
+   /* (1) sort by address, so that chunks adjacent in memory are
+      adjacent in apv; NULL elements sort first */
+   qsort(apv, uCount, sizeof(void*), HeapMgr_compareAddresses);
+
+   i = 0;
+   while ((i < uCount) && (apv[i] == NULL))
+      i++;
+
+   while (i < uCount)
+   {
+      /* (2) merge each run of chunks that follow one another in
+         memory into a single in use chunk */
+      oRun = Chunk_fromPayload(apv[i]);
+      uRunUnits = Chunk_getUnits(oRun);
+      for (i++; i < uCount; i++)
+      {
+         oChunk = Chunk_fromPayload(apv[i]);
+         if ((char*)oChunk !=
+             (char*)oRun + Chunk_unitsToBytes(uRunUnits))
+            break;
+         assert(Chunk_getStatus(oChunk) == CHUNK_INUSE);
+         uRunUnits += Chunk_getUnits(oChunk);
+      }
+      HeapMgr_startChange();
+      Chunk_setUnits(oRun, uRunUnits);
+      HeapMgr_endChange();
+
+      /* (3) free the run, touching the Free list only once */
+      HeapMgr_freeChunk(oHeap, oRun);
+   }
+
+   assert(HeapMgr_isValid(oHeap));
+}
+
+size_t HeapMgr_usableSize(void *pv)
+{
+   Chunk_T oChunk = NULL; /* chunk that owns payload pv */
+
+   if (pv == NULL)
+      return 0;
+
+   if (HeapMgr_isInSlab(pv))
+      return HeapMgr_getSlabBytes(pv);
+
+   oChunk = Chunk_fromPayload(pv);
+   assert(Chunk_getStatus(oChunk) == CHUNK_INUSE);
+   return Chunk_unitsToPayloadBytes(Chunk_getUnits(oChunk));
+}
+
+size_t HeapMgr_goodSize(size_t uBytes)
+{
+   size_t uClass; /* the slab class of an object of uBytes bytes */
+
+   if (uBytes == 0)
+      return 0;
+
+   /* an object in a slab holds the bytes of its class, which may be
+      fewer than the payload of the smallest chunk */
+   uClass = (uBytes - 1) / Chunk_unitsToBytes(1);
+   if ((uBytes <= uSlabThreshold) &&
+       (uClass < (size_t)SLAB_CLASS_COUNT))
+      return Chunk_unitsToBytes(uClass + 1);
+   return Chunk_unitsToPayloadBytes(Chunk_bytesToUnits(uBytes));
+}
+
+void HeapMgr_freeSized(void *pv, size_t uBytes)
+{
+   HeapMgr_T oHeap = &oDefaultHeap; /* the heap to use */
+   Chunk_T oChunk = NULL; /* chunk that owns payload pv */
+
+   assert(pv != NULL);
+   assert(HeapMgr_isValid(oHeap));
+
+   /* an object in a slab has no header to check uBytes against */
+   assert((! HeapMgr_isInSlab(pv)) ||
+          (uBytes <= HeapMgr_getSlabBytes(pv)));
+   if (HeapMgr_freeIfInSlab(pv))
+      return;
+
+   /* (0) get the chunk from payload */
+   oChunk = Chunk_fromPayload(pv);
+   assert(Chunk_getUnits(oChunk) >= Chunk_bytesToUnits(uBytes));
+
+#ifndef HEAPMGR_PAGES
+   /* every in use chunk of the heap was cut to the units its size
+      needs, give or take a remainder too small to split off, so a
+      small one goes to the cache by the units of uBytes, without
+      loading its header; one at the free end of the heap waits
+      there for the next consolidation, as its neighbor goes unread */
+   if ((! HeapMgr_isMapped(oChunk)) &&
+       HeapMgr_cacheUnits(oChunk, Chunk_bytesToUnits(uBytes)))
+      return;
+#else
+   if (HeapMgr_cacheChunk(oChunk))
+      return;
+#endif
+
+   /* a chunk with a mapping of its own spans whole pages */
+   if (HeapMgr_unmapIfMapped(oChunk))
+      return;
+
+   /* so uBytes must lead to nearly the units in the header of every
+      other chunk too */
+   assert(Chunk_getUnits(oChunk) - Chunk_bytesToUnits(uBytes)
+          < SPLIT_THRESHOLD);
+   (void)uBytes;
+
+   HeapMgr_freeChunk(oHeap, oChunk);
+
+   assert(HeapMgr_isValid(oHeap));
+}
+
+HeapMgr_T HeapMgr_new(void)
+{
+   HeapMgr_T oHeap; /* heap to eventually return */
+   size_t uUnitBytes; /* bytes per unit */
+   size_t uHeaderBytes; /* bytes in front of the heap for its state */
+
+   /* reserve address space for the state and the heap after it; the
+      OS hands out zeroed pages, so all of it is fresh */
+   oHeap = (HeapMgr_T)mmap(NULL, (size_t)HEAP_RESERVE_BYTES,
+                           PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                           -1, 0);
+   if ((void*)oHeap == MAP_FAILED)
+      return NULL;
+
+   uUnitBytes = Chunk_unitsToBytes(1);
+   uHeaderBytes = ((sizeof(struct HeapMgr) + uUnitBytes - 1)
+                   / uUnitBytes) * uUnitBytes;
+   oHeap->oHeapStart = (Chunk_T)((char*)oHeap + uHeaderBytes
+                                 + Chunk_getStartOffset());
+   oHeap->oHeapEnd = oHeap->oHeapStart;
+   oHeap->oReserveEnd = (Chunk_T)((char*)oHeap + HEAP_RESERVE_BYTES);
+   oHeap->oFreshStart = oHeap->oHeapStart;
+#ifdef CHUNK_FOOTERLESS
+   oHeap->eLastStatus = CHUNK_INUSE;
+#endif
+#ifndef HEAPMGR_THREADS
+   oHeap->oLastRemainder = NULL;
+#endif
+
+   assert(HeapMgr_isValid(oHeap));
+   return oHeap;
+}
+
+void HeapMgr_destroy(HeapMgr_T oHeap)
+{
+   assert(oHeap != NULL);
+   assert(oHeap != &oDefaultHeap);
+   assert(HeapMgr_isValid(oHeap));
+
+   /* the state and every chunk go with the reservation */
+   (void)munmap(oHeap, (size_t)HEAP_RESERVE_BYTES);
+}
+
+int HeapMgr_getLockStats(HeapMgr_T oHeap, int iLock,
+                         struct HeapMgrLockStats *psStats)
+{
+   assert(psStats != NULL);
+
+   if (oHeap == NULL)
+      oHeap = &oDefaultHeap;
+
+#ifdef HEAPMGR_THREADS
+   if (iLock == 0)
+      *psStats = oHeap->sTopLock.sStats;
+   else if ((iLock > 0) && (iLock <= IBINCOUNT))
+      *psStats = oHeap->asBinLocks[iLock - 1].sStats;
+   else if ((oHeap == &oDefaultHeap) && (iLock > IBINCOUNT) &&
+            (iLock <= IBINCOUNT + SLAB_CLASS_COUNT))
+      *psStats = asSlabLocks[iLock - IBINCOUNT - 1].sStats;
+   else
+      return FALSE;
+   return TRUE;
+#else
+   (void)oHeap;
+   (void)iLock;
+   (void)psStats;
+   return FALSE;
+#endif
+}
+
+void HeapMgr_setMmapThreshold(size_t uBytes)
+{
+   uMmapThreshold = uBytes;
+}
+
+void HeapMgr_setSlabThreshold(size_t uBytes)
+{
+   uSlabThreshold = uBytes;
+}
+
+int HeapMgr_trim(size_t uPad)
+{
+   HeapMgr_T oHeap = &oDefaultHeap; /* the heap to use */
+   Chunk_T oChunk = NULL; /* the free chunk at the end of the heap */
+   Chunk_T oHeapEnd = NULL; /* the end of the heap before trimming */
+   size_t uIndex;
+   size_t uBytes; /* bytes in a free chunk */
+   int iReleased = FALSE;
+
+   if (oHeap->oHeapStart == NULL)
+      return FALSE;
+   assert(HeapMgr_isValidEvery(oHeap, 1UL));
+
+   /* (0) the empty slabs kept for the next small requests, and the
+      objects and chunks cached by the calling thread or kept in the
+      fast bins, may be what keeps the end of the heap in use */
+#ifdef HEAPMGR_THREADS
+   if (sSlabCache.iRegistered)
+      HeapMgr_flushSlabCaches(&sSlabCache);
+#endif
+   (void)HeapMgr_trimSlabs();
+#if defined(HEAPMGR_THREADS) && ! defined(HEAPMGR_PAGES)
+   if (sCache.iRegistered)
+      HeapMgr_flushAll(&sCache);
+#elif ! defined(HEAPMGR_THREADS)
+   HeapMgr_consolidate();
+#endif
+
+   /* (1) release the whole pages of every free chunk that has some;
+      the lock of its bin keeps it free meanwhile */
+   for (uIndex = HeapMgr_nextBin(oHeap, HeapMgr_getBinIndex(
+           Chunk_bytesToUnits((size_t)sysconf(_SC_PAGESIZE))));
+        uIndex < (size_t)IBINCOUNT;
+        uIndex = HeapMgr_nextBin(oHeap, uIndex + 1))
+   {
+      HeapMgr_lockBin(oHeap, uIndex);
+      for (oChunk = oHeap->aoBins[uIndex]; oChunk != NULL;
+           oChunk = Chunk_getNextInList(oChunk))
+      {
+         uBytes = Chunk_unitsToBytes(Chunk_getUnits(oChunk));
+         if (HeapMgr_releasePages(oChunk, (char*)oChunk,
+                                  (char*)oChunk + uBytes))
+            iReleased = TRUE;
+         HeapMgr_setFreeSince(oHeap, oChunk, (size_t)RELEASED);
+      }
+      HeapMgr_unlockBin(oHeap, uIndex);
+   }
+
+   /* (2) shrink the heap to uPad bytes past the last chunk in use;
+      the end must not move while the footer in front of it is read */
+   HeapMgr_lockTop(oHeap);
+   oHeapEnd = oHeap->oHeapEnd;
+   oChunk = HeapMgr_takePrevIfFree(oHeap, oHeapEnd);
+   HeapMgr_unlockTop(oHeap);
+   if (oChunk != NULL)
+   {
+      HeapMgr_freeAndTrim(oHeap, oChunk, 0, uPad);
+      if (oHeap->oHeapEnd < oHeapEnd)
+         iReleased = TRUE;
+   }
+
+   assert(HeapMgr_isValidEvery(oHeap, 1UL));
+   return iReleased;
+}
+
+int HeapMgr_startScavenger(unsigned long ulPeriodMillis,
+                           unsigned long ulAgeMillis)
+{
+#ifdef HEAPMGR_THREADS
+   static int iForkHandled = FALSE; /* TRUE once the child forgets */
+
+   if (iScavenging || (ulPeriodMillis == 0))
+      return FALSE;
+
+   /* the heap must exist before the thread looks at it */
+   HeapMgr_init(&oDefaultHeap);
+   if (! iForkHandled)
+   {
+      (void)pthread_atfork(NULL, NULL, HeapMgr_forgetScavenger);
+      iForkHandled = TRUE;
+   }
+
+   ulScavengePeriodNanos = (ulPeriodMillis % 1000UL) * 1000000UL +
+      (ulPeriodMillis / 1000UL) * (unsigned long)NANOS_PER_SECOND;
+   uScavengeAge = (size_t)((ulAgeMillis + ulPeriodMillis - 1)
+                           / ulPeriodMillis);
+   iScavengerStopping = FALSE;
+   if (pthread_create(&iScavenger, NULL, HeapMgr_scavenge, NULL) != 0)
+      return FALSE;
+   iScavenging = TRUE;
+   return TRUE;
+#else
+   (void)ulPeriodMillis;
+   (void)ulAgeMillis;
+   return FALSE;
+#endif
+}
+
+void HeapMgr_stopScavenger(void)
+{
+#ifdef HEAPMGR_THREADS
+   if (! iScavenging)
+      return;
+   iScavengerStopping = TRUE;
+   (void)pthread_join(iScavenger, NULL);
+   iScavenging = FALSE;
+#endif
+}
@@ -0,0 +1,444 @@
+/*--------------------------------------------------------------------*/
+/* heapmgr3.c                                                         */
+/* Author: Nate Wilson                                                */
+/* Author: Narek Galstyan                                             */
+/*--------------------------------------------------------------------*/
+
+/* A Two-Level Segregated Fit (TLSF) heap manager. Free chunks are
+   kept in lists by size class: a first level of powers of two, each
+   split into SL_COUNT equal second-level ranges. A bitmap per level
+   tells which classes hold chunks, so that both HeapMgr_malloc() and
+   HeapMgr_free() take a bounded number of steps, however many chunks
+   the heap holds. */
+
+#include "heapmgr.h"
+#include "checker3.h"
+#include "chunk.h"
+#include <stddef.h>
+#include <limits.h>
+#include <assert.h>
+
+#define __USE_XOPEN_EXTENDED
+#include <unistd.h>
+
+/* In lieu of a boolean data type. */
+enum {FALSE, TRUE};
+
+/* Minimum size of the free (logical) chunk to split */
+enum {SPLIT_THRESHOLD = 3};
+
+/* The minimum number of units to request of the OS. */
+enum {MIN_UNITS_FROM_OS = 512};
+
+/* The log2 of the number of second-level classes per first-level
+   class, and that number. Chunks of fewer than SL_COUNT units all
+   fall in first-level class 0, one class per size. */
+enum {SL_LOG2 = 4};
+enum {SL_COUNT = 1 << SL_LOG2};
+
+/* The number of first-level classes: class 0, and one for each
+   position of the leading bit of a size from SL_LOG2 up. */
+enum {FL_COUNT = (int)(sizeof(size_t) * CHAR_BIT) - SL_LOG2 + 1};
+
+/*--------------------------------------------------------------------*/
+
+/* The state of the HeapMgr. */
+
+/* The address of the start of the heap. */
+static Chunk_T oHeapStart = NULL;
+
+/* The address immediately beyond the end of the heap. */
+static Chunk_T oHeapEnd = NULL;
+
+/* The free lists, one per size class: list iSecond of first-level
+   class iFirst is aoLists[iFirst * SL_COUNT + iSecond]. */
+static Chunk_T aoLists[FL_COUNT * SL_COUNT];
+
+/* Bit iFirst of ulFirstMap is set if any list of first-level class
+   iFirst holds chunks, and bit iSecond of aulSecondMaps[iFirst] if
+   list iSecond of it does. */
+static unsigned long ulFirstMap = 0;
+static unsigned long aulSecondMaps[FL_COUNT];
+
+#ifdef CHUNK_FOOTERLESS
+/* The status of the last chunk in memory, which no header after it
+   records. */
+static enum ChunkStatus eLastStatus = CHUNK_INUSE;
+#endif
+
+/*--------------------------------------------------------------------*/
+
+/* Return the position of the leading bit of uUnits, which must not be
+   0. */
+static size_t HeapMgr_getLeadingBit(size_t uUnits)
+{
+   assert(uUnits != 0);
+
+   return sizeof(unsigned long) * CHAR_BIT - 1
+          - (size_t)__builtin_clzl((unsigned long)uUnits);
+}
+
+/* Set *puFirst and *puSecond to the first- and second-level classes
+ * of chunks of uUnits units.
+ */
+static void HeapMgr_getClass(size_t uUnits, size_t *puFirst,
+                             size_t *puSecond)
+{
+   size_t uLeadingBit; /* the position of the leading bit of uUnits */
+
+   assert(puFirst != NULL);
+   assert(puSecond != NULL);
+
+   if (uUnits < (size_t)SL_COUNT)
+   {
+      *puFirst = 0;
+      *puSecond = uUnits;
+      return;
+   }
+
+   /* the SL_LOG2 bits after the leading one pick the second level */
+   uLeadingBit = HeapMgr_getLeadingBit(uUnits);
+   *puFirst = uLeadingBit - (size_t)SL_LOG2 + 1;
+   *puSecond = (uUnits >> (uLeadingBit - (size_t)SL_LOG2))
+               - (size_t)SL_COUNT;
+}
+
+/* Return uUnits rounded up to the smallest size of a class whose
+ * chunks all have at least uUnits units, or 0 if there is no such
+ * size.
+ */
+static size_t HeapMgr_roundUp(size_t uUnits)
+{
+   size_t uStep; /* the range of sizes of the class of uUnits */
+
+   if (uUnits < (size_t)SL_COUNT)
+      return uUnits;
+
+   uStep = (size_t)1 << (HeapMgr_getLeadingBit(uUnits)
+                         - (size_t)SL_LOG2);
+   if (uUnits + (uStep - 1) < uUnits)
+      return 0;
+   return (uUnits + (uStep - 1)) & ~(uStep - 1);
+}
+
+/* Set the status of oChunk to eStatus. Without footers on chunks in
+ * use, record it in the header of the next chunk in memory as well,
+ * or in eLastStatus if there is none.
+ */
+static void HeapMgr_setStatus(Chunk_T oChunk, enum ChunkStatus eStatus)
+{
+#ifdef CHUNK_FOOTERLESS
+   Chunk_T oNextChunk; /* the next chunk in memory */
+#endif
+
+   Chunk_setStatus(oChunk, eStatus);
+
+#ifdef CHUNK_FOOTERLESS
+   oNextChunk = Chunk_getNextInMem(oChunk, oHeapEnd);
+   if (oNextChunk == NULL)
+      eLastStatus = eStatus;
+   else
+      Chunk_setPrevStatus(oNextChunk, eStatus);
+#endif
+}
+
+/*--------------------------------------------------------------------*/
+/* Request more memory from the operating system -- enough to store
+   uUnits units. Create a new chunk, and and return it. */
+static Chunk_T HeapMgr_getMoreMemory(size_t uUnits)
+{
+   Chunk_T oChunk; /* new chunk to build and return */
+   Chunk_T oNewHeapEnd; /* the heap end, once the break moves */
+   size_t uBytes; /* requested number of bytes */
+
+   /* always use at least 512 units */
+   if (uUnits < (size_t)MIN_UNITS_FROM_OS)
+      uUnits = (size_t)MIN_UNITS_FROM_OS;
+
+   /* Convert units to bytes. */
+   uBytes = Chunk_unitsToBytes(uUnits);
+
+   /* calculate address of potential new heap end*/
+   oNewHeapEnd = (Chunk_T)((char*)oHeapEnd + uBytes);
+
+   /* Check for overflow */
+   if (oNewHeapEnd < oHeapEnd)
+      return NULL;
+
+   /* Check that the heap stays within what its chunks can span */
+   if (uUnits > Chunk_getMaxUnits()
+                - (size_t)((char*)oHeapEnd - (char*)oHeapStart)
+                  / Chunk_unitsToBytes(1))
+      return NULL;
+
+   /* system call: move the program break and error check*/
+   if (brk(oNewHeapEnd) == -1)
+      return NULL;
+
+   /* select new chunk for returning */
+   oChunk = oHeapEnd;
+
+   /* update global var heap end */
+   oHeapEnd = oNewHeapEnd;
+
+   /* Set the fields of the new chunk. */
+   Chunk_setUnits(oChunk, uUnits);
+   Chunk_setNextInList(oChunk, NULL);
+   Chunk_setPrevInList(oChunk, NULL);
+#ifdef CHUNK_FOOTERLESS
+   Chunk_setPrevStatus(oChunk, eLastStatus);
+#endif
+
+   return oChunk;
+}
+
+/* Add oChunk, a free chunk, to the front of the list of its class. */
+static void HeapMgr_addToList(Chunk_T oChunk)
+{
+   size_t uFirst; /* the first-level class of oChunk */
+   size_t uSecond; /* the second-level class of oChunk */
+   Chunk_T *poList; /* the list of the class */
+
+   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
+   assert(Chunk_getStatus(oChunk) == CHUNK_FREE);
+
+   HeapMgr_getClass(Chunk_getUnits(oChunk), &uFirst, &uSecond);
+   poList = &aoLists[uFirst * (size_t)SL_COUNT + uSecond];
+
+   /* link oChunk in front of the old front */
+   Chunk_setNextInList(oChunk, *poList);
+   Chunk_setPrevInList(oChunk, NULL);
+   if (*poList != NULL)
+      Chunk_setPrevInList(*poList, oChunk);
+   *poList = oChunk;
+
+   /* the class holds chunks now */
+   aulSecondMaps[uFirst] |= 1UL << uSecond;
+   ulFirstMap |= 1UL << uFirst;
+}
+
+/* Remove oChunk, a free chunk, from the list of its class. */
+static void HeapMgr_removeFromList(Chunk_T oChunk)
+{
+   size_t uFirst; /* the first-level class of oChunk */
+   size_t uSecond; /* the second-level class of oChunk */
+   Chunk_T *poList; /* the list of the class */
+   Chunk_T oPrevChunk; /* previous chunk in list */
+   Chunk_T oNextChunk; /* next chunk in list */
+
+   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
+
+   HeapMgr_getClass(Chunk_getUnits(oChunk), &uFirst, &uSecond);
+   poList = &aoLists[uFirst * (size_t)SL_COUNT + uSecond];
+   assert(*poList != NULL);
+
+   /* unlink oChunk from its neighbors in the list */
+   oPrevChunk = Chunk_getPrevInList(oChunk);
+   oNextChunk = Chunk_getNextInList(oChunk);
+   if (oPrevChunk == NULL)
+      *poList = oNextChunk;
+   else
+      Chunk_setNextInList(oPrevChunk, oNextChunk);
+   if (oNextChunk != NULL)
+      Chunk_setPrevInList(oNextChunk, oPrevChunk);
+   Chunk_setNextInList(oChunk, NULL);
+   Chunk_setPrevInList(oChunk, NULL);
+
+   /* the class may be empty now */
+   if (*poList == NULL)
+   {
+      aulSecondMaps[uFirst] &= ~(1UL << uSecond);
+      if (aulSecondMaps[uFirst] == 0)
+         ulFirstMap &= ~(1UL << uFirst);
+   }
+}
+
+/* Take a chunk of at least uUnits units out of the free lists, and
+ * return it, or NULL if there is none. Look only in classes all of
+ * whose chunks are big enough, so that the first chunk of the first
+ * one that holds any will do.
+ */
+static Chunk_T HeapMgr_findChunk(size_t uUnits)
+{
+   size_t uFirst; /* the first-level class to look in */
+   size_t uSecond; /* the second-level class to look in */
+   unsigned long ulMap; /* the classes to look in that hold chunks */
+   Chunk_T oChunk;
+
+   /* (1) the smallest class whose chunks all fit */
+   uUnits = HeapMgr_roundUp(uUnits);
+   if (uUnits == 0)
+      return NULL;
+   HeapMgr_getClass(uUnits, &uFirst, &uSecond);
+
+   /* (2) the first class from there on in its first-level class, or
+      else the first class of the next first-level class with any */
+   ulMap = aulSecondMaps[uFirst] & (~0UL << uSecond);
+   if (ulMap == 0)
+   {
+      if (uFirst + 1 == (size_t)FL_COUNT)
+         return NULL;
+      ulMap = ulFirstMap & (~0UL << (uFirst + 1));
+      if (ulMap == 0)
+         return NULL;
+      uFirst = (size_t)__builtin_ctzl(ulMap);
+      ulMap = aulSecondMaps[uFirst];
+   }
+   uSecond = (size_t)__builtin_ctzl(ulMap);
+
+   /* (3) its first chunk */
+   oChunk = aoLists[uFirst * (size_t)SL_COUNT + uSecond];
+   assert(oChunk != NULL);
+   HeapMgr_removeFromList(oChunk);
+   return oChunk;
+}
+
+/* Split oChunk into two valid logical Chunks, the first of which has
+ * length uUnits and the second having the rest of the physical chunks.
+ * Return tail.
+ * The status bit of the tail is undefined.
+ * The lengths of the two Chunks are reset.
+ */
+static Chunk_T HeapMgr_splitGetTail(Chunk_T oChunk, size_t uUnits)
+{
+   Chunk_T oTail; /* tail end of split oChunk */
+   size_t uTotalUnits; /* total units of chunk before split */
+
+   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
+
+   uTotalUnits = Chunk_getUnits(oChunk);
+   assert(uTotalUnits > uUnits);
+
+   oTail = (Chunk_T)((char*)oChunk + Chunk_unitsToBytes(uUnits));
+   Chunk_setUnits(oTail, uTotalUnits - uUnits);
+   Chunk_setUnits(oChunk, uUnits);
+#ifdef CHUNK_FOOTERLESS
+   Chunk_setPrevStatus(oTail, Chunk_getStatus(oChunk));
+#endif
+
+   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
+   assert(Chunk_isValid(oTail, oHeapStart, oHeapEnd));
+   assert(Chunk_getNextInMem(oChunk, oHeapEnd) == oTail);
+
+   return oTail;
+}
+
+/* Merge oChunk with the chunks next to it in memory that are free,
+ * taking them out of the free lists. oChunk must be out of them.
+ * Return the merged chunk, whose status is that of oChunk.
+ */
+static Chunk_T HeapMgr_coalesce(Chunk_T oChunk)
+{
+   Chunk_T oNext; /* the next chunk in memory */
+   Chunk_T oPrev; /* the previous chunk in memory */
+   size_t uUnits; /* units in the merged chunk */
+
+   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
+
+   uUnits = Chunk_getUnits(oChunk);
+
+   /* (1) forward */
+   oNext = Chunk_getNextInMem(oChunk, oHeapEnd);
+   if ((oNext != NULL) && (Chunk_getStatus(oNext) == CHUNK_FREE))
+   {
+      HeapMgr_removeFromList(oNext);
+      uUnits += Chunk_getUnits(oNext);
+   }
+
+   /* (2) backward */
+   oPrev = Chunk_getPrevInMem(oChunk, oHeapStart);
+   if ((oPrev != NULL) && (Chunk_getStatus(oPrev) == CHUNK_FREE))
+   {
+      HeapMgr_removeFromList(oPrev);
+      uUnits += Chunk_getUnits(oPrev);
+      Chunk_setStatus(oPrev, Chunk_getStatus(oChunk));
+      oChunk = oPrev;
+   }
+
+   Chunk_setUnits(oChunk, uUnits);
+   return oChunk;
+}
+
+/*--------------------------------------------------------------------*/
+
+void *HeapMgr_malloc(size_t uBytes)
+{
+   size_t uUnits; /* units requested */
+   Chunk_T oChunk = NULL; /* memory chunk to eventually return */
+   Chunk_T oTail = NULL; /* the part of oChunk left over */
+
+   /* can't request 0 bytes */
+   if (uBytes == 0)
+      return NULL;
+
+   /* (1) initialize */
+   if (oHeapStart == NULL)
+   {
+      /* start where the payload of a chunk is aligned to a unit */
+      char *pcBreak = (char*)sbrk(0);
+      size_t uUnitBytes = Chunk_unitsToBytes(1);
+      oHeapStart = (Chunk_T)(pcBreak +
+         (Chunk_getStartOffset() + uUnitBytes
+          - (size_t)pcBreak % uUnitBytes) % uUnitBytes);
+      oHeapEnd = oHeapStart;
+   }
+   assert(Checker_isValid(oHeapStart, oHeapEnd, aoLists, ulFirstMap,
+                          aulSecondMaps, FL_COUNT, SL_LOG2));
+
+   /* (2) determine units needed */
+   uUnits = Chunk_bytesToUnits(uBytes);
+
+   /* (3) take a chunk from the free lists, or get more memory and
+      merge it with the free chunk before it, if any */
+   oChunk = HeapMgr_findChunk(uUnits);
+   if (oChunk == NULL)
+   {
+      oChunk = HeapMgr_getMoreMemory(uUnits);
+      if (oChunk == NULL)
+      {
+         assert(Checker_isValid(oHeapStart, oHeapEnd, aoLists,
+                                ulFirstMap, aulSecondMaps, FL_COUNT,
+                                SL_LOG2));
+         return NULL;
+      }
+      HeapMgr_setStatus(oChunk, CHUNK_INUSE);
+      oChunk = HeapMgr_coalesce(oChunk);
+   }
+   HeapMgr_setStatus(oChunk, CHUNK_INUSE);
+
+   /* (4) give back the rest of the chunk if it is too big */
+   if (Chunk_getUnits(oChunk) - uUnits >= (size_t)SPLIT_THRESHOLD)
+   {
+      oTail = HeapMgr_splitGetTail(oChunk, uUnits);
+      HeapMgr_setStatus(oTail, CHUNK_FREE);
+      HeapMgr_addToList(oTail);
+   }
+
+   assert(Checker_isValid(oHeapStart, oHeapEnd, aoLists, ulFirstMap,
+                          aulSecondMaps, FL_COUNT, SL_LOG2));
+   return Chunk_toPayload(oChunk);
+}
+
+void HeapMgr_free(void *pv)
+{
+   Chunk_T oChunk = NULL; /* logical chunk that owns payload pv */
+
+   if (pv == NULL)
+      return;
+
+   assert(Checker_isValid(oHeapStart, oHeapEnd, aoLists, ulFirstMap,
+                          aulSecondMaps, FL_COUNT, SL_LOG2));
+
+   /* (1) get the chunk from payload */
+   oChunk = Chunk_fromPayload(pv);
+   assert(Chunk_getStatus(oChunk) == CHUNK_INUSE);
+
+   /* (2) merge it with its free neighbors, and add the result to the
+      list of its class */
+   oChunk = HeapMgr_coalesce(oChunk);
+   HeapMgr_setStatus(oChunk, CHUNK_FREE);
+   HeapMgr_addToList(oChunk);
+
+   assert(Checker_isValid(oHeapStart, oHeapEnd, aoLists, ulFirstMap,
+                          aulSecondMaps, FL_COUNT, SL_LOG2));
+}
@@ -0,0 +1,306 @@
+/*--------------------------------------------------------------------*/
+/* heapmgr4.c                                                         */
+/* Author: Nate Wilson                                                */
+/* Author: Narek Galstyan                                             */
+/*--------------------------------------------------------------------*/
+
+/* A binary buddy heap manager. Every chunk has a power-of-two number
+   of units, 2^k for its order k, and starts at an offset from the
+   start of the heap that is a multiple of that number. The buddy of a
+   chunk, which it splits from and merges with, is then at the offset
+   with bit k flipped, so merging reads only headers, never footers.
+   Free chunks are kept in a list per order, and a bitmap tells which
+   lists hold chunks. */
+
+#include "heapmgr.h"
+#include "checker4.h"
+#include "chunk.h"
+#include <stddef.h>
+#include <limits.h>
+#include <assert.h>
+
+#define __USE_XOPEN_EXTENDED
+#include <unistd.h>
+
+/* In lieu of a boolean data type. */
+enum {FALSE, TRUE};
+
+/* The number of orders: one for each bit of a number of units. */
+enum {ORDER_COUNT = (int)(sizeof(size_t) * CHAR_BIT)};
+
+/* The order of the smallest chunk: the least that holds
+   MIN_UNITS_PER_CHUNK units. */
+enum {MIN_ORDER = 2};
+
+/* The order of the smallest chunk to request of the OS. */
+enum {MIN_ORDER_FROM_OS = 9};
+
+/*--------------------------------------------------------------------*/
+
+/* The state of the HeapMgr. */
+
+/* The address of the start of the heap. */
+static Chunk_T oHeapStart = NULL;
+
+/* The address immediately beyond the end of the heap. */
+static Chunk_T oHeapEnd = NULL;
+
+/* The free lists, one per order. */
+static Chunk_T aoLists[ORDER_COUNT];
+
+/* Bit k of ulOrderMap is set if list k holds chunks. */
+static unsigned long ulOrderMap = 0;
+
+/*--------------------------------------------------------------------*/
+
+/* Return the order of the smallest chunk that holds uUnits units, or
+ * ORDER_COUNT if there is none.
+ */
+static size_t HeapMgr_getOrder(size_t uUnits)
+{
+   if (uUnits <= (size_t)1 << MIN_ORDER)
+      return (size_t)MIN_ORDER;
+
+   /* one past the position of the leading bit of uUnits - 1 */
+   return sizeof(unsigned long) * CHAR_BIT
+          - (size_t)__builtin_clzl((unsigned long)(uUnits - 1));
+}
+
+/* Return the offset of oChunk from the start of the heap, in
+ * units.
+ */
+static size_t HeapMgr_getOffset(Chunk_T oChunk)
+{
+   return (size_t)((char*)oChunk - (char*)oHeapStart)
+          / Chunk_unitsToBytes(1);
+}
+
+/* Return the chunk at uOffset units from the start of the heap. */
+static Chunk_T HeapMgr_atOffset(size_t uOffset)
+{
+   return (Chunk_T)((char*)oHeapStart + Chunk_unitsToBytes(uOffset));
+}
+
+/* Add oChunk, a free chunk of order uOrder, to the front of its
+ * list.
+ */
+static void HeapMgr_addToList(Chunk_T oChunk, size_t uOrder)
+{
+   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
+   assert(Chunk_getStatus(oChunk) == CHUNK_FREE);
+   assert(Chunk_getUnits(oChunk) == (size_t)1 << uOrder);
+
+   Chunk_setNextInList(oChunk, aoLists[uOrder]);
+   Chunk_setPrevInList(oChunk, NULL);
+   if (aoLists[uOrder] != NULL)
+      Chunk_setPrevInList(aoLists[uOrder], oChunk);
+   aoLists[uOrder] = oChunk;
+   ulOrderMap |= 1UL << uOrder;
+}
+
+/* Remove oChunk, a free chunk of order uOrder, from its list. */
+static void HeapMgr_removeFromList(Chunk_T oChunk, size_t uOrder)
+{
+   Chunk_T oPrevChunk; /* previous chunk in list */
+   Chunk_T oNextChunk; /* next chunk in list */
+
+   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
+   assert(Chunk_getUnits(oChunk) == (size_t)1 << uOrder);
+
+   oPrevChunk = Chunk_getPrevInList(oChunk);
+   oNextChunk = Chunk_getNextInList(oChunk);
+   if (oPrevChunk == NULL)
+      aoLists[uOrder] = oNextChunk;
+   else
+      Chunk_setNextInList(oPrevChunk, oNextChunk);
+   if (oNextChunk != NULL)
+      Chunk_setPrevInList(oNextChunk, oPrevChunk);
+   Chunk_setNextInList(oChunk, NULL);
+   Chunk_setPrevInList(oChunk, NULL);
+
+   if (aoLists[uOrder] == NULL)
+      ulOrderMap &= ~(1UL << uOrder);
+}
+
+/* Free oChunk, a chunk of order uOrder: merge it with its buddy for
+ * as long as the buddy is a free chunk of the same order, and add the
+ * result to the list of its order.
+ */
+static void HeapMgr_release(Chunk_T oChunk, size_t uOrder)
+{
+   size_t uOffset; /* the offset of oChunk */
+   Chunk_T oBuddy; /* the buddy of oChunk */
+
+   assert(Chunk_isValid(oChunk, oHeapStart, oHeapEnd));
+
+   uOffset = HeapMgr_getOffset(oChunk);
+   for (; uOrder + 1 < (size_t)ORDER_COUNT; uOrder++)
+   {
+      /* the buddy starts a chunk, unless it is past the heap end, as
+         no chunk of a higher order can hold it without oChunk */
+      oBuddy = HeapMgr_atOffset(uOffset ^ ((size_t)1 << uOrder));
+      if ((oBuddy >= oHeapEnd) ||
+          (Chunk_getStatus(oBuddy) != CHUNK_FREE) ||
+          (Chunk_getUnits(oBuddy) != (size_t)1 << uOrder))
+         break;
+
+      HeapMgr_removeFromList(oBuddy, uOrder);
+      uOffset &= ~((size_t)1 << uOrder);
+   }
+
+   oChunk = HeapMgr_atOffset(uOffset);
+   Chunk_setUnits(oChunk, (size_t)1 << uOrder);
+   Chunk_setStatus(oChunk, CHUNK_FREE);
+   HeapMgr_addToList(oChunk, uOrder);
+}
+
+/*--------------------------------------------------------------------*/
+/* Request more memory from the operating system -- enough for a chunk
+   of order uOrder -- and free it, so that the lists hold a chunk of
+   that order or more. Return TRUE if they do, or FALSE otherwise. */
+static int HeapMgr_getMoreMemory(size_t uOrder)
+{
+   size_t uEnd; /* the offset of the heap end */
+   size_t uNewEnd; /* the offset of the heap end, once it moves */
+   size_t uFillOrder; /* the order of a chunk that aligns the end */
+   Chunk_T oNewHeapEnd; /* the heap end, once the break moves */
+
+   /* always use at least 512 units */
+   if (uOrder < (size_t)MIN_ORDER_FROM_OS)
+      uOrder = (size_t)MIN_ORDER_FROM_OS;
+   if (uOrder >= (size_t)ORDER_COUNT - 1)
+      return FALSE;
+
+   /* the chunk must start at a multiple of its size */
+   uEnd = HeapMgr_getOffset(oHeapEnd);
+   uNewEnd = (uEnd + ((size_t)1 << uOrder) - 1)
+             & ~(((size_t)1 << uOrder) - 1);
+   if (uNewEnd < uEnd)
+      return FALSE;
+   uNewEnd += (size_t)1 << uOrder;
+   if (uNewEnd < uEnd)
+      return FALSE;
+
+   /* Check for overflow, and that the heap stays within what its
+      chunks can span */
+   if ((uNewEnd > ~(size_t)0 / Chunk_unitsToBytes(1)) ||
+       (uNewEnd > Chunk_getMaxUnits()))
+      return FALSE;
+   oNewHeapEnd = HeapMgr_atOffset(uNewEnd);
+   if (oNewHeapEnd < oHeapEnd)
+      return FALSE;
+
+   /* system call: move the program break and error check*/
+   if (brk(oNewHeapEnd) == -1)
+      return FALSE;
+
+   /* free the memory chunk by chunk, each the largest that starts at
+      a multiple of its size, moving the heap end past each only as it
+      is set up */
+   while (uEnd < uNewEnd)
+   {
+      uFillOrder = (uEnd == 0) ? uOrder
+                   : (size_t)__builtin_ctzl((unsigned long)uEnd);
+      if (uFillOrder > uOrder)
+         uFillOrder = uOrder;
+      oHeapEnd = HeapMgr_atOffset(uEnd + ((size_t)1 << uFillOrder));
+      Chunk_setUnits(HeapMgr_atOffset(uEnd),
+                     (size_t)1 << uFillOrder);
+      HeapMgr_release(HeapMgr_atOffset(uEnd), uFillOrder);
+      uEnd += (size_t)1 << uFillOrder;
+   }
+
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+void *HeapMgr_malloc(size_t uBytes)
+{
+   size_t uOrder; /* the order of the chunk to return */
+   size_t uFoundOrder; /* the order of the chunk found */
+   unsigned long ulMap; /* the lists to look in that hold chunks */
+   Chunk_T oChunk = NULL; /* memory chunk to eventually return */
+   Chunk_T oBuddy = NULL; /* the upper half of a split chunk */
+
+   /* can't request 0 bytes */
+   if (uBytes == 0)
+      return NULL;
+
+   /* (1) initialize */
+   if (oHeapStart == NULL)
+   {
+      /* start where the payload of a chunk is aligned to a unit */
+      char *pcBreak = (char*)sbrk(0);
+      size_t uUnitBytes = Chunk_unitsToBytes(1);
+      oHeapStart = (Chunk_T)(pcBreak +
+         (Chunk_getStartOffset() + uUnitBytes
+          - (size_t)pcBreak % uUnitBytes) % uUnitBytes);
+      oHeapEnd = oHeapStart;
+   }
+   assert(Checker_isValid(oHeapStart, oHeapEnd, aoLists, ulOrderMap,
+                          ORDER_COUNT));
+
+   /* (2) determine the order needed */
+   uOrder = HeapMgr_getOrder(Chunk_bytesToUnits(uBytes));
+   if (uOrder >= (size_t)ORDER_COUNT)
+      return NULL;
+
+   /* (3) find the lowest order from there on that holds chunks, and
+      get more memory if there is none */
+   ulMap = ulOrderMap & (~0UL << uOrder);
+   if (ulMap == 0)
+   {
+      if (! HeapMgr_getMoreMemory(uOrder))
+      {
+         assert(Checker_isValid(oHeapStart, oHeapEnd, aoLists,
+                                ulOrderMap, ORDER_COUNT));
+         return NULL;
+      }
+      ulMap = ulOrderMap & (~0UL << uOrder);
+      assert(ulMap != 0);
+   }
+   uFoundOrder = (size_t)__builtin_ctzl(ulMap);
+   oChunk = aoLists[uFoundOrder];
+   HeapMgr_removeFromList(oChunk, uFoundOrder);
+
+   /* (4) split it in halves down to the order needed, freeing each
+      upper half */
+   while (uFoundOrder > uOrder)
+   {
+      uFoundOrder--;
+      Chunk_setUnits(oChunk, (size_t)1 << uFoundOrder);
+      oBuddy = HeapMgr_atOffset(HeapMgr_getOffset(oChunk)
+                                + ((size_t)1 << uFoundOrder));
+      Chunk_setUnits(oBuddy, (size_t)1 << uFoundOrder);
+      Chunk_setStatus(oBuddy, CHUNK_FREE);
+      HeapMgr_addToList(oBuddy, uFoundOrder);
+   }
+   Chunk_setStatus(oChunk, CHUNK_INUSE);
+
+   assert(Checker_isValid(oHeapStart, oHeapEnd, aoLists, ulOrderMap,
+                          ORDER_COUNT));
+   return Chunk_toPayload(oChunk);
+}
+
+void HeapMgr_free(void *pv)
+{
+   Chunk_T oChunk = NULL; /* logical chunk that owns payload pv */
+
+   if (pv == NULL)
+      return;
+
+   assert(Checker_isValid(oHeapStart, oHeapEnd, aoLists, ulOrderMap,
+                          ORDER_COUNT));
+
+   /* (1) get the chunk from payload */
+   oChunk = Chunk_fromPayload(pv);
+   assert(Chunk_getStatus(oChunk) == CHUNK_INUSE);
+
+   /* (2) merge it with its buddies */
+   HeapMgr_release(oChunk,
+                   HeapMgr_getOrder(Chunk_getUnits(oChunk)));
+
+   assert(Checker_isValid(oHeapStart, oHeapEnd, aoLists, ulOrderMap,
+                          ORDER_COUNT));
+}
@@ -3,8 +3,13 @@
 /* Author: Bob Dondero                                                */
 /*--------------------------------------------------------------------*/
 
+/* posix_memalign() is declared only for POSIX.1-2001 and later. */
+#define _POSIX_C_SOURCE 200112L
+
 #include "heapmgr.h"
 #include <stdlib.h>
+#include <malloc.h>
+#include <limits.h>
 
 /*--------------------------------------------------------------------*/
 
@@ -19,3 +24,225 @@ void HeapMgr_free(void *pv)
 {
    free(pv);
 }
+
+/*--------------------------------------------------------------------*/
+
+void *HeapMgr_realloc(void *pv, size_t uBytes)
+{
+   return realloc(pv, uBytes);
+}
+
+/*--------------------------------------------------------------------*/
+
+void *HeapMgr_calloc(size_t uCount, size_t uBytes)
+{
+   return calloc(uCount, uBytes);
+}
+
+/*--------------------------------------------------------------------*/
+
+void *HeapMgr_memalign(size_t uAlignment, size_t uBytes)
+{
+   void *pv;
+
+   /* posix_memalign() also requires a multiple of sizeof(void*). */
+   if (uAlignment < sizeof(void*))
+      uAlignment = sizeof(void*);
+   if ((uBytes == 0) || (posix_memalign(&pv, uAlignment, uBytes) != 0))
+      return NULL;
+   return pv;
+}
+
+/*--------------------------------------------------------------------*/
+
+int HeapMgr_posixMemalign(void **ppv, size_t uAlignment, size_t uBytes)
+{
+   return posix_memalign(ppv, uAlignment, uBytes);
+}
+
+/*--------------------------------------------------------------------*/
+
+size_t HeapMgr_mallocBatch(size_t uBytes, size_t uCount, void *apv[])
+{
+   size_t i;
+
+   if (uBytes == 0)
+      return 0;
+   for (i = 0; i < uCount; i++)
+   {
+      apv[i] = malloc(uBytes);
+      if (apv[i] == NULL)
+         break;
+   }
+   return i;
+}
+
+/*--------------------------------------------------------------------*/
+
+void HeapMgr_freeBatch(void *apv[], size_t uCount)
+{
+   size_t i;
+
+   for (i = 0; i < uCount; i++)
+      free(apv[i]);
+}
+
+/*--------------------------------------------------------------------*/
+
+size_t HeapMgr_usableSize(void *pv)
+{
+   return malloc_usable_size(pv);
+}
+
+/*--------------------------------------------------------------------*/
+
+size_t HeapMgr_goodSize(size_t uBytes)
+{
+   /* The GNU implementation does not publish its rounding. */
+   return uBytes;
+}
+
+/*--------------------------------------------------------------------*/
+
+void HeapMgr_freeSized(void *pv, size_t uBytes)
+{
+   (void)uBytes;
+   free(pv);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* The GNU implementation has no heaps of its own to offer, so a
+   HeapMgr keeps its regions in a doubly-linked list, in order to
+   free them all in HeapMgr_destroy(). Each region lies behind a
+   header that links it in. */
+
+union Header
+{
+   struct
+   {
+      union Header *psNext;
+      union Header *psPrev;
+   } sLinks;
+   long double ldAligner;
+};
+
+struct HeapMgr
+{
+   /* The front of the list of regions in the heap, or NULL. */
+   union Header *psFirst;
+};
+
+/*--------------------------------------------------------------------*/
+
+HeapMgr_T HeapMgr_new(void)
+{
+   return (HeapMgr_T)calloc(1, sizeof(struct HeapMgr));
+}
+
+/*--------------------------------------------------------------------*/
+
+void *HeapMgr_mallocIn(HeapMgr_T oHeap, size_t uBytes)
+{
+   union Header *ps;
+
+   if ((uBytes == 0) || (uBytes > ((size_t)-1) - sizeof(union Header)))
+      return NULL;
+   ps = (union Header*)malloc(sizeof(union Header) + uBytes);
+   if (ps == NULL)
+      return NULL;
+
+   ps->sLinks.psPrev = NULL;
+   ps->sLinks.psNext = oHeap->psFirst;
+   if (oHeap->psFirst != NULL)
+      oHeap->psFirst->sLinks.psPrev = ps;
+   oHeap->psFirst = ps;
+   return ps + 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+void HeapMgr_freeIn(HeapMgr_T oHeap, void *pv)
+{
+   union Header *ps;
+
+   if (pv == NULL)
+      return;
+   ps = (union Header*)pv - 1;
+
+   if (ps->sLinks.psPrev != NULL)
+      ps->sLinks.psPrev->sLinks.psNext = ps->sLinks.psNext;
+   else
+      oHeap->psFirst = ps->sLinks.psNext;
+   if (ps->sLinks.psNext != NULL)
+      ps->sLinks.psNext->sLinks.psPrev = ps->sLinks.psPrev;
+   free(ps);
+}
+
+/*--------------------------------------------------------------------*/
+
+void HeapMgr_destroy(HeapMgr_T oHeap)
+{
+   union Header *ps;
+   union Header *psNext;
+
+   for (ps = oHeap->psFirst; ps != NULL; ps = psNext)
+   {
+      psNext = ps->sLinks.psNext;
+      free(ps);
+   }
+   free(oHeap);
+}
+
+/*--------------------------------------------------------------------*/
+
+int HeapMgr_getLockStats(HeapMgr_T oHeap, int iLock,
+                         struct HeapMgrLockStats *psStats)
+{
+   /* The GNU implementation does not publish its locks. */
+   (void)oHeap;
+   (void)iLock;
+   (void)psStats;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+void HeapMgr_setMmapThreshold(size_t uBytes)
+{
+   /* The GNU implementation caps the threshold well below INT_MAX. */
+   (void)mallopt(M_MMAP_THRESHOLD,
+                 uBytes > (size_t)INT_MAX ? INT_MAX : (int)uBytes);
+}
+
+/*--------------------------------------------------------------------*/
+
+void HeapMgr_setSlabThreshold(size_t uBytes)
+{
+   /* The GNU implementation gives every region a header. */
+   (void)uBytes;
+}
+
+/*--------------------------------------------------------------------*/
+
+int HeapMgr_trim(size_t uPad)
+{
+   return malloc_trim(uPad);
+}
+
+/*--------------------------------------------------------------------*/
+
+int HeapMgr_startScavenger(unsigned long ulPeriodMillis,
+                           unsigned long ulAgeMillis)
+{
+   /* The GNU implementation trims only on free. */
+   (void)ulPeriodMillis;
+   (void)ulAgeMillis;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+void HeapMgr_stopScavenger(void)
+{
+}
@@ -0,0 +1,347 @@
+/*--------------------------------------------------------------------*/
+/* heapmgrpreload.c                                                   */
+/* Author: Nate Wilson                                                */
+/* Author: Narek Galstyan                                             */
+/*--------------------------------------------------------------------*/
+
+/* The standard C memory allocation functions, implemented on top of
+   the HeapMgr interface. Built as a shared library, they replace the
+   ones in the C library of an unmodified program run with
+   LD_PRELOAD set to that library. */
+
+/* posix_memalign() and pthread_atfork() are declared only for
+   POSIX.1-2001 and later. */
+#define _POSIX_C_SOURCE 200112L
+
+#include "heapmgr.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+/*--------------------------------------------------------------------*/
+
+/* Unless the HeapMgr is built thread-safe, by defining
+   HEAPMGR_THREADS, it is not reentrant, so every call into it holds a
+   lock. If a call into it ever calls back into one of these
+   functions, as an allocating library function would, the inner call
+   is served from a small static bootstrap arena instead. */
+
+#ifndef HEAPMGR_THREADS
+/* 1 if some thread is inside the HeapMgr, or 0 otherwise. */
+static volatile int iLocked = 0;
+#endif
+
+/* 1 if the calling thread is inside the HeapMgr, or 0 otherwise. The
+   initial-exec model keeps reads of it from allocating. */
+static __thread int iInside
+   __attribute__((tls_model("initial-exec"))) = 0;
+
+/* The number of bytes in the bootstrap arena. */
+enum {BOOTSTRAP_BYTES = 64 * 1024};
+
+/* The alignment of every region in the bootstrap arena, and the size
+   of the header in front of it that holds its size. */
+enum {BOOTSTRAP_ALIGNMENT = 16};
+
+/* The bootstrap arena. Regions are bump allocated and never reused. */
+static union
+{
+   char acBytes[BOOTSTRAP_BYTES];
+   long double ldAligner;
+} uBootstrap;
+
+/* The number of bytes of the bootstrap arena in use. */
+static size_t uBootstrapUsed = 0;
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 (TRUE) if the calling thread is inside the HeapMgr already,
+   or 0 (FALSE) otherwise. */
+
+static int isRecursive(void)
+{
+   return iInside;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Enter the HeapMgr, first waiting until no other thread is inside
+   it if it is not thread-safe. */
+
+static void lock(void)
+{
+#ifndef HEAPMGR_THREADS
+   while (__sync_lock_test_and_set(&iLocked, 1) != 0)
+      (void)sched_yield();
+#endif
+   iInside = 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Leave the HeapMgr. */
+
+static void unlock(void)
+{
+   iInside = 0;
+#ifndef HEAPMGR_THREADS
+   __sync_lock_release(&iLocked);
+#endif
+}
+
+/*--------------------------------------------------------------------*/
+
+#ifndef HEAPMGR_THREADS
+/* Keep a child process from inheriting the lock held by a thread of
+   the parent that the child does not have. A thread-safe HeapMgr
+   does the same for its own locks. */
+
+static void prepareFork(void)
+{
+   lock();
+}
+
+static void finishFork(void)
+{
+   unlock();
+}
+
+static void registerForkHandlers(void) __attribute__((constructor));
+
+static void registerForkHandlers(void)
+{
+   (void)pthread_atfork(prepareFork, finishFork, finishFork);
+}
+#endif
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 (TRUE) if pv points into the bootstrap arena, or 0 (FALSE)
+   otherwise. */
+
+static int isBootstrap(void *pv)
+{
+   return ((char*)pv >= uBootstrap.acBytes) &&
+          ((char*)pv < uBootstrap.acBytes + BOOTSTRAP_BYTES);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the address of a region of uBytes bytes from the bootstrap
+   arena, or NULL if the arena is exhausted. */
+
+static void *bootstrapAlloc(size_t uBytes)
+{
+   char *pc;
+   size_t uTotal;
+
+   uTotal = BOOTSTRAP_ALIGNMENT +
+      ((uBytes + BOOTSTRAP_ALIGNMENT - 1) / BOOTSTRAP_ALIGNMENT)
+      * BOOTSTRAP_ALIGNMENT;
+   if ((uBytes > BOOTSTRAP_BYTES) ||
+       (uTotal > BOOTSTRAP_BYTES - uBootstrapUsed))
+      return NULL;
+
+   pc = uBootstrap.acBytes + uBootstrapUsed;
+   uBootstrapUsed += uTotal;
+   *(size_t*)pc = uBytes;
+
+   /* Memory in the bss section is zero until it is used. */
+   return pc + BOOTSTRAP_ALIGNMENT;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the size of the region pv in the bootstrap arena. */
+
+static size_t bootstrapSize(void *pv)
+{
+   return *(size_t*)((char*)pv - BOOTSTRAP_ALIGNMENT);
+}
+
+/*--------------------------------------------------------------------*/
+
+void *malloc(size_t uBytes)
+{
+   void *pv;
+
+   /* Unlike HeapMgr_malloc(), malloc(0) returns a unique region. */
+   if (uBytes == 0)
+      uBytes = 1;
+
+   if (isRecursive())
+      pv = bootstrapAlloc(uBytes);
+   else
+   {
+      lock();
+      pv = HeapMgr_malloc(uBytes);
+      unlock();
+   }
+
+   if (pv == NULL)
+      errno = ENOMEM;
+   return pv;
+}
+
+/*--------------------------------------------------------------------*/
+
+void free(void *pv)
+{
+   if ((pv == NULL) || isBootstrap(pv))
+      return;
+
+   lock();
+   HeapMgr_free(pv);
+   unlock();
+}
+
+/*--------------------------------------------------------------------*/
+
+void *calloc(size_t uCount, size_t uBytes)
+{
+   void *pv;
+
+   /* Unlike HeapMgr_calloc(), calloc() of zero bytes returns a unique
+      region. */
+   if ((uCount == 0) || (uBytes == 0))
+      uCount = uBytes = 1;
+
+   if (isRecursive())
+   {
+      if (uCount > ((size_t)-1) / uBytes)
+         pv = NULL;
+      else
+         pv = bootstrapAlloc(uCount * uBytes);
+   }
+   else
+   {
+      lock();
+      pv = HeapMgr_calloc(uCount, uBytes);
+      unlock();
+   }
+
+   if (pv == NULL)
+      errno = ENOMEM;
+   return pv;
+}
+
+/*--------------------------------------------------------------------*/
+
+void *realloc(void *pv, size_t uBytes)
+{
+   void *pvNew;
+
+   if (pv == NULL)
+      return malloc(uBytes);
+   if (uBytes == 0)
+   {
+      free(pv);
+      return NULL;
+   }
+
+   /* Move regions out of the bootstrap arena. */
+   if (isBootstrap(pv))
+   {
+      pvNew = malloc(uBytes);
+      if (pvNew != NULL)
+         memcpy(pvNew, pv, bootstrapSize(pv) < uBytes ?
+                           bootstrapSize(pv) : uBytes);
+      return pvNew;
+   }
+
+   lock();
+   pvNew = HeapMgr_realloc(pv, uBytes);
+   unlock();
+
+   if (pvNew == NULL)
+      errno = ENOMEM;
+   return pvNew;
+}
+
+/*--------------------------------------------------------------------*/
+
+int posix_memalign(void **ppv, size_t uAlignment, size_t uBytes)
+{
+   int iResult;
+
+   if (uBytes == 0)
+      uBytes = 1;
+
+   /* The bootstrap arena does not honor alignments. */
+   if (isRecursive())
+      return ENOMEM;
+
+   lock();
+   iResult = HeapMgr_posixMemalign(ppv, uAlignment, uBytes);
+   unlock();
+   return iResult;
+}
+
+/*--------------------------------------------------------------------*/
+
+void *memalign(size_t uAlignment, size_t uBytes)
+{
+   void *pv;
+
+   if (uBytes == 0)
+      uBytes = 1;
+
+   if (isRecursive())
+      pv = NULL;
+   else
+   {
+      lock();
+      pv = HeapMgr_memalign(uAlignment, uBytes);
+      unlock();
+   }
+
+   if (pv == NULL)
+      errno = ((uAlignment & (uAlignment - 1)) != 0) ? EINVAL : ENOMEM;
+   return pv;
+}
+
+/*--------------------------------------------------------------------*/
+
+void *aligned_alloc(size_t uAlignment, size_t uBytes)
+{
+   return memalign(uAlignment, uBytes);
+}
+
+/*--------------------------------------------------------------------*/
+
+void *valloc(size_t uBytes)
+{
+   return memalign((size_t)sysconf(_SC_PAGESIZE), uBytes);
+}
+
+/*--------------------------------------------------------------------*/
+
+void *pvalloc(size_t uBytes)
+{
+   size_t uPageBytes = (size_t)sysconf(_SC_PAGESIZE);
+
+   return memalign(uPageBytes,
+                   ((uBytes + uPageBytes - 1) / uPageBytes) * uPageBytes);
+}
+
+/*--------------------------------------------------------------------*/
+
+size_t malloc_usable_size(void *pv)
+{
+   size_t uBytes;
+
+   if (pv == NULL)
+      return 0;
+   if (isBootstrap(pv))
+      return bootstrapSize(pv);
+
+   lock();
+   uBytes = HeapMgr_usableSize(pv);
+   unlock();
+   return uBytes;
+}
@@ -0,0 +1,2112 @@
+/*--------------------------------------------------------------------*/
+/* testheapext.c                                                      */
+/* Author: Nate Wilson                                                */
+/* Author: Narek Galstyan                                             */
+/*--------------------------------------------------------------------*/
+
+#include "heapmgr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+#include <assert.h>
+
+#ifndef S_SPLINT_S
+#include <sys/resource.h>
+#endif
+
+#define __USE_XOPEN_EXTENDED
+#include <unistd.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+/* In lieu of a boolean data type. */
+enum {FALSE, TRUE};
+
+/*--------------------------------------------------------------------*/
+
+/* testheapext exercises the parts of the HeapMgr interface beyond
+   HeapMgr_malloc() and HeapMgr_free(). It is kept apart from
+   testheapmgr.c so that testheapmgr.c can still be linked with
+   implementations that provide only those two functions. */
+
+/* These arrays are too big for the stack section, so store
+   them in the bss section. */
+
+/* The maximum allowable number of calls of the HeapMgr functions. */
+enum {MAX_CALLS = 1000000};
+
+/* Memory chunks allocated by the HeapMgr functions. */
+static char *apcChunks[MAX_CALLS];
+
+/* Memory chunks allocated and freed in batches. */
+static void *apvBatch[MAX_CALLS];
+
+/* Current sizes of the memory chunks in apcChunks.  */
+static int aiSizes[MAX_CALLS];
+
+/*--------------------------------------------------------------------*/
+
+/* Function declarations. */
+
+/* Get command-line arguments *piTestNum, *piCount, and *piSize,
+   from argument vector argv. argc is the number of used elements
+   in argv. Exit if any of the arguments is invalid.  */
+static void getArgs(int argc, char *argv[],
+   int *piTestNum, int *piCount, int *piSize);
+
+/* Set the process's "CPU time" resource limit. After the CPU
+   time limit expires, the OS will send a SIGKILL signal to the
+   process. */
+static void setCpuTimeLimit(void);
+
+/* Grow a few memory chunks in round-robin order with iCount calls
+   of HeapMgr_realloc(), each adding some random number of bytes
+   less than iSize, as a growing vector would. */
+static void testReallocGrow(int iCount, int iSize);
+
+/* Resize memory chunks to some random size less than iSize with
+   iCount calls of HeapMgr_realloc(), in a random order. */
+static void testReallocRandom(int iCount, int iSize);
+
+/* Allocate, resize, and free iCount memory chunks, each of some
+   random size less than iSize, in a random order, allocating them
+   with HeapMgr_calloc(). */
+static void testCallocRandom(int iCount, int iSize);
+
+/* Allocate and free iCount memory chunks, each of some random size
+   less than iSize and some random power of two alignment, in a
+   random order. */
+static void testMemalignRandom(int iCount, int iSize);
+
+/* Allocate and free iCount memory chunks, each of size iSize, in
+   batches of random length, freeing them in a random order. */
+static void testBatchFixed(int iCount, int iSize);
+
+/* Allocate and free iCount memory chunks, each of some random size
+   less than iSize, in a random order, using all of the bytes that
+   HeapMgr_usableSize() reports for half of them and freeing with
+   HeapMgr_freeSized(). */
+static void testUsableRandom(int iCount, int iSize);
+
+/* Allocate and free iCount memory chunks, each of some random size
+   less than iSize, in a random order, spread over a few heaps made
+   by HeapMgr_new(). Destroy the heaps with half of their chunks
+   still allocated. */
+static void testHeapsRandom(int iCount, int iSize);
+
+/* Allocate, resize, and free iCount memory chunks, each of some
+   random size less than iSize, in a random order, from a few threads
+   at once. Only a thread-safe HeapMgr can pass this test, so it is
+   skipped unless HEAPMGR_THREADS is defined. */
+static void testThreadsRandom(int iCount, int iSize);
+
+/* Allocate and free iCount memory chunks, each of size iSize, in
+   bursts from a few threads at once, as request handlers would.
+   Only a thread-safe HeapMgr can pass this test, so it is skipped
+   unless HEAPMGR_THREADS is defined. */
+static void testThreadsFixed(int iCount, int iSize);
+
+/* Allocate iCount memory chunks, each of some random size less than
+   iSize, from a few threads at once, each thread handing the chunks
+   that it allocates to the next one to free. Only a thread-safe
+   HeapMgr can pass this test, so it is skipped unless
+   HEAPMGR_THREADS is defined. */
+static void testThreadsRemote(int iCount, int iSize);
+
+/* Resize memory chunks as testReallocRandom() does, with about half
+   of them big enough for mappings of their own, so that chunks move
+   into and out of mappings, then allocate a mapped chunk with
+   HeapMgr_calloc(), and then mapped chunks with HeapMgr_memalign()
+   at alignments of up to a few pages, some of them only big enough
+   for mappings of their own with room to align them. */
+static void testMmapRandom(int iCount, int iSize);
+
+/* Allocate iCount memory chunks, each of some random size less than
+   iSize, free most of them, hand the free memory back to the OS with
+   HeapMgr_trim(), and then allocate and free them again. */
+static void testTrimRandom(int iCount, int iSize);
+
+/* Allocate and free memory chunks as testTrimRandom() does, but let
+   a scavenger thread hand the free memory back to the OS while the
+   rest of the chunks stay allocated. */
+static void testScavengeRandom(int iCount, int iSize);
+
+/* Resize memory chunks as testReallocRandom() does, to sizes of up
+   to a few dozen times iSize, all of them in the heap rather than in
+   mappings of their own. */
+static void testLargeRandom(int iCount, int iSize);
+
+/* Allocate and free memory chunks as testUsableRandom() does, and
+   then resize them as testReallocRandom() does, with every chunk of
+   iSize bytes or less in a slab. */
+static void testSlabRandom(int iCount, int iSize);
+
+/* Allocate and free iCount memory chunks in bursts, each chunk of one
+   of a few small sizes, with every so often a chunk of some random
+   size of up to a few times iSize that the small free chunks must
+   merge to make room for. */
+static void testFastRandom(int iCount, int iSize);
+
+/* Allocate, free, and trim memory chunks so that the chunks freed
+   last lie just below memory that the heap has never handed out, and
+   then allocate chunks of some random size less than iSize with
+   HeapMgr_calloc() over that memory, iCount times over, making sure
+   that they are zeroed. */
+static void testCallocFresh(int iCount, int iSize);
+
+/* Allocate iCount memory chunks of a few bytes each, or a few
+   thousand if iCount is smaller, the first half of them each with a
+   header of its own and the second half in slabs, making sure that
+   the slabs spread over fewer pages. iSize is unused. */
+static void testSlabFootprint(int iCount, int iSize);
+
+/*--------------------------------------------------------------------*/
+
+/* apcTestName is an array containing the names of the tests. */
+
+static char *apcTestName[] =
+{
+   "ReallocGrow", "ReallocRandom", "CallocRandom", "MemalignRandom",
+   "BatchFixed", "UsableRandom", "HeapsRandom", "ThreadsRandom",
+   "ThreadsFixed", "ThreadsRemote", "MmapRandom", "TrimRandom",
+   "ScavengeRandom", "LargeRandom", "SlabRandom", "FastRandom",
+   "CallocFresh", "SlabFootprint"
+};
+
+/*--------------------------------------------------------------------*/
+
+/* An object of type TestFunction is a pointer to a function that
+   accepts two ints and returns nothing. */
+
+typedef void (*TestFunction)(int, int);
+
+/* apfTestFunction is an array containing pointers to the test
+   functions. Each pointer corresponds, by position, to a test name
+   in apcTestName. */
+
+static TestFunction apfTestFunction[] =
+{
+   testReallocGrow, testReallocRandom, testCallocRandom,
+   testMemalignRandom, testBatchFixed, testUsableRandom,
+   testHeapsRandom, testThreadsRandom, testThreadsFixed,
+   testThreadsRemote, testMmapRandom, testTrimRandom,
+   testScavengeRandom, testLargeRandom, testSlabRandom,
+   testFastRandom, testCallocFresh, testSlabFootprint
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Test the extended HeapMgr functions.
+
+   As always, argc is the command-line argument count.
+
+   argv[1] indicates which test to run:
+      ReallocGrow: round-robin growth of a few chunks,
+      ReallocRandom: random order resizing of random size chunks,
+      CallocRandom: random order calloc, realloc, and free,
+      MemalignRandom: random order aligned allocation and free,
+      BatchFixed: batch allocation and random order batch free,
+      UsableRandom: random order use of usable sizes and sized free,
+      HeapsRandom: random order allocation and free in a few heaps,
+      ThreadsRandom: random order allocation, resizing, and free
+         from a few threads,
+      ThreadsFixed: bursts of fixed size allocation and free from
+         a few threads,
+      ThreadsRemote: random size allocation in a few threads, each
+         freeing the chunks that another one allocated,
+      MmapRandom: random order resizing of random size chunks, half
+         of them in mappings of their own, and aligned mapped chunks,
+      TrimRandom: allocation of random size chunks, and trimming
+         after most of them are freed,
+      ScavengeRandom: allocation of random size chunks, and
+         scavenging after most of them are freed,
+      LargeRandom: random order resizing of random size chunks, up
+         to a few dozen times the size given, in the heap,
+      SlabRandom: random order use of usable sizes and resizing of
+         random size chunks, the small ones in slabs,
+      FastRandom: bursts of small allocation and free, mixed with
+         larger random size chunks,
+      CallocFresh: calloc over memory that trimming made fresh,
+      SlabFootprint: memory taken by small chunks with and without
+         slabs.
+
+   argv[2] is the number of calls of the HeapMgr functions to
+   execute. argv[2] cannot be greater than MAX_CALLS.
+
+   argv[3] is the (maximum) size of each memory chunk.
+
+   If the NDEBUG macro is not defined, then initialize and check
+   the contents of each memory chunk.
+
+   At the end of the process, write the heap memory and CPU time
+   consumed to stdout, and return 0. */
+
+int main(int argc, char *argv[])
+{
+   int iTestNum = 0;
+   int iCount = 0;
+   int iSize = 0;
+   clock_t iInitialClock;
+   clock_t iFinalClock;
+   char *pcInitialBreak;
+   char *pcFinalBreak;
+   unsigned int uiMemoryConsumed;
+   double dTimeConsumed;
+
+   /* Get the command-line arguments. */
+   getArgs(argc, argv, &iTestNum, &iCount, &iSize);
+
+   /* Start printing the results. */
+   printf("%16s %14s %7d %6d ", argv[0], argv[1], iCount, iSize);
+   fflush(stdout);
+
+   /* Save the initial clock and program break. */
+   iInitialClock = clock();
+   pcInitialBreak = sbrk(0);
+
+   /* Set the process's CPU time limit. */
+   setCpuTimeLimit();
+
+   /* Call the specified test function. */
+   (*(apfTestFunction[iTestNum]))(iCount, iSize);
+
+   /* Save the final clock and program break. */
+   pcFinalBreak = sbrk(0);
+   iFinalClock = clock();
+
+   /* Use the initial and final clocks and program breaks to compute
+      CPU time and heap memory consumed. */
+   uiMemoryConsumed = (unsigned int)(pcFinalBreak - pcInitialBreak);
+   dTimeConsumed =
+      ((double)(iFinalClock - iInitialClock)) / CLOCKS_PER_SEC;
+
+   /* Finish printing the results. */
+   printf("%6.2f %10u\n", dTimeConsumed, uiMemoryConsumed);
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Get command-line arguments *piTestNum, *piCount, and *piSize,
+   from argument vector argv. argc is the number of used elements
+   in argv. Exit if any of the arguments is invalid.  */
+
+static void getArgs(int argc, char *argv[],
+   int *piTestNum, int *piCount, int *piSize)
+{
+   int i;
+   int iTestCount;
+
+   assert(argv != NULL);
+   assert(piTestNum != NULL);
+   assert(piCount != NULL);
+   assert(piSize != NULL);
+
+   if (argc != 4)
+   {
+      fprintf(stderr, "Usage: %s testname count size\n", argv[0]);
+      exit(EXIT_FAILURE);
+   }
+
+   /* Get the test number. */
+   iTestCount = (int)(sizeof(apcTestName) / sizeof(apcTestName[0]));
+   for (i = 0; i < iTestCount; i++)
+      if (strcmp(argv[1], apcTestName[i]) == 0)
+      {
+         *piTestNum = i;
+         break;
+      }
+   if (i == iTestCount)
+   {
+      fprintf(stderr, "Usage: %s testname count size\n", argv[0]);
+      fprintf(stderr, "Valid testnames:\n");
+      for (i = 0; i < iTestCount; i++)
+         fprintf(stderr, " %s", apcTestName[i]);
+      fprintf(stderr, "\n");
+      exit(EXIT_FAILURE);
+   }
+
+   /* Get the count. */
+   if (sscanf(argv[2], "%d", piCount) != 1)
+   {
+      fprintf(stderr, "Usage: %s testname count size\n", argv[0]);
+      fprintf(stderr, "Count must be numeric\n");
+      exit(EXIT_FAILURE);
+   }
+   if (*piCount <= 0)
+   {
+      fprintf(stderr, "Usage: %s testname count size\n", argv[0]);
+      fprintf(stderr, "Count must be positive\n");
+      exit(EXIT_FAILURE);
+   }
+   if (*piCount > MAX_CALLS)
+   {
+      fprintf(stderr, "Usage: %s testname count size\n", argv[0]);
+      fprintf(stderr, "Count cannot be greater than %d\n", MAX_CALLS);
+      exit(EXIT_FAILURE);
+   }
+
+   /* Get the size. */
+   if (sscanf(argv[3], "%d", piSize) != 1)
+   {
+      fprintf(stderr, "Usage: %s testname count size\n", argv[0]);
+      fprintf(stderr, "Size must be numeric\n");
+      exit(EXIT_FAILURE);
+   }
+   if (*piSize <= 0)
+   {
+      fprintf(stderr, "Usage: %s testname count size\n", argv[0]);
+      fprintf(stderr, "Size must be positive\n");
+      exit(EXIT_FAILURE);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+#ifndef S_SPLINT_S
+/* Set the process's "CPU time" resource limit. After the CPU
+   time limit expires, the OS will send a SIGKILL signal to the
+   process. */
+
+static void setCpuTimeLimit(void)
+{
+   enum {CPU_TIME_LIMIT_IN_SECONDS = 300};
+   struct rlimit sRlimit;
+   sRlimit.rlim_cur = CPU_TIME_LIMIT_IN_SECONDS;
+   sRlimit.rlim_max = CPU_TIME_LIMIT_IN_SECONDS;
+   setrlimit(RLIMIT_CPU, &sRlimit);
+}
+#endif
+
+/*--------------------------------------------------------------------*/
+
+#ifndef NDEBUG
+
+#define ASSURE(i) assure(i, __LINE__)
+
+/* If !iSuccessful, print an error message indicating that the test
+   at line iLineNum failed. */
+
+static void assure(int iSuccessful, int iLineNum)
+{
+   if (! iSuccessful)
+      fprintf(stderr, "Test at line %d failed.\n", iLineNum);
+}
+
+#endif
+
+/*--------------------------------------------------------------------*/
+
+/* Unless the HeapMgr is thread-safe, as it is if HEAPMGR_THREADS is
+   defined, say that the test is skipped and exit, as threads would
+   race on its heap. */
+
+static void requireThreadSafe(void)
+{
+#ifndef HEAPMGR_THREADS
+   printf("skipped: HeapMgr is not thread-safe\n");
+   exit(0);
+#endif
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Grow a few memory chunks in round-robin order with iCount calls
+   of HeapMgr_realloc(), each adding some random number of bytes
+   less than iSize, as a growing vector would. */
+
+static void testReallocGrow(int iCount, int iSize)
+{
+   /* The number of chunks growing at the same time. */
+   enum {VECTOR_COUNT = 8};
+
+   /* The number of times iSize beyond which a chunk is cut back. */
+   enum {MAX_GROWTH = 256};
+
+   int i;
+   int iVec;
+   int iOldSize;
+
+   for (i = 0; i < iCount; i++)
+   {
+      iVec = i % VECTOR_COUNT;
+      iOldSize = aiSizes[iVec];
+
+      /* Cut long chunks back to a single byte, as a vector that is
+         cleared and reused would be. */
+      if (iOldSize > iSize * MAX_GROWTH)
+         aiSizes[iVec] = 1;
+      else
+         aiSizes[iVec] += (rand() % iSize) + 1;
+
+      apcChunks[iVec] =
+         (char*)HeapMgr_realloc(apcChunks[iVec], (size_t)aiSizes[iVec]);
+      if (apcChunks[iVec] == NULL)
+      {
+         printf("Realloc returned NULL.\n");
+         exit(0);
+      }
+
+      #ifndef NDEBUG
+      {
+         /* Check that the ends of the old contents survived, then
+            fill the added bytes with a character derived from the
+            last digit of iVec. */
+         int iCol;
+         char c = (char)((iVec % 10) + '0');
+         if (iOldSize > 0)
+         {
+            ASSURE(apcChunks[iVec][0] == c);
+            if (iOldSize < aiSizes[iVec])
+               ASSURE(apcChunks[iVec][iOldSize - 1] == c);
+         }
+         for (iCol = iOldSize; iCol < aiSizes[iVec]; iCol++)
+            apcChunks[iVec][iCol] = c;
+      }
+      #endif
+   }
+
+   /* Free the chunks by resizing them to zero bytes. */
+   for (iVec = 0; iVec < VECTOR_COUNT && iVec < iCount; iVec++)
+   {
+      #ifndef NDEBUG
+      {
+         /* Check the chunk that is about to be freed to make sure
+            that its contents haven't been corrupted. */
+         int iCol;
+         char c = (char)((iVec % 10) + '0');
+         for (iCol = 0; iCol < aiSizes[iVec]; iCol++)
+            ASSURE(apcChunks[iVec][iCol] == c);
+      }
+      #endif
+
+      apcChunks[iVec] = (char*)HeapMgr_realloc(apcChunks[iVec], 0);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Resize memory chunks to some random size less than iSize with
+   iCount calls of HeapMgr_realloc(), in a random order. */
+
+static void testReallocRandom(int iCount, int iSize)
+{
+   int i;
+   int iRand;
+   int iNewSize;
+   int iLogicalArraySize;
+
+   iLogicalArraySize = (iCount / 3) + 1;
+
+   /* Call HeapMgr_realloc() repeatedly on random elements of
+      apcChunks. The first call for an element allocates it. */
+   for (i = 0; i < iCount; i++)
+   {
+      /* Assign some random integer to iRand. */
+      iRand = rand() % iLogicalArraySize;
+      iNewSize = (rand() % iSize) + 1;
+
+      #ifndef NDEBUG
+      {
+         /* Check the part of the chunk that is about to be kept to
+            make sure that its contents haven't been corrupted. */
+         int iCol;
+         char c = (char)((iRand % 10) + '0');
+         for (iCol = 0; iCol < aiSizes[iRand] && iCol < iNewSize;
+              iCol++)
+            ASSURE(apcChunks[iRand][iCol] == c);
+      }
+      #endif
+
+      apcChunks[iRand] = (char*)HeapMgr_realloc(apcChunks[iRand],
+                                                (size_t)iNewSize);
+      if (apcChunks[iRand] == NULL)
+      {
+         printf("Realloc returned NULL.\n");
+         exit(0);
+      }
+
+      #ifndef NDEBUG
+      {
+         /* Check the kept part again, now that it may have moved,
+            and fill the rest of the chunk. */
+         int iCol;
+         char c = (char)((iRand % 10) + '0');
+         for (iCol = 0; iCol < iNewSize; iCol++)
+         {
+            if (iCol < aiSizes[iRand])
+               ASSURE(apcChunks[iRand][iCol] == c);
+            else
+               apcChunks[iRand][iCol] = c;
+         }
+      }
+      #endif
+
+      aiSizes[iRand] = iNewSize;
+   }
+
+   /* Free the chunks by resizing them to zero bytes. */
+   for (i = 0; i < iLogicalArraySize; i++)
+   {
+      if (apcChunks[i] != NULL)
+      {
+         #ifndef NDEBUG
+         {
+            /* Check the chunk that is about to be freed to make sure
+               that its contents haven't been corrupted. */
+            int iCol;
+            char c = (char)((i % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[i]; iCol++)
+               ASSURE(apcChunks[i][iCol] == c);
+         }
+         #endif
+
+         apcChunks[i] = (char*)HeapMgr_realloc(apcChunks[i], 0);
+      }
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate, resize, and free iCount memory chunks, each of some
+   random size less than iSize, in a random order, allocating them
+   with HeapMgr_calloc(). */
+
+static void testCallocRandom(int iCount, int iSize)
+{
+   int i;
+   int iRand;
+   int iNewSize;
+   int iLogicalArraySize;
+
+   iLogicalArraySize = (iCount / 3) + 1;
+
+   for (i = 0; i < iCount; i++)
+   {
+      /* Assign some random integer to iRand. */
+      iRand = rand() % iLogicalArraySize;
+      iNewSize = (rand() % iSize) + 1;
+
+      /* Allocate apcChunks[iRand] if it is empty, resize it half of
+         the time otherwise, and free it the other half. */
+      if (apcChunks[iRand] == NULL)
+      {
+         apcChunks[iRand] =
+            (char*)HeapMgr_calloc((size_t)iNewSize, (size_t)1);
+         if (apcChunks[iRand] == NULL)
+         {
+            printf("Calloc returned NULL.\n");
+            exit(0);
+         }
+
+         #ifndef NDEBUG
+         {
+            /* Make sure the new chunk is zeroed, then fill it with
+               some character derived from the last digit of iRand. */
+            int iCol;
+            char c = (char)((iRand % 10) + '0');
+            for (iCol = 0; iCol < iNewSize; iCol++)
+            {
+               ASSURE(apcChunks[iRand][iCol] == '\0');
+               apcChunks[iRand][iCol] = c;
+            }
+         }
+         #endif
+
+         aiSizes[iRand] = iNewSize;
+      }
+      else if (rand() % 2 == 0)
+      {
+         apcChunks[iRand] = (char*)HeapMgr_realloc(apcChunks[iRand],
+                                                   (size_t)iNewSize);
+         if (apcChunks[iRand] == NULL)
+         {
+            printf("Realloc returned NULL.\n");
+            exit(0);
+         }
+
+         #ifndef NDEBUG
+         {
+            /* Check the kept part and fill the rest of the chunk. */
+            int iCol;
+            char c = (char)((iRand % 10) + '0');
+            for (iCol = 0; iCol < iNewSize; iCol++)
+            {
+               if (iCol < aiSizes[iRand])
+                  ASSURE(apcChunks[iRand][iCol] == c);
+               else
+                  apcChunks[iRand][iCol] = c;
+            }
+         }
+         #endif
+
+         aiSizes[iRand] = iNewSize;
+      }
+      else
+      {
+         #ifndef NDEBUG
+         {
+            /* Check the chunk that is about to be freed to make sure
+               that its contents haven't been corrupted. */
+            int iCol;
+            char c = (char)((iRand % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[iRand]; iCol++)
+               ASSURE(apcChunks[iRand][iCol] == c);
+         }
+         #endif
+
+         HeapMgr_free(apcChunks[iRand]);
+         apcChunks[iRand] = NULL;
+      }
+   }
+
+   /* Free the rest of the chunks. */
+   for (i = 0; i < iLogicalArraySize; i++)
+   {
+      if (apcChunks[i] != NULL)
+      {
+         #ifndef NDEBUG
+         {
+            /* Check the chunk that is about to be freed to make sure
+               that its contents haven't been corrupted. */
+            int iCol;
+            char c = (char)((i % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[i]; iCol++)
+               ASSURE(apcChunks[i][iCol] == c);
+         }
+         #endif
+
+         HeapMgr_free(apcChunks[i]);
+         apcChunks[i] = NULL;
+      }
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate and free iCount memory chunks, each of some random size
+   less than iSize and some random power of two alignment, in a
+   random order. */
+
+static void testMemalignRandom(int iCount, int iSize)
+{
+   /* The base 2 logarithm of the largest alignment to request. */
+   enum {MAX_ALIGNMENT_SHIFT = 12};
+
+   int i;
+   int iRand;
+   size_t uAlignment;
+   void *pv;
+   int iLogicalArraySize;
+
+   iLogicalArraySize = (iCount / 3) + 1;
+
+   /* Fill aiSizes, an array of random integers in the range 1
+      to iSize. */
+   for (i = 0; i < iLogicalArraySize; i++)
+      aiSizes[i] = (rand() % iSize) + 1;
+
+   i = 0;
+
+   /* Call HeapMgr_memalign() or HeapMgr_posixMemalign(), and
+      HeapMgr_free() in a randomly interleaved manner. */
+   while (i < iCount)
+   {
+      /* Assign some random integer to iRand. */
+      iRand = rand() % iLogicalArraySize;
+
+      if (apcChunks[iRand] == NULL)
+      {
+         uAlignment = (size_t)1 << (rand() % (MAX_ALIGNMENT_SHIFT + 1));
+         if (iRand % 2 == 0)
+            pv = HeapMgr_memalign(uAlignment, (size_t)aiSizes[iRand]);
+         else
+         {
+            /* HeapMgr_posixMemalign() accepts only multiples of
+               sizeof(void*). */
+            if (uAlignment < sizeof(void*))
+               uAlignment = sizeof(void*);
+            if (HeapMgr_posixMemalign(&pv, uAlignment,
+                                      (size_t)aiSizes[iRand]) != 0)
+               pv = NULL;
+         }
+         apcChunks[iRand] = (char*)pv;
+         if (apcChunks[iRand] == NULL)
+         {
+            printf("Memalign returned NULL.\n");
+            exit(0);
+         }
+
+         #ifndef NDEBUG
+         {
+            /* Make sure the chunk is aligned, then fill it with some
+               character derived from the last digit of iRand. */
+            int iCol;
+            char c = (char)((iRand % 10) + '0');
+            ASSURE((size_t)apcChunks[iRand] % uAlignment == 0);
+            for (iCol = 0; iCol < aiSizes[iRand]; iCol++)
+               apcChunks[iRand][iCol] = c;
+         }
+         #endif
+
+         i++;
+      }
+
+      /* Assign some random integer to iRand. */
+      iRand = rand() % iLogicalArraySize;
+
+      /* If apcChunks[iRand] contains a chunk, free it and set
+         apcChunks[iRand] to NULL. */
+      if (apcChunks[iRand] != NULL)
+      {
+         #ifndef NDEBUG
+         {
+            /* Check the chunk that is about to be freed to make sure
+               that its contents haven't been corrupted. */
+            int iCol;
+            char c = (char)((iRand % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[iRand]; iCol++)
+               ASSURE(apcChunks[iRand][iCol] == c);
+         }
+         #endif
+
+         HeapMgr_free(apcChunks[iRand]);
+         apcChunks[iRand] = NULL;
+      }
+   }
+
+   /* Free the rest of the chunks. */
+   for (i = 0; i < iLogicalArraySize; i++)
+   {
+      if (apcChunks[i] != NULL)
+      {
+         #ifndef NDEBUG
+         {
+            /* Check the chunk that is about to be freed to make sure
+               that its contents haven't been corrupted. */
+            int iCol;
+            char c = (char)((i % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[i]; iCol++)
+               ASSURE(apcChunks[i][iCol] == c);
+         }
+         #endif
+
+         HeapMgr_free(apcChunks[i]);
+         apcChunks[i] = NULL;
+      }
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate and free iCount memory chunks, each of size iSize, in
+   batches of random length, freeing them in a random order. */
+
+static void testBatchFixed(int iCount, int iSize)
+{
+   /* The maximum number of chunks per batch. */
+   enum {MAX_BATCH = 256};
+
+   /* The number of times to allocate and free all chunks. */
+   enum {ROUND_COUNT = 2};
+
+   int i;
+   int iRand;
+   int iRound;
+   int iBatch;
+   void *pvTemp;
+
+   for (iRound = 0; iRound < ROUND_COUNT; iRound++)
+   {
+      /* Call HeapMgr_mallocBatch() repeatedly to fill apvBatch. */
+      for (i = 0; i < iCount; i += iBatch)
+      {
+         iBatch = (rand() % MAX_BATCH) + 1;
+         if (iBatch > iCount - i)
+            iBatch = iCount - i;
+         if (HeapMgr_mallocBatch((size_t)iSize, (size_t)iBatch,
+                                 &apvBatch[i]) != (size_t)iBatch)
+         {
+            printf("MallocBatch returned too few chunks.\n");
+            exit(0);
+         }
+      }
+
+      #ifndef NDEBUG
+      {
+         /* Fill every chunk with a character derived from the last
+            digit of its index, then check them all, so that any
+            overlap between chunks shows. */
+         int iCol;
+         for (i = 0; i < iCount; i++)
+            for (iCol = 0; iCol < iSize; iCol++)
+               ((char*)apvBatch[i])[iCol] = (char)((i % 10) + '0');
+         for (i = 0; i < iCount; i++)
+            for (iCol = 0; iCol < iSize; iCol++)
+               ASSURE(((char*)apvBatch[i])[iCol] ==
+                      (char)((i % 10) + '0'));
+      }
+      #endif
+
+      /* Shuffle apvBatch, so that each batch to free holds chunks
+         from all over the heap. */
+      for (i = iCount - 1; i > 0; i--)
+      {
+         iRand = rand() % (i + 1);
+         pvTemp = apvBatch[i];
+         apvBatch[i] = apvBatch[iRand];
+         apvBatch[iRand] = pvTemp;
+      }
+
+      /* Call HeapMgr_freeBatch() repeatedly to free the chunks. */
+      for (i = 0; i < iCount; i += iBatch)
+      {
+         iBatch = (rand() % MAX_BATCH) + 1;
+         if (iBatch > iCount - i)
+            iBatch = iCount - i;
+         HeapMgr_freeBatch(&apvBatch[i], (size_t)iBatch);
+      }
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate and free iCount memory chunks, each of some random size
+   less than iSize, in a random order, using all of the bytes that
+   HeapMgr_usableSize() reports for half of them and freeing with
+   HeapMgr_freeSized(). */
+
+static void testUsableRandom(int iCount, int iSize)
+{
+   int i;
+   int iRand;
+   int iLogicalArraySize;
+
+   iLogicalArraySize = (iCount / 3) + 1;
+
+   i = 0;
+
+   /* Call HeapMgr_malloc() and HeapMgr_freeSized() in a randomly
+      interleaved manner. */
+   while (i < iCount)
+   {
+      /* Assign some random integer to iRand. */
+      iRand = rand() % iLogicalArraySize;
+
+      if (apcChunks[iRand] == NULL)
+      {
+         aiSizes[iRand] = (rand() % iSize) + 1;
+         apcChunks[iRand] = (char*)HeapMgr_malloc((size_t)aiSizes[iRand]);
+         if (apcChunks[iRand] == NULL)
+         {
+            printf("Malloc returned NULL.\n");
+            exit(0);
+         }
+
+         #ifndef NDEBUG
+         {
+            /* The chunk holds at least what was asked for, and what
+               HeapMgr_goodSize() promised, aligned as malloc() aligns
+               for data of any type. */
+            ASSURE((size_t)apcChunks[iRand] % (2 * sizeof(size_t))
+                   == 0);
+            ASSURE(HeapMgr_goodSize((size_t)aiSizes[iRand])
+                   >= (size_t)aiSizes[iRand]);
+            ASSURE(HeapMgr_usableSize(apcChunks[iRand])
+                   >= HeapMgr_goodSize((size_t)aiSizes[iRand]));
+         }
+         #endif
+
+         /* Grow into the slack of every other chunk, and free the
+            rest by the size asked for, which may lead to fewer units
+            than the chunk holds. */
+         if (iRand % 2 == 0)
+            aiSizes[iRand] = (int)HeapMgr_usableSize(apcChunks[iRand]);
+
+         #ifndef NDEBUG
+         {
+            /* Fill the newly allocated chunk with some character.
+               The character is derived from the last digit of iRand.
+               So later, given iRand, we can check to make sure that
+               the contents haven't been corrupted. */
+            int iCol;
+            char c = (char)((iRand % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[iRand]; iCol++)
+               apcChunks[iRand][iCol] = c;
+         }
+         #endif
+
+         i++;
+      }
+
+      /* Assign some random integer to iRand. */
+      iRand = rand() % iLogicalArraySize;
+
+      /* If apcChunks[iRand] contains a chunk, free it and set
+         apcChunks[iRand] to NULL. */
+      if (apcChunks[iRand] != NULL)
+      {
+         #ifndef NDEBUG
+         {
+            /* Check the chunk that is about to be freed to make sure
+               that its contents haven't been corrupted. */
+            int iCol;
+            char c = (char)((iRand % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[iRand]; iCol++)
+               ASSURE(apcChunks[iRand][iCol] == c);
+         }
+         #endif
+
+         HeapMgr_freeSized(apcChunks[iRand], (size_t)aiSizes[iRand]);
+         apcChunks[iRand] = NULL;
+      }
+   }
+
+   /* Free the rest of the chunks. */
+   for (i = 0; i < iLogicalArraySize; i++)
+   {
+      if (apcChunks[i] != NULL)
+      {
+         #ifndef NDEBUG
+         {
+            /* Check the chunk that is about to be freed to make sure
+               that its contents haven't been corrupted. */
+            int iCol;
+            char c = (char)((i % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[i]; iCol++)
+               ASSURE(apcChunks[i][iCol] == c);
+         }
+         #endif
+
+         HeapMgr_freeSized(apcChunks[i], (size_t)aiSizes[i]);
+         apcChunks[i] = NULL;
+      }
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate and free iCount memory chunks, each of some random size
+   less than iSize, in a random order, spread over a few heaps made
+   by HeapMgr_new(). Destroy the heaps with half of their chunks
+   still allocated. */
+
+static void testHeapsRandom(int iCount, int iSize)
+{
+   /* The number of heaps. Chunk i lives in heap i % HEAP_COUNT. */
+   enum {HEAP_COUNT = 4};
+
+   HeapMgr_T aoHeaps[HEAP_COUNT];
+   int i;
+   int iRand;
+   int iLogicalArraySize;
+
+   iLogicalArraySize = (iCount / 3) + 1;
+
+   for (i = 0; i < HEAP_COUNT; i++)
+   {
+      aoHeaps[i] = HeapMgr_new();
+      if (aoHeaps[i] == NULL)
+      {
+         printf("New returned NULL.\n");
+         exit(0);
+      }
+   }
+
+   i = 0;
+
+   /* Call HeapMgr_mallocIn() and HeapMgr_freeIn() in a randomly
+      interleaved manner. */
+   while (i < iCount)
+   {
+      /* Assign some random integer to iRand. */
+      iRand = rand() % iLogicalArraySize;
+
+      if (apcChunks[iRand] == NULL)
+      {
+         aiSizes[iRand] = (rand() % iSize) + 1;
+         apcChunks[iRand] = (char*)HeapMgr_mallocIn(
+            aoHeaps[iRand % HEAP_COUNT], (size_t)aiSizes[iRand]);
+         if (apcChunks[iRand] == NULL)
+         {
+            printf("MallocIn returned NULL.\n");
+            exit(0);
+         }
+
+         #ifndef NDEBUG
+         {
+            /* Fill the newly allocated chunk with some character.
+               The character is derived from the last digit of iRand.
+               So later, given iRand, we can check to make sure that
+               the contents haven't been corrupted. */
+            int iCol;
+            char c = (char)((iRand % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[iRand]; iCol++)
+               apcChunks[iRand][iCol] = c;
+         }
+         #endif
+
+         i++;
+      }
+
+      /* Assign some random integer to iRand. */
+      iRand = rand() % iLogicalArraySize;
+
+      /* If apcChunks[iRand] contains a chunk, free it and set
+         apcChunks[iRand] to NULL. */
+      if (apcChunks[iRand] != NULL)
+      {
+         #ifndef NDEBUG
+         {
+            /* Check the chunk that is about to be freed to make sure
+               that its contents haven't been corrupted. */
+            int iCol;
+            char c = (char)((iRand % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[iRand]; iCol++)
+               ASSURE(apcChunks[iRand][iCol] == c);
+         }
+         #endif
+
+         HeapMgr_freeIn(aoHeaps[iRand % HEAP_COUNT], apcChunks[iRand]);
+         apcChunks[iRand] = NULL;
+      }
+   }
+
+   /* Check the rest of the chunks, freeing every other one. */
+   for (i = 0; i < iLogicalArraySize; i++)
+   {
+      if (apcChunks[i] != NULL)
+      {
+         #ifndef NDEBUG
+         {
+            /* Check the chunk to make sure that its contents haven't
+               been corrupted. */
+            int iCol;
+            char c = (char)((i % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[i]; iCol++)
+               ASSURE(apcChunks[i][iCol] == c);
+         }
+         #endif
+
+         if (i % 2 == 0)
+            HeapMgr_freeIn(aoHeaps[i % HEAP_COUNT], apcChunks[i]);
+         apcChunks[i] = NULL;
+      }
+   }
+
+   /* Destroy the heaps, and with them the chunks left in them. */
+   for (i = 0; i < HEAP_COUNT; i++)
+      HeapMgr_destroy(aoHeaps[i]);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* The number of threads that testThreadsRandom() runs. */
+enum {THREAD_COUNT = 4};
+
+/* The work of one thread of testThreadsRandom(). Each thread owns
+   its own slice of apcChunks and aiSizes. */
+
+struct ThreadWork
+{
+   /* The index of the first element of the slice. */
+   int iFirst;
+
+   /* The number of elements in the slice. */
+   int iLength;
+
+   /* The number of chunks for the thread to allocate. */
+   int iCount;
+
+   /* The (maximum) size of each chunk. */
+   int iSize;
+
+   /* The state of the random number generator of the thread, as
+      rand() cannot be shared among threads. */
+   unsigned long ulSeed;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Return a random integer between 0 and 32767, advancing the
+   random number generator state *pulSeed. */
+
+static int nextRand(unsigned long *pulSeed)
+{
+   *pulSeed = (*pulSeed * 1103515245UL + 12345UL) & 0xffffffffUL;
+   return (int)((*pulSeed >> 16) & 0x7fffUL);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate, resize, and free chunks in the slice that pv, a
+   struct ThreadWork, describes, in a random order. Return NULL. */
+
+static void *runThreadWork(void *pv)
+{
+   struct ThreadWork *psWork = (struct ThreadWork*)pv;
+   char *pcNew;
+   int i;
+   int iRand;
+
+   i = 0;
+
+   /* Call HeapMgr_malloc(), HeapMgr_calloc(), HeapMgr_realloc(), and
+      HeapMgr_free() in a randomly interleaved manner. */
+   while (i < psWork->iCount)
+   {
+      /* Assign some random element of the slice to iRand. */
+      iRand = psWork->iFirst +
+         (nextRand(&psWork->ulSeed) % psWork->iLength);
+
+      if (apcChunks[iRand] == NULL)
+      {
+         aiSizes[iRand] = (nextRand(&psWork->ulSeed) % psWork->iSize)
+            + 1;
+         if (iRand % 2 == 0)
+            apcChunks[iRand] =
+               (char*)HeapMgr_malloc((size_t)aiSizes[iRand]);
+         else
+            apcChunks[iRand] =
+               (char*)HeapMgr_calloc(1, (size_t)aiSizes[iRand]);
+         if (apcChunks[iRand] == NULL)
+         {
+            printf("Malloc returned NULL.\n");
+            exit(0);
+         }
+
+         #ifndef NDEBUG
+         {
+            /* Fill the newly allocated chunk with some character,
+               checking first that calloc() zeroed it. */
+            int iCol;
+            char c = (char)((iRand % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[iRand]; iCol++)
+            {
+               if (iRand % 2 != 0)
+                  ASSURE(apcChunks[iRand][iCol] == '\0');
+               apcChunks[iRand][iCol] = c;
+            }
+         }
+         #endif
+
+         i++;
+      }
+
+      /* Assign some random element of the slice to iRand. */
+      iRand = psWork->iFirst +
+         (nextRand(&psWork->ulSeed) % psWork->iLength);
+
+      /* If apcChunks[iRand] contains a chunk, resize it half of the
+         time, and free it and set apcChunks[iRand] to NULL the other
+         half. */
+      if (apcChunks[iRand] != NULL)
+      {
+         #ifndef NDEBUG
+         {
+            /* Check the chunk to make sure that its contents haven't
+               been corrupted. */
+            int iCol;
+            char c = (char)((iRand % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[iRand]; iCol++)
+               ASSURE(apcChunks[iRand][iCol] == c);
+         }
+         #endif
+
+         if (nextRand(&psWork->ulSeed) % 2 == 0)
+         {
+            int iOldSize = aiSizes[iRand];
+
+            aiSizes[iRand] = (nextRand(&psWork->ulSeed) % psWork->iSize)
+               + 1;
+            pcNew = (char*)HeapMgr_realloc(apcChunks[iRand],
+                                           (size_t)aiSizes[iRand]);
+            if (pcNew == NULL)
+            {
+               printf("Realloc returned NULL.\n");
+               exit(0);
+            }
+            apcChunks[iRand] = pcNew;
+
+            #ifndef NDEBUG
+            {
+               /* Fill the bytes that the chunk gained. */
+               int iCol;
+               char c = (char)((iRand % 10) + '0');
+               for (iCol = iOldSize; iCol < aiSizes[iRand]; iCol++)
+                  apcChunks[iRand][iCol] = c;
+            }
+            #else
+            (void)iOldSize;
+            #endif
+         }
+         else
+         {
+            HeapMgr_free(apcChunks[iRand]);
+            apcChunks[iRand] = NULL;
+         }
+      }
+   }
+   return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate, resize, and free iCount memory chunks, each of some
+   random size less than iSize, in a random order, from a few threads
+   at once. Only a thread-safe HeapMgr can pass this test, so it is
+   skipped unless HEAPMGR_THREADS is defined. */
+
+static void testThreadsRandom(int iCount, int iSize)
+{
+   struct ThreadWork asWork[THREAD_COUNT];
+   pthread_t aiThreads[THREAD_COUNT];
+   int i;
+   int iLogicalArraySize;
+
+   requireThreadSafe();
+
+   iLogicalArraySize = (iCount / 3) + THREAD_COUNT;
+
+   /* Give each thread an even share of the chunks and of the
+      elements of apcChunks. */
+   for (i = 0; i < THREAD_COUNT; i++)
+   {
+      asWork[i].iFirst = i * (iLogicalArraySize / THREAD_COUNT);
+      asWork[i].iLength = iLogicalArraySize / THREAD_COUNT;
+      asWork[i].iCount = iCount / THREAD_COUNT;
+      asWork[i].iSize = iSize;
+      asWork[i].ulSeed = (unsigned long)rand();
+      if (pthread_create(&aiThreads[i], NULL, runThreadWork,
+                         &asWork[i]) != 0)
+      {
+         printf("Could not create a thread.\n");
+         exit(0);
+      }
+   }
+   for (i = 0; i < THREAD_COUNT; i++)
+      (void)pthread_join(aiThreads[i], NULL);
+
+   /* Free the rest of the chunks. */
+   for (i = 0; i < iLogicalArraySize; i++)
+   {
+      if (apcChunks[i] != NULL)
+      {
+         #ifndef NDEBUG
+         {
+            /* Check the chunk to make sure that its contents haven't
+               been corrupted. */
+            int iCol;
+            char c = (char)((i % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[i]; iCol++)
+               ASSURE(apcChunks[i][iCol] == c);
+         }
+         #endif
+
+         HeapMgr_free(apcChunks[i]);
+         apcChunks[i] = NULL;
+      }
+   }
+
+   #ifndef NDEBUG
+   {
+      /* A thread-safe HeapMgr that counts its locks must have taken
+         the lock of the end of the heap to grow it. */
+      struct HeapMgrLockStats sStats;
+      int iLock;
+      if (HeapMgr_getLockStats(NULL, 0, &sStats))
+      {
+         ASSURE(sStats.ulAcquisitions > 0);
+         ASSURE(sStats.ulContentions <= sStats.ulAcquisitions);
+      }
+
+      /* Every lock after it, those of the slabs too, has consistent
+         counts. */
+      for (iLock = 1; HeapMgr_getLockStats(NULL, iLock, &sStats);
+           iLock++)
+         ASSURE(sStats.ulContentions <= sStats.ulAcquisitions);
+   }
+   #endif
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate and free chunks in the slice that pv, a struct ThreadWork,
+   describes, in bursts that fill the slice and then empty it in
+   reverse order, leaving the last burst allocated. Return NULL. */
+
+static void *runThreadBursts(void *pv)
+{
+   struct ThreadWork *psWork = (struct ThreadWork*)pv;
+   int i;
+   int iDone;
+
+   iDone = 0;
+   while (iDone < psWork->iCount)
+   {
+      /* Free the chunks of the previous burst, newest first. */
+      for (i = psWork->iFirst + psWork->iLength - 1;
+           i >= psWork->iFirst; i--)
+      {
+         if (apcChunks[i] != NULL)
+         {
+            #ifndef NDEBUG
+            {
+               /* Check the chunk to make sure that its contents
+                  haven't been corrupted. */
+               int iCol;
+               char c = (char)((i % 10) + '0');
+               for (iCol = 0; iCol < psWork->iSize; iCol++)
+                  ASSURE(apcChunks[i][iCol] == c);
+            }
+            #endif
+
+            HeapMgr_free(apcChunks[i]);
+            apcChunks[i] = NULL;
+         }
+      }
+
+      /* Allocate the chunks of the next burst. */
+      for (i = psWork->iFirst;
+           (i < psWork->iFirst + psWork->iLength) &&
+           (iDone < psWork->iCount);
+           i++, iDone++)
+      {
+         apcChunks[i] = (char*)HeapMgr_malloc((size_t)psWork->iSize);
+         if (apcChunks[i] == NULL)
+         {
+            printf("Malloc returned NULL.\n");
+            exit(0);
+         }
+
+         #ifndef NDEBUG
+         {
+            /* Fill the newly allocated chunk with some character. */
+            int iCol;
+            char c = (char)((i % 10) + '0');
+            for (iCol = 0; iCol < psWork->iSize; iCol++)
+               apcChunks[i][iCol] = c;
+         }
+         #endif
+      }
+   }
+   return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate and free iCount memory chunks, each of size iSize, in
+   bursts from a few threads at once, as request handlers would.
+   Only a thread-safe HeapMgr can pass this test, so it is skipped
+   unless HEAPMGR_THREADS is defined. */
+
+static void testThreadsFixed(int iCount, int iSize)
+{
+   /* The number of chunks in a burst of one thread. */
+   enum {BURST_LENGTH = 100};
+
+   struct ThreadWork asWork[THREAD_COUNT];
+   pthread_t aiThreads[THREAD_COUNT];
+   int i;
+
+   requireThreadSafe();
+
+   /* Give each thread an even share of the chunks, and a slice of
+      apcChunks for a burst. The threads exit with chunks that they
+      freed last still in their hands. */
+   for (i = 0; i < THREAD_COUNT; i++)
+   {
+      asWork[i].iFirst = i * BURST_LENGTH;
+      asWork[i].iLength = BURST_LENGTH;
+      asWork[i].iCount = iCount / THREAD_COUNT;
+      asWork[i].iSize = iSize;
+      asWork[i].ulSeed = 0;
+      if (pthread_create(&aiThreads[i], NULL, runThreadBursts,
+                         &asWork[i]) != 0)
+      {
+         printf("Could not create a thread.\n");
+         exit(0);
+      }
+   }
+   for (i = 0; i < THREAD_COUNT; i++)
+      (void)pthread_join(aiThreads[i], NULL);
+
+   /* Free the last bursts from the main thread. */
+   for (i = 0; i < THREAD_COUNT * BURST_LENGTH; i++)
+   {
+      if (apcChunks[i] != NULL)
+      {
+         HeapMgr_free(apcChunks[i]);
+         apcChunks[i] = NULL;
+      }
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* The number of elements of apcChunks through which one thread of
+   testThreadsRemote() hands chunks to the next. */
+enum {MAILBOX_LENGTH = 64};
+
+/* Return the chunk in element i of apcChunks, which another thread
+   may change at any time. */
+
+static char *getMailbox(int i)
+{
+   return ((char *volatile *)apcChunks)[i];
+}
+
+/* Put pc in element i of apcChunks, after any stores before it. */
+
+static void setMailbox(int i, char *pc)
+{
+   __sync_synchronize();
+   ((char *volatile *)apcChunks)[i] = pc;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate chunks into the slice that pv, a struct ThreadWork,
+   describes, whenever the next thread has emptied their elements,
+   and free the chunks that the previous thread puts in its own
+   slice. Return NULL. */
+
+static void *runThreadRemote(void *pv)
+{
+   struct ThreadWork *psWork = (struct ThreadWork*)pv;
+   int iFrom; /* the first element of the slice of the previous
+                 thread */
+   int iSent;
+   int iFreed;
+   int i;
+   char *pc;
+
+   iFrom = (psWork->iFirst + (THREAD_COUNT - 1) * MAILBOX_LENGTH)
+      % (THREAD_COUNT * MAILBOX_LENGTH);
+   iSent = 0;
+   iFreed = 0;
+   while ((iSent < psWork->iCount) || (iFreed < psWork->iCount))
+   {
+      /* Allocate chunks into the empty elements of the slice. */
+      for (i = psWork->iFirst;
+           (i < psWork->iFirst + MAILBOX_LENGTH) &&
+           (iSent < psWork->iCount);
+           i++)
+      {
+         if (getMailbox(i) != NULL)
+            continue;
+         aiSizes[i] = (nextRand(&psWork->ulSeed) % psWork->iSize) + 1;
+         pc = (char*)HeapMgr_malloc((size_t)aiSizes[i]);
+         if (pc == NULL)
+         {
+            printf("Malloc returned NULL.\n");
+            exit(0);
+         }
+
+         #ifndef NDEBUG
+         {
+            /* Fill the newly allocated chunk with some character. */
+            int iCol;
+            char c = (char)((i % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[i]; iCol++)
+               pc[iCol] = c;
+         }
+         #endif
+
+         setMailbox(i, pc);
+         iSent++;
+      }
+
+      /* Free the chunks that the previous thread allocated. */
+      for (i = iFrom; i < iFrom + MAILBOX_LENGTH; i++)
+      {
+         pc = getMailbox(i);
+         if (pc == NULL)
+            continue;
+         __sync_synchronize();
+
+         #ifndef NDEBUG
+         {
+            /* Check the chunk to make sure that its contents haven't
+               been corrupted. */
+            int iCol;
+            char c = (char)((i % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[i]; iCol++)
+               ASSURE(pc[iCol] == c);
+         }
+         #endif
+
+         HeapMgr_free(pc);
+         setMailbox(i, NULL);
+         iFreed++;
+      }
+      (void)sched_yield();
+   }
+   return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate iCount memory chunks, each of some random size less than
+   iSize, from a few threads at once, each thread handing the chunks
+   that it allocates to the next one to free. Only a thread-safe
+   HeapMgr can pass this test, so it is skipped unless
+   HEAPMGR_THREADS is defined. */
+
+static void testThreadsRemote(int iCount, int iSize)
+{
+   struct ThreadWork asWork[THREAD_COUNT];
+   pthread_t aiThreads[THREAD_COUNT];
+   int i;
+
+   requireThreadSafe();
+
+   /* Give each thread an even share of the chunks, and a slice of
+      apcChunks to hand them over in. */
+   for (i = 0; i < THREAD_COUNT; i++)
+   {
+      asWork[i].iFirst = i * MAILBOX_LENGTH;
+      asWork[i].iLength = MAILBOX_LENGTH;
+      asWork[i].iCount = iCount / THREAD_COUNT;
+      asWork[i].iSize = iSize;
+      asWork[i].ulSeed = (unsigned long)i + 1UL;
+      if (pthread_create(&aiThreads[i], NULL, runThreadRemote,
+                         &asWork[i]) != 0)
+      {
+         printf("Could not create a thread.\n");
+         exit(0);
+      }
+   }
+   for (i = 0; i < THREAD_COUNT; i++)
+      (void)pthread_join(aiThreads[i], NULL);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Resize memory chunks as testReallocRandom() does, with about half
+   of them big enough for mappings of their own, so that chunks move
+   into and out of mappings, and then allocate a mapped chunk with
+   HeapMgr_calloc(). */
+
+static void testMmapRandom(int iCount, int iSize)
+{
+   /* The base 2 logarithm of the largest alignment to request. */
+   enum {MAX_ALIGNMENT_SHIFT = 16};
+
+   int iShift;
+   size_t uAlignment;
+   size_t uBytes;
+   char *pc;
+
+   HeapMgr_setMmapThreshold((size_t)(iSize / 2) + 1);
+   testReallocRandom(iCount, iSize);
+
+   pc = (char*)HeapMgr_calloc((size_t)iSize, 1);
+   if (pc == NULL)
+   {
+      printf("Calloc returned NULL.\n");
+      exit(0);
+   }
+
+   #ifndef NDEBUG
+   {
+      /* A mapped chunk holds zeros, as the OS gave it. */
+      int iCol;
+      for (iCol = 0; iCol < iSize; iCol++)
+         ASSURE(pc[iCol] == 0);
+   }
+   #endif
+
+   HeapMgr_free(pc);
+
+   /* Allocate aligned chunks, the small ones past the threshold only
+      with their alignment, and move each to a bigger mapping. */
+   for (iShift = 5; iShift <= MAX_ALIGNMENT_SHIFT; iShift++)
+   {
+      uAlignment = (size_t)1 << iShift;
+      uBytes = (iShift % 2 == 0) ? (size_t)iSize : 1;
+      pc = (char*)HeapMgr_memalign(uAlignment, uBytes);
+      if (pc == NULL)
+      {
+         printf("Memalign returned NULL.\n");
+         exit(0);
+      }
+
+      #ifndef NDEBUG
+      {
+         /* Make sure the chunk is aligned, then fill it. */
+         size_t u;
+         ASSURE((size_t)pc % uAlignment == 0);
+         for (u = 0; u < uBytes; u++)
+            pc[u] = (char)((iShift % 10) + '0');
+      }
+      #endif
+
+      pc = (char*)HeapMgr_realloc(pc, 2 * (size_t)iSize);
+      if (pc == NULL)
+      {
+         printf("Realloc returned NULL.\n");
+         exit(0);
+      }
+
+      #ifndef NDEBUG
+      {
+         /* The contents moved with the chunk. */
+         size_t u;
+         for (u = 0; u < uBytes; u++)
+            ASSURE(pc[u] == (char)((iShift % 10) + '0'));
+      }
+      #endif
+
+      HeapMgr_free(pc);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate iCount memory chunks, each of some random size less than
+   iSize, free most of them, hand the free memory back to the OS with
+   HeapMgr_trim(), or wait for a scavenger to do so if iScavenged,
+   and then allocate and free them again. */
+
+static void trimRounds(int iCount, int iSize, int iScavenged)
+{
+   /* The microseconds to give a scavenger. */
+   enum {SCAVENGE_WAIT = 20000};
+
+   /* Every KEEP_EVERY-th chunk stays allocated while trimming. */
+   enum {KEEP_EVERY = 10};
+
+   int i;
+   int iRound;
+   int iLogicalArraySize;
+
+   iLogicalArraySize = (iCount / 2) + 1;
+
+   for (iRound = 0; iRound < 2; iRound++)
+   {
+      /* Allocate the chunks that are not allocated. */
+      for (i = 0; i < iLogicalArraySize; i++)
+      {
+         if (apcChunks[i] != NULL)
+            continue;
+         aiSizes[i] = (rand() % iSize) + 1;
+         apcChunks[i] = (char*)HeapMgr_malloc((size_t)aiSizes[i]);
+         if (apcChunks[i] == NULL)
+         {
+            printf("Malloc returned NULL.\n");
+            exit(0);
+         }
+
+         #ifndef NDEBUG
+         {
+            /* Fill the newly allocated chunk with some character. */
+            int iCol;
+            char c = (char)((i % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[i]; iCol++)
+               apcChunks[i][iCol] = c;
+         }
+         #endif
+      }
+
+      /* Free all but every KEEP_EVERY-th chunk, or all of them in
+         the last round, and trim. */
+      for (i = 0; i < iLogicalArraySize; i++)
+      {
+         if ((iRound == 0) && (i % KEEP_EVERY == 0))
+            continue;
+         HeapMgr_free(apcChunks[i]);
+         apcChunks[i] = NULL;
+      }
+      if (iScavenged)
+         (void)usleep(SCAVENGE_WAIT);
+      else
+         (void)HeapMgr_trim(0);
+
+      #ifndef NDEBUG
+      {
+         /* Check the chunks that stayed to make sure that trimming
+            did not touch their contents. */
+         int iCol;
+         for (i = 0; i < iLogicalArraySize; i++)
+         {
+            char c = (char)((i % 10) + '0');
+            if (apcChunks[i] == NULL)
+               continue;
+            for (iCol = 0; iCol < aiSizes[i]; iCol++)
+               ASSURE(apcChunks[i][iCol] == c);
+         }
+      }
+      #endif
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate iCount memory chunks, each of some random size less than
+   iSize, free most of them, hand the free memory back to the OS with
+   HeapMgr_trim(), and then allocate and free them again. */
+
+static void testTrimRandom(int iCount, int iSize)
+{
+   trimRounds(iCount, iSize, FALSE);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate and free memory chunks as testTrimRandom() does, but let
+   a scavenger thread hand the free memory back to the OS while the
+   rest of the chunks stay allocated. */
+
+static void testScavengeRandom(int iCount, int iSize)
+{
+   /* Only a thread-safe HeapMgr has a scavenger to start. */
+   (void)HeapMgr_startScavenger(1, 2);
+   trimRounds(iCount, iSize, TRUE);
+   HeapMgr_stopScavenger();
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Resize memory chunks as testReallocRandom() does, to sizes of up
+   to a few dozen times iSize, all of them in the heap rather than in
+   mappings of their own. */
+
+static void testLargeRandom(int iCount, int iSize)
+{
+   /* The chunks grow to up to LARGE_FACTOR times iSize. */
+   enum {LARGE_FACTOR = 64};
+
+   HeapMgr_setMmapThreshold((size_t)iSize * LARGE_FACTOR + 1);
+   testReallocRandom(iCount, iSize * LARGE_FACTOR);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate and free memory chunks as testUsableRandom() does, and
+   then resize them as testReallocRandom() does, with every chunk of
+   iSize bytes or less in a slab. */
+
+static void testSlabRandom(int iCount, int iSize)
+{
+   HeapMgr_setSlabThreshold((size_t)iSize);
+   testUsableRandom(iCount, iSize);
+
+   /* testReallocRandom() takes chunks not allocated to hold 0
+      bytes. */
+   memset(aiSizes, 0, sizeof(aiSizes));
+   testReallocRandom(iCount, iSize);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate and free iCount memory chunks in bursts, each chunk of one
+   of a few small sizes, with every so often a chunk of some random
+   size of up to a few times iSize that the small free chunks must
+   merge to make room for. */
+
+static void testFastRandom(int iCount, int iSize)
+{
+   /* The number of chunks allocated, and then freed, per burst. */
+   enum {BURST_COUNT = 32};
+
+   /* The small sizes are multiples of SMALL_STEP bytes. */
+   enum {SMALL_STEP = 24, SMALL_SIZES = 4};
+
+   /* Every LARGE_EVERY-th chunk is a large one. */
+   enum {LARGE_EVERY = 64, LARGE_FACTOR = 4};
+
+   int i;
+   int iRand;
+   int iBurst;
+   int iLogicalArraySize;
+
+   iLogicalArraySize = (iCount / 2) + 1;
+
+   for (i = 0; i < iCount; i += iBurst)
+   {
+      iBurst = (rand() % BURST_COUNT) + 1;
+      if (iBurst > iCount - i)
+         iBurst = iCount - i;
+
+      /* Allocate a burst of chunks into random slots, freeing any
+         chunk that a slot holds first. */
+      for (iRand = 0; iRand < iBurst; iRand++)
+      {
+         int iSlot = rand() % iLogicalArraySize;
+
+         if (apcChunks[iSlot] != NULL)
+         {
+            #ifndef NDEBUG
+            {
+               /* Check the chunk that is about to be freed to make
+                  sure that its contents haven't been corrupted. */
+               int iCol;
+               char c = (char)((iSlot % 10) + '0');
+               for (iCol = 0; iCol < aiSizes[iSlot]; iCol++)
+                  ASSURE(apcChunks[iSlot][iCol] == c);
+            }
+            #endif
+
+            HeapMgr_free(apcChunks[iSlot]);
+         }
+
+         if (rand() % LARGE_EVERY == 0)
+            aiSizes[iSlot] = (rand() % (iSize * LARGE_FACTOR)) + 1;
+         else
+            aiSizes[iSlot] = ((rand() % SMALL_SIZES) + 1) * SMALL_STEP;
+         apcChunks[iSlot] =
+            (char*)HeapMgr_malloc((size_t)aiSizes[iSlot]);
+         if (apcChunks[iSlot] == NULL)
+         {
+            printf("Malloc returned NULL.\n");
+            exit(0);
+         }
+
+         #ifndef NDEBUG
+         {
+            /* Fill the newly allocated chunk with some character. */
+            int iCol;
+            char c = (char)((iSlot % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[iSlot]; iCol++)
+               apcChunks[iSlot][iCol] = c;
+         }
+         #endif
+      }
+
+      /* Free as many chunks from random slots again. */
+      for (iRand = 0; iRand < iBurst; iRand++)
+      {
+         int iSlot = rand() % iLogicalArraySize;
+
+         if (apcChunks[iSlot] == NULL)
+            continue;
+
+         #ifndef NDEBUG
+         {
+            /* Check the chunk that is about to be freed to make sure
+               that its contents haven't been corrupted. */
+            int iCol;
+            char c = (char)((iSlot % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[iSlot]; iCol++)
+               ASSURE(apcChunks[iSlot][iCol] == c);
+         }
+         #endif
+
+         HeapMgr_free(apcChunks[iSlot]);
+         apcChunks[iSlot] = NULL;
+      }
+   }
+
+   /* Free the rest of the chunks, and hand what is free back to the
+      OS. */
+   for (i = 0; i < iLogicalArraySize; i++)
+   {
+      if (apcChunks[i] != NULL)
+      {
+         #ifndef NDEBUG
+         {
+            /* Check the chunk that is about to be freed to make sure
+               that its contents haven't been corrupted. */
+            int iCol;
+            char c = (char)((i % 10) + '0');
+            for (iCol = 0; iCol < aiSizes[i]; iCol++)
+               ASSURE(apcChunks[i][iCol] == c);
+         }
+         #endif
+
+         HeapMgr_free(apcChunks[i]);
+         apcChunks[i] = NULL;
+      }
+   }
+   (void)HeapMgr_trim(0);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate, free, and trim memory chunks so that the chunks freed
+   last lie just below memory that the heap has never handed out, and
+   then allocate chunks of some random size less than iSize with
+   HeapMgr_calloc() over that memory, iCount times over, making sure
+   that they are zeroed. */
+
+static void testCallocFresh(int iCount, int iSize)
+{
+   /* The sizes of the chunk that trimming gives back, and of the one
+      that stays below it. */
+   enum {BIG_SIZE = 1 << 20, KEPT_SIZE = 100000};
+
+   /* The largest size of the small chunk freed last. */
+   enum {SMALL_SIZE = 64};
+
+   int i;
+   int iCol;
+   int iNewSize;
+   char *pcKept;
+   char *pcNew;
+
+   /* Keep every chunk in the heap, and out of slabs. */
+   HeapMgr_setSlabThreshold(0);
+   HeapMgr_setMmapThreshold((size_t)BIG_SIZE * 2);
+
+   for (i = 0; i < iCount; i++)
+   {
+      /* Free a big chunk at the end of the heap, which trims it, and
+         free a small chunk just past the chunk that stays, so that
+         trimming leaves a free chunk there that reaches into the
+         memory that the big one gave back. */
+      HeapMgr_free(HeapMgr_malloc((size_t)BIG_SIZE));
+      pcKept = (char*)HeapMgr_malloc((size_t)KEPT_SIZE);
+      HeapMgr_free(HeapMgr_malloc((size_t)(rand() % SMALL_SIZE) + 1));
+      (void)HeapMgr_trim(0);
+
+      iNewSize = (rand() % iSize) + 1;
+      pcNew = (char*)HeapMgr_calloc((size_t)iNewSize, (size_t)1);
+      if ((pcKept == NULL) || (pcNew == NULL))
+      {
+         printf("Calloc returned NULL.\n");
+         exit(0);
+      }
+
+      /* Check for a nonzero byte even without NDEBUG, as this is
+         what the test is about. */
+      for (iCol = 0; iCol < iNewSize; iCol++)
+         if (pcNew[iCol] != '\0')
+         {
+            printf("Calloc returned a nonzero byte at offset %d.\n",
+                   iCol);
+            exit(0);
+         }
+
+      HeapMgr_free(pcNew);
+      HeapMgr_free(pcKept);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* The bytes in each memory page that testSlabFootprint() counts. */
+enum {PAGE_BYTES = 4096};
+
+/* Return -1, 0, or 1 as the page that *pv1, an element of apvBatch,
+   lies before, at, or after the page that *pv2 does. */
+
+static int comparePages(const void *pv1, const void *pv2)
+{
+   unsigned long ulPage1 =
+      (unsigned long)*(void *const *)pv1 / (unsigned long)PAGE_BYTES;
+   unsigned long ulPage2 =
+      (unsigned long)*(void *const *)pv2 / (unsigned long)PAGE_BYTES;
+
+   if (ulPage1 < ulPage2)
+      return -1;
+   if (ulPage1 > ulPage2)
+      return 1;
+   return 0;
+}
+
+/* Return how many memory pages the chunks of apcChunks from element
+   iFirst up to but not including element iLast start in. */
+
+static long countPages(int iFirst, int iLast)
+{
+   int i;
+   long lPages = 0;
+
+   for (i = iFirst; i < iLast; i++)
+      apvBatch[i - iFirst] = apcChunks[i];
+   qsort(apvBatch, (size_t)(iLast - iFirst), sizeof(void*),
+         comparePages);
+   for (i = 0; i < iLast - iFirst; i++)
+      if ((i == 0) || (comparePages(&apvBatch[i - 1], &apvBatch[i])
+                       != 0))
+         lPages++;
+   return lPages;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Allocate iCount memory chunks of a few bytes each, or a few
+   thousand if iCount is smaller, the first half of them each with a
+   header of its own and the second half in slabs, making sure that
+   the slabs spread over fewer pages. iSize is unused. */
+
+static void testSlabFootprint(int iCount, int iSize)
+{
+   /* The size of each chunk, and the fewest chunks in each half. */
+   enum {CHUNK_SIZE = 16, MIN_HALF = 4096};
+
+   int i;
+   int iHalf;
+   int iPhase;
+   long alPages[2]; /* pages that the chunks of each half start in */
+
+   (void)iSize;
+
+   /* A HeapMgr whose good sizes are the sizes requested has no size
+      classes, and so no slabs to measure. */
+   if (HeapMgr_goodSize(1) == 1)
+   {
+      printf("skipped: HeapMgr has no size classes\n");
+      exit(0);
+   }
+
+   iHalf = iCount / 2;
+   if (iHalf < MIN_HALF)
+      iHalf = MIN_HALF;
+
+   for (iPhase = 0; iPhase < 2; iPhase++)
+   {
+      HeapMgr_setSlabThreshold((iPhase == 0) ? 0 : (size_t)CHUNK_SIZE);
+      for (i = iPhase * iHalf; i < (iPhase + 1) * iHalf; i++)
+      {
+         apcChunks[i] = (char*)HeapMgr_malloc((size_t)CHUNK_SIZE);
+         if (apcChunks[i] == NULL)
+         {
+            printf("Malloc returned NULL.\n");
+            exit(0);
+         }
+
+         #ifndef NDEBUG
+         {
+            /* Fill the newly allocated chunk with some character. */
+            int iCol;
+            char c = (char)((i % 10) + '0');
+            for (iCol = 0; iCol < CHUNK_SIZE; iCol++)
+               apcChunks[i][iCol] = c;
+         }
+         #endif
+      }
+      alPages[iPhase] =
+         countPages(iPhase * iHalf, (iPhase + 1) * iHalf);
+   }
+
+   /* Compare even with NDEBUG, as this is what the test is about.
+      Counting pages rather than watching the break also counts chunks
+      that come from mappings, as thread pages do. */
+   if (alPages[1] >= alPages[0])
+   {
+      printf("Slabs took %ld pages, chunks with headers %ld.\n",
+             alPages[1], alPages[0]);
+      exit(0);
+   }
+
+   for (i = 0; i < 2 * iHalf; i++)
+   {
+      #ifndef NDEBUG
+      {
+         /* Check the chunk that is about to be freed to make sure
+            that its contents haven't been corrupted. */
+         int iCol;
+         char c = (char)((i % 10) + '0');
+         for (iCol = 0; iCol < CHUNK_SIZE; iCol++)
+            ASSURE(apcChunks[i][iCol] == c);
+      }
+      #endif
+
+      HeapMgr_free(apcChunks[i]);
+      apcChunks[i] = NULL;
+   }
+}